@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+#include "U3.h"
+#include "AppleU3UserClient.h"
+
+#define super IOUserClient
+OSDefineMetaClassAndStructors(AppleU3UserClient, IOUserClient)
+
+static const IOExternalMethod sMethods[kU3UserClientNumMethods] =
+{
+	{	// kU3UserClientResetLockStats
+		NULL,
+		(IOMethod) &AppleU3UserClient::resetLockStats,
+		kIOUCScalarIScalarO,
+		0,
+		0
+	}
+};
+
+// **********************************************************************************
+// initWithTask
+//
+// Register traffic is only exposed to administrators
+// **********************************************************************************
+bool AppleU3UserClient::initWithTask( task_t owningTask, void *securityToken, UInt32 type )
+{
+	if (!super::initWithTask(owningTask, securityToken, type))
+		return false;
+
+	if (clientHasPrivilege(securityToken, kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+		return false;
+
+	u3 = NULL;
+
+	return true;
+}
+
+// **********************************************************************************
+// start
+//
+// **********************************************************************************
+bool AppleU3UserClient::start( IOService *provider )
+{
+	if (!(u3 = OSDynamicCast(AppleU3, provider)))
+		return false;
+
+	return super::start(provider);
+}
+
+// **********************************************************************************
+// clientClose
+//
+// **********************************************************************************
+IOReturn AppleU3UserClient::clientClose( void )
+{
+	if (!isInactive())
+		terminate();
+
+	return kIOReturnSuccess;
+}
+
+// **********************************************************************************
+// clientMemoryForType
+//
+// All memory handed out here is mapped read-only into the client
+// **********************************************************************************
+IOReturn AppleU3UserClient::clientMemoryForType( UInt32 type, IOOptionBits *options, IOMemoryDescriptor **memory )
+{
+	IOMemoryDescriptor *md = NULL;
+
+	if (!u3)
+		return kIOReturnNotAttached;
+
+	switch (type)
+	{
+		case kU3UserClientTraceMemory:
+#ifdef U3_MMIO_TRACE
+			md = u3->traceMemory;
+#endif
+			break;
+
+		case kU3UserClientStatsMemory:
+			md = u3->statsMemory;
+			break;
+
+		case kU3UserClientRegisterMemory:
+			md = u3->regWindowMemory;
+			break;
+
+		default:
+			break;
+	}
+
+	if (!md)
+		return kIOReturnUnsupported;
+
+	md->retain();
+	*options = kIOMapReadOnly;
+	if (type == kU3UserClientRegisterMemory)
+		*options |= kIOMapInhibitCache;
+	*memory = md;
+
+	return kIOReturnSuccess;
+}
+
+// **********************************************************************************
+// getTargetAndMethodForIndex
+//
+// **********************************************************************************
+IOExternalMethod *AppleU3UserClient::getTargetAndMethodForIndex( IOService **target, UInt32 index )
+{
+	if (index >= kU3UserClientNumMethods)
+		return NULL;
+
+	*target = this;
+
+	return (IOExternalMethod *) &sMethods[index];
+}
+
+// **********************************************************************************
+// resetLockStats
+//
+// **********************************************************************************
+IOReturn AppleU3UserClient::resetLockStats( void )
+{
+	if (!u3)
+		return kIOReturnNotAttached;
+
+	u3->resetLockStats();
+
+	return kIOReturnSuccess;
+}
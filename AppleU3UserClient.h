@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+#ifndef _IOKIT_APPLE_U3_USERCLIENT_H
+#define _IOKIT_APPLE_U3_USERCLIENT_H
+
+// Definitions below are shared with user space clients of AppleU3
+
+#define kAppleU3UserClientClassName		"AppleU3UserClient"
+
+// Memory types for IOConnectMapMemory
+enum
+{
+	kU3UserClientTraceMemory		= 0,	// Uni-N register access trace rings (u3_trace_buffer_t)
+	kU3UserClientStatsMemory		= 1,	// driver statistics page (u3_stats_page_t)
+	kU3UserClientRegisterMemory		= 2		// read-only Uni-N register pages, see u3_reg_window_t
+};
+
+// External method selectors
+enum
+{
+	kU3UserClientResetLockStats		= 0,	// no arguments
+	kU3UserClientNumMethods
+};
+
+// Driver statistics page.  Always present, one page long.
+#define kU3StatsVersion			4
+#define kU3StatsMaxCPUs			4
+
+// Uni-N register lock histograms, one set per CPU.  Bucket n counts acquisitions whose wait
+// (or hold) time in absolute time units t satisfied 2^(n-1) <= t < 2^n; bucket 0 counts t == 0.
+#define kU3LockHistBuckets		32
+
+typedef struct _u3_lock_hist_t
+{
+	UInt32	wait[kU3LockHistBuckets];	// time spent spinning for the lock
+	UInt32	hold[kU3LockHistBuckets];	// time the lock was held, with interrupts disabled
+} u3_lock_hist_t;
+
+// Layout of kU3UserClientRegisterMemory.  The mapping is pageCount pages back to back, page n
+// being the Uni-N page at offset pageOffset[n], so the register at Uni-N offset off is at
+// (n * pageSize) + (off - pageOffset[n]).  Only pages holding no register with read side
+// effects are mapped; pageCount is zero if the window could not be set up.
+#define kU3RegWindowMaxPages	4
+
+typedef struct _u3_reg_window_t
+{
+	UInt32				pageCount;
+	UInt32				pageSize;
+	UInt32				pageOffset[kU3RegWindowMaxPages];
+} u3_reg_window_t;
+
+// The platform-do functions flagged kIOPFFlagOnSleep run when Uni-N saves its state for sleep,
+// and the ones flagged kIOPFFlagOnWake when it returns to normal.  The ones flagged
+// kIOPFFlagHighSpeed or kIOPFFlagLowSpeed run ahead of a processor speed change to that speed,
+// and the sleep and wake ones don't run around a speed change.  Their register writes go out
+// as one locked batch; the functions with config cycles or delays run after it - for the wake
+// phase, once the PCI bridges are restored, and its lastTime is the sum of the two parts.
+enum
+{
+	kU3PowerPhaseSleep		= 0,
+	kU3PowerPhaseWake		= 1,
+	kU3PowerPhaseHighSpeed	= 2,	// added in version 4
+	kU3PowerPhaseLowSpeed	= 3,	// added in version 4
+	kU3NumPowerPhases		= 4
+};
+
+typedef struct _u3_power_phase_stats_t
+{
+	UInt32				runs;
+	UInt32				regCount;		// register writes in the batch
+	UInt32				programCount;	// functions run after the batch
+	UInt32				failures;		// of those, how many could not run or timed out
+	UInt64				lastTime;		// duration of the last run, mach absolute time units
+	UInt64				maxTime;
+} u3_power_phase_stats_t;
+
+typedef struct _u3_stats_page_t
+{
+	UInt32				version;		// kU3StatsVersion
+	UInt32				cpuCount;		// number of entries in lockHist
+	UInt32				reserved[6];
+	u3_lock_hist_t		lockHist[kU3StatsMaxCPUs];
+	u3_reg_window_t		regWindow;		// added in version 2
+	u3_power_phase_stats_t	powerPhase[kU3NumPowerPhases];	// added in version 3
+} u3_stats_page_t;
+
+// Uni-N register access trace.  Present only when AppleU3 is built with U3_MMIO_TRACE.
+//
+// Each CPU appends to its own ring without taking any lock.  head counts every record ever
+// written to the ring, so the newest record is records[(head - 1) & (kU3TraceRingEntries - 1)].
+// A record is zero while being written and complete once sequence == (its position + 1).
+#define kU3TraceVersion			1
+#define kU3TraceMaxCPUs			4
+#define kU3TraceRingEntries		1024	// must be a power of 2
+
+enum
+{
+	kU3TraceRead	= 0,
+	kU3TraceWrite	= 1
+};
+
+typedef struct _u3_trace_record_t
+{
+	UInt64	timestamp;		// mach absolute time
+	UInt32	sequence;		// ring position + 1, zero while the record is being written
+	UInt16	cpu;
+	UInt16	op;				// kU3TraceRead or kU3TraceWrite
+	UInt32	offset;			// register offset within the Uni-N window
+	UInt32	value;			// value read or written
+	UInt32	caller;			// return address into the code that issued the access
+	UInt32	reserved;
+} u3_trace_record_t;
+
+typedef struct _u3_trace_ring_t
+{
+	volatile UInt32		head;
+	UInt32				reserved[7];
+	u3_trace_record_t	records[kU3TraceRingEntries];
+} u3_trace_ring_t;
+
+typedef struct _u3_trace_buffer_t
+{
+	UInt32				version;		// kU3TraceVersion
+	UInt32				cpuCount;		// number of rings
+	UInt32				ringEntries;	// records per ring
+	UInt32				reserved[5];
+	u3_trace_ring_t		rings[kU3TraceMaxCPUs];
+} u3_trace_buffer_t;
+
+#ifdef KERNEL
+
+#include <IOKit/IOUserClient.h>
+
+class AppleU3;
+
+class AppleU3UserClient : public IOUserClient
+{
+    OSDeclareDefaultStructors(AppleU3UserClient)
+
+private:
+	AppleU3					*u3;
+
+public:
+    virtual bool initWithTask( task_t owningTask, void *securityToken, UInt32 type );
+    virtual bool start( IOService *provider );
+    virtual IOReturn clientClose( void );
+    virtual IOReturn clientMemoryForType( UInt32 type, IOOptionBits *options, IOMemoryDescriptor **memory );
+    virtual IOExternalMethod *getTargetAndMethodForIndex( IOService **target, UInt32 index );
+
+	virtual IOReturn resetLockStats( void );
+};
+
+#endif /* KERNEL */
+
+#endif /* _IOKIT_APPLE_U3_USERCLIENT_H */
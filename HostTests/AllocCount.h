@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Counts heap allocations made while htAllocCounting is set.  operator new is replaced
+// everywhere; malloc and calloc are interposed where glibc lets us reach its own allocator.
+// Include in one translation unit per program.
+
+#ifndef _HOSTTESTS_ALLOCCOUNT_H
+#define _HOSTTESTS_ALLOCCOUNT_H
+
+#include <new>
+#include <stdlib.h>
+
+// new and delete are both replaced here, so free() in delete is the matching deallocator
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static volatile bool	htAllocCounting;
+static volatile UInt32	htAllocations;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc (size_t size);
+extern "C" void *__libc_calloc (size_t count, size_t size);
+
+extern "C" void *malloc (size_t size)
+{
+	if (htAllocCounting)
+		htAllocations++;
+	return __libc_malloc (size);
+}
+
+extern "C" void *calloc (size_t count, size_t size)
+{
+	if (htAllocCounting)
+		htAllocations++;
+	return __libc_calloc (count, size);
+}
+
+#define htRawMalloc		__libc_malloc
+#else
+#define htRawMalloc		malloc
+#endif
+
+void *operator new (size_t size)
+{
+	void *p;
+
+	if (htAllocCounting)
+		htAllocations++;
+	if (!(p = htRawMalloc (size ? size : 1)))
+		throw std::bad_alloc ();
+	return p;
+}
+
+void *operator new[] (size_t size)		{ return operator new (size); }
+void operator delete (void *p) throw ()		{ free (p); }
+void operator delete[] (void *p) throw ()	{ free (p); }
+void operator delete (void *p, size_t) throw ()		{ free (p); }
+void operator delete[] (void *p, size_t) throw ()	{ free (p); }
+
+#endif /* _HOSTTESTS_ALLOCCOUNT_H */
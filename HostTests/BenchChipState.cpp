@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Cost of the U3ChipState.h sequences against the simulated chip: start's variant selection,
+// the chip fault handler for each error on each variant, the sleep and wake register lists and
+// the HT link calls.  Each round powers the chip on and injects the error, as the hardware
+// would present it, outside the timed span; the counts are what the chip saw per call.
+
+#include "HostTest.h"
+#include "SimChip.h"
+
+#define kBenchRounds		200000
+
+static u3_reg_access_t	regIndex[kU3RegAccessSlots];
+static UInt32			sink;
+
+static void report (const char *name, UInt64 elapsed, const SimRegPort &port)
+{
+	printf ("  %-28s %6.1f ns/call  %5.2f loads  %5.2f stores  %5.2f locks  %5.2f fences\n", name,
+		(double)elapsed / kBenchRounds,
+		(double)port.loads / kBenchRounds, (double)port.stores / kBenchRounds,
+		(double)port.locks / kBenchRounds, (double)port.fences / kBenchRounds);
+}
+
+// Counts are taken from a separate port so that powering on between rounds doesn't reset them
+static void accumulate (SimRegPort *total, const SimRegPort &port)
+{
+	total->loads += port.loads;
+	total->stores += port.stores;
+	total->locks += port.locks;
+	total->fences += port.fences;
+}
+
+template <UInt32 Variant> static void benchVariant (const char *name)
+{
+	SimRegPort	port;
+	UInt64		start;
+	UInt32		round;
+
+	simPowerOn<Variant> (&port);
+	start = htNanoseconds ();
+	for (round = 0; round < kBenchRounds; round++)
+		sink += U3ChipVariantFor<SimUniNRegs> (U3ReadRegClassified (port, regIndex, SimUniNRegs::versionReg));
+	report (name, htNanoseconds () - start, port);
+}
+
+// Capture, decode and restore the mask - readChipFaultStateFor and handleChipFaultStateFor
+template <UInt32 Variant> static void benchFault (const char *name, bool dart, UInt32 excpBits, UInt32 mear, UInt32 syndrome)
+{
+	typedef SimChipTraits<Variant>	Chip;
+	SimRegPort						port, total;
+	u3_chip_fault_state_t			state;
+	u3_chip_fault_decode_t			decode;
+	UInt64							start, elapsed = 0;
+	UInt32							round;
+
+	for (round = 0; round < kBenchRounds; round++) {
+		simPowerOn<Variant> (&port);
+		if (dart)
+			simInjectDARTExcp<Chip> (&port, kSimDARTExcpWrite | round);
+		else
+			simInjectECC<Chip> (&port, excpBits, mear, syndrome);
+
+		start = htNanoseconds ();
+		U3RestoreChipFaultMask<Chip> (port, U3CaptureChipFault<Chip> (port, regIndex, &state));
+		U3DecodeChipFault<Chip> (&state, &decode);
+		elapsed += htNanoseconds () - start;
+
+		sink += decode.actions + decode.dimm;
+		accumulate (&total, port);
+	}
+	report (name, elapsed, total);
+}
+
+template <UInt32 Variant> static void benchSleepWake (const char *variant, bool hasMPIC)
+{
+	typedef SimChipTraits<Variant>	Chip;
+	SimRegPort						port;
+	u3_uni_n_saved_t				saved;
+	u3_reg_transaction_t			list[kU3UniNRestoreEntries];
+	char							name[64];
+	UInt64							start;
+	UInt32							round, count;
+
+	simPowerOn<Variant> (&port);
+
+	start = htNanoseconds ();
+	for (round = 0; round < kBenchRounds; round++)
+		U3SaveUniNState<SimUniNRegs> (port, regIndex, Chip::hasPMClockControl, &saved);
+	snprintf (name, sizeof(name), "%s save", variant);
+	report (name, htNanoseconds () - start, port);
+
+	port.clearCounts ();
+	start = htNanoseconds ();
+	for (round = 0; round < kBenchRounds; round++) {
+		count = U3BuildUniNSleep<SimUniNRegs> (hasMPIC, list);
+		U3RunRegTransaction (port, list, count);
+	}
+	snprintf (name, sizeof(name), "%s sleep", variant);
+	report (name, htNanoseconds () - start, port);
+
+	port.clearCounts ();
+	start = htNanoseconds ();
+	for (round = 0; round < kBenchRounds; round++) {
+		count = U3BuildUniNRestore<SimUniNRegs> (&saved, hasMPIC, Chip::hasPMClockControl, list);
+		U3RunRegTransaction (port, list, count);
+	}
+	snprintf (name, sizeof(name), "%s restore", variant);
+	report (name, htNanoseconds () - start, port);
+}
+
+static void benchHTLink (void)
+{
+	SimRegPort	port;
+	UInt64		start;
+	UInt32		round, outWidth, inWidth;
+
+	simPowerOn<kU3VariantU4> (&port);
+
+	start = htNanoseconds ();
+	for (round = 0; round < kBenchRounds; round++) {
+		U3SetHTLinkFrequency<SimUniNRegs> (port, round & 7);
+		sink += U3GetHTLinkFrequency<SimUniNRegs> (port, regIndex);
+	}
+	report ("HT frequency set and get", htNanoseconds () - start, port);
+
+	port.clearCounts ();
+	start = htNanoseconds ();
+	for (round = 0; round < kBenchRounds; round++) {
+		U3SetHTLinkWidth<SimUniNRegs> (port, round & 7, (round >> 3) & 7);
+		U3GetHTLinkWidth<SimUniNRegs> (port, regIndex, &outWidth, &inWidth);
+		sink += outWidth + inWidth;
+	}
+	report ("HT width set and get", htNanoseconds () - start, port);
+}
+
+int main (void)
+{
+	UInt32	heavyMEAR = U3SetRegField<SimChipTraits<kU3VariantHeavy>::RankField> (0, 3);
+	UInt32	u4MEAR = U3SetRegField<SimChipTraits<kU3VariantU4>::RankField> (0, 3);
+
+	simBuildRegAccessIndex (regIndex);
+
+	printf ("BenchChipState: %d calls per path\n", kBenchRounds);
+	benchVariant<kU3VariantLite> ("U3 Lite variant select");
+	benchVariant<kU3VariantU4> ("U4 variant select");
+	benchFault<kU3VariantLite> ("U3 Lite DART fault", true, 0, 0, 0);
+	benchFault<kU3VariantHeavy> ("U3 Heavy DART fault", true, 0, 0, 0);
+	benchFault<kU3VariantU4> ("U4 DART fault", true, 0, 0, 0);
+	benchFault<kU3VariantHeavy> ("U3 Heavy CE, one DIMM", false, kSimAPIECCCELow, heavyMEAR, SyndromeTable[5]);
+	benchFault<kU3VariantHeavy> ("U3 Heavy CE, both halves", false, kSimAPIECCCEHigh | kSimAPIECCCELow, heavyMEAR, SyndromeTable[70]);
+	benchFault<kU3VariantHeavy> ("U3 Heavy UE", false, kSimAPIECCUEHigh | kSimAPIECCUELow, heavyMEAR, 0);
+	benchFault<kU3VariantU4> ("U4 CE", false, kSimU4APIECCCE, u4MEAR, SyndromeTable[100]);
+	benchFault<kU3VariantU4> ("U4 UE", false, kSimU4APIECCUE, u4MEAR, 0);
+	benchSleepWake<kU3VariantHeavy> ("U3 Heavy", true);
+	benchSleepWake<kU3VariantU4> ("U4", true);
+	benchHTLink ();
+
+	return sink == 0xFFFFFFFF;	// keeps the results live
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Multi-threaded contention on the simulated register file: each thread runs masked-write
+// transactions against its own block of registers, and one in sixteen of them spans two
+// blocks.  With the single register lock every thread queues behind every other; with one
+// lock per block, taken in ascending order as lockUniN does, only the spanning transactions
+// contend.  The ascending order also has to hold up here - a lock order bug deadlocks the run.
+
+#include <pthread.h>
+
+#include "HostTest.h"
+#include "U3RegTransaction.h"
+
+#define kBenchDomains		6		// as kU3NumLockDomains
+#define kBenchRegsPerDomain	16		// 64 bytes, so each domain's registers have their own cache line
+#define kBenchTransactions	200000
+
+class ContendedRegPort
+{
+public:
+	typedef int	LockState;
+
+	volatile UInt32		regs[kBenchDomains * kBenchRegsPerDomain];
+	pthread_spinlock_t	locks[kBenchDomains];
+	bool				singleLock;
+
+	ContendedRegPort (bool single) : singleLock(single)
+	{
+		for (int i = 0; i < kBenchDomains; i++)
+			pthread_spin_init (&locks[i], PTHREAD_PROCESS_PRIVATE);
+	}
+
+	LockState lock (UInt32 domainMask)
+	{
+		if (singleLock)
+			pthread_spin_lock (&locks[0]);
+		else
+			for (int domain = 0; domain < kBenchDomains; domain++)
+				if (domainMask & (1 << domain))
+					pthread_spin_lock (&locks[domain]);
+		return 0;
+	}
+
+	void unlock (UInt32 domainMask, LockState state)
+	{
+		if (singleLock)
+			pthread_spin_unlock (&locks[0]);
+		else
+			for (int domain = kBenchDomains - 1; domain >= 0; domain--)
+				if (domainMask & (1 << domain))
+					pthread_spin_unlock (&locks[domain]);
+	}
+
+	UInt32 lockDomain (UInt32 offset)		{ return offset / (kBenchRegsPerDomain * sizeof(UInt32)); }
+	SInt32 shadowIndex (UInt32 offset)		{ return -1; }
+	UInt32 shadow (SInt32 index)			{ return 0; }
+	void updateShadow (SInt32 index, UInt32 data)	{}
+	UInt32 load (UInt32 offset)				{ return regs[offset >> 2]; }
+	void store (UInt32 offset, UInt32 data)	{ regs[offset >> 2] = data; }
+	void fence (void)						{ __sync_synchronize (); }
+};
+
+struct BenchThread
+{
+	pthread_t			thread;
+	ContendedRegPort	*port;
+	UInt32				domain, threads;
+};
+
+static void *runThread (void *arg)
+{
+	BenchThread				*bt = (BenchThread *)arg;
+	u3_reg_transaction_t	list[4];
+	UInt32					i, n, base = bt->domain * kBenchRegsPerDomain * sizeof(UInt32);
+
+	for (n = 0; n < kBenchTransactions; n++) {
+		for (i = 0; i < 4; i++) {
+			list[i].op = kU3RegOpWrite;
+			list[i].offset = base + (i << 2);
+			list[i].mask = 0x000000FF;
+			list[i].value = n;
+		}
+
+		// Now and then span into the next thread's block, from either end
+		if ((n & 15) == 0)
+			list[(n & 16) ? 0 : 3].offset = ((bt->domain + 1) % bt->threads) * kBenchRegsPerDomain * sizeof(UInt32);
+
+		U3RunRegTransaction (*bt->port, list, 4);
+	}
+
+	return NULL;
+}
+
+static double run (UInt32 threads, bool single)
+{
+	ContendedRegPort	port(single);
+	BenchThread			bt[kBenchDomains];
+	UInt64				start;
+	UInt32				i;
+
+	start = htNanoseconds ();
+	for (i = 0; i < threads; i++) {
+		bt[i].port = &port;
+		bt[i].domain = i;
+		bt[i].threads = threads;
+		pthread_create (&bt[i].thread, NULL, runThread, &bt[i]);
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join (bt[i].thread, NULL);
+
+	// transactions per microsecond, all threads together
+	return (double)threads * kBenchTransactions * 1000.0 / (double)(htNanoseconds () - start);
+}
+
+int main (void)
+{
+	UInt32	threads;
+
+	printf ("BenchLockDomains: transactions/us, 1 in 16 spanning two domains\n");
+	printf ("  threads   single lock   per-domain locks\n");
+	for (threads = 1; threads <= kBenchDomains; threads++)
+		printf ("  %7u   %11.2f   %16.2f\n", threads, run (threads, true), run (threads, false));
+
+	return 0;
+}
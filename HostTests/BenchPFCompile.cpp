@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Invocation cost of an on-demand platform function, interpreted against compiled.  The
+// interpreted run is what performFunction did per call before the op compiler: allocate an
+// iterator, re-parse the command words and copy out ten parameters per command, then act on
+// them.  The compiled run is the op loop of runPlatformProgram.  Both write the same
+// simulated registers and config space, so only the per-call overhead differs.  The command
+// sets are constructed to match the shapes of real platform-do functions; no captured
+// device tree data is in this tree.
+
+#include "HostTest.h"
+#include "PFBlob.h"
+#include "U3RegTransaction.h"
+#include "U3PFCompile.h"
+
+#define kRounds		1000000
+
+class BenchPort
+{
+public:
+	typedef int	LockState;
+
+	volatile UInt32		regs[64];
+	volatile UInt32		config[64];
+
+	LockState lock (UInt32 domainMask)				{ return 0; }
+	void unlock (UInt32 domainMask, LockState state)	{}
+	UInt32 lockDomain (UInt32 offset)				{ return 0; }
+	SInt32 shadowIndex (UInt32 offset)				{ return -1; }
+	UInt32 shadow (SInt32 index)					{ return 0; }
+	void updateShadow (SInt32 index, UInt32 data)	{}
+	UInt32 load (UInt32 offset)						{ return regs[(offset >> 2) & 63]; }
+	void store (UInt32 offset, UInt32 data)			{ regs[(offset >> 2) & 63] = data; }
+	void fence (void)								{ __asm__ __volatile__ ("" ::: "memory"); }
+};
+
+static BenchPort	port;
+
+static __attribute__((noinline)) void interpret (const PFBlob *blob)
+{
+	IOPlatformFunctionCursor	*iterator;
+	IOPFCommandView				cmd;
+	UInt32						params[kIOPFMaxParams], data = 0, i;
+
+	// stands in for the IOPlatformFunctionIterator allocated on every call
+	iterator = new IOPlatformFunctionCursor (blob->words, blob->byteLength ());
+
+	while (iterator->next (&cmd)) {
+		for (i = 0; i < kIOPFMaxParams; i++)
+			params[i] = (i < cmd.paramCount) ? cmd.params[i] : 0;
+
+		switch (cmd.cmd) {
+			case kCommandWriteReg32:
+				U3WriteRegKeepingBits (port, params[0], (params[2] == 0xFFFFFFFF) ? 0 : params[2], params[1]);
+				break;
+			case kCommandReadConfig:
+				data = port.config[(params[0] >> 2) & 63];
+				break;
+			case kCommandRMWConfig:
+				port.config[(params[0] >> 2) & 63] = (data & *(const UInt32 *)cmd.bytes) |
+					*(const UInt32 *)(cmd.bytes + params[1]);
+				break;
+		}
+	}
+
+	delete iterator;
+}
+
+static __attribute__((noinline)) void run (const u3_pf_op_t *ops, UInt32 opCount)
+{
+	const u3_pf_op_t	*op;
+	UInt32				data = 0;
+
+	for (op = ops; op < &ops[opCount]; op++)
+		switch (op->opcode) {
+			case kU3PFOpWriteReg:
+				U3WriteRegKeepingBits (port, op->offset, op->keepMask, op->value);
+				break;
+			case kU3PFOpReadConfig:
+				data = port.config[(op->offset >> 2) & 63];
+				break;
+			case kU3PFOpRMWConfig:
+				port.config[(op->offset >> 2) & 63] = (data & op->keepMask) | op->value;
+				break;
+		}
+}
+
+static void bench (const char *name, const PFBlob &blob)
+{
+	u3_pf_op_t	ops[16];
+	UInt32		opCount, flags, round;
+	UInt64		start, interpreted, compiled;
+
+	opCount = U3CompilePFCommands (blob.cursor (), blob.words[0], ops, 16, &flags);
+	if (!opCount) {
+		printf ("  %-28s does not compile\n", name);
+		return;
+	}
+
+	start = htNanoseconds ();
+	for (round = 0; round < kRounds; round++)
+		interpret (&blob);
+	interpreted = htNanoseconds () - start;
+
+	start = htNanoseconds ();
+	for (round = 0; round < kRounds; round++)
+		run (ops, opCount);
+	compiled = htNanoseconds () - start;
+
+	printf ("  %-28s %2u ops %10.1f %10.1f\n", name, opCount,
+		(double)interpreted / kRounds, (double)compiled / kRounds);
+}
+
+int main (void)
+{
+	PFBlob	single, sequence, config;
+
+	single.writeReg32 (0x70, 0x00000001, 0xFFFFFFFE);
+	sequence.list (4).writeReg32 (0x70, 0x00000001, 0xFFFFFFFE).writeReg32 (0x74, 0x80000000, 0x7FFFFFFF)
+		.writeReg32 (0x78, 0x00001000, 0xFFFFFFFF).writeReg32 (0x70, 0x00000000, 0xFFFFFFFE);
+	config.list (2).readConfig (0x40, 4).rmwConfig (0x40, 0xFFFFFFF0, 0x00000006);
+
+	printf ("BenchPFCompile: ns per invocation\n");
+	printf ("  %-28s %6s %10s %10s\n", "", "", "interpreted", "compiled");
+	bench ("masked register write", single);
+	bench ("register sequence", sequence);
+	bench ("config read-modify-write", config);
+
+	return 0;
+}
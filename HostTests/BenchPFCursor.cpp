@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Walking representative command sets with IOPlatformFunctionCursor against the old pattern of
+// an iterator allocated per execution that copies out ten parameters per command.  Reports
+// time per command and heap allocations per execution, which must be zero for the cursor.
+// The command sets are constructed in the shape of real platform-do functions.
+
+#include "HostTest.h"
+#include "AllocCount.h"
+#include "PFBlob.h"
+
+#define kRounds		1000000
+
+static volatile UInt32	sink;
+static bool				cursorAllocated;
+
+static __attribute__((noinline)) UInt32 walkCopying (const PFBlob *blob)
+{
+	IOPlatformFunctionCursor	*iterator;
+	IOPFCommandView				view;
+	UInt32						params[kIOPFMaxParams], i, n = 0;
+
+	iterator = new IOPlatformFunctionCursor (blob->words, blob->byteLength ());
+	while (iterator->next (&view)) {
+		for (i = 0; i < kIOPFMaxParams; i++)
+			params[i] = (i < view.paramCount) ? view.params[i] : 0;
+		sink += params[0] + params[1];
+		n++;
+	}
+	delete iterator;
+
+	return n;
+}
+
+static __attribute__((noinline)) UInt32 walkCursor (const PFBlob *blob)
+{
+	IOPlatformFunctionCursor	cursor (blob->words, blob->byteLength ());
+	IOPFCommandView				view;
+	UInt32						n = 0;
+
+	while (cursor.next (&view)) {
+		sink += view.params[0] + ((view.paramCount > 1) ? view.params[1] : 0);
+		n++;
+	}
+
+	return n;
+}
+
+static void bench (const char *name, const PFBlob &blob)
+{
+	UInt32	(*walks[2])(const PFBlob *) = { walkCopying, walkCursor };
+	double	ns[2], allocs[2];
+	UInt32	w, round, commands = 0;
+	UInt64	start;
+
+	for (w = 0; w < 2; w++) {
+		htAllocations = 0;
+		htAllocCounting = true;
+		start = htNanoseconds ();
+		for (round = 0; round < kRounds; round++)
+			commands = walks[w] (&blob);
+		ns[w] = (double)(htNanoseconds () - start) / ((double)kRounds * commands);
+		htAllocCounting = false;
+		allocs[w] = (double)htAllocations / kRounds;
+	}
+
+	if (allocs[1] != 0)
+		cursorAllocated = true;
+
+	printf ("  %-24s %2u cmds %8.1f %6.2f %8.1f %6.2f\n", name, commands, ns[0], allocs[0], ns[1], allocs[1]);
+}
+
+int main (void)
+{
+	static const UInt8	i2cData[4] = { 0x12, 0x34, 0x56, 0x78 }, i2cMask[2] = { 0xF0, 0xFF }, i2cValue[2] = { 0x05, 0x00 };
+	PFBlob				regs, i2c, config;
+
+	regs.list (4).writeReg32 (0x70, 0x00000001, 0xFFFFFFFE).writeReg32 (0x74, 0x80000000, 0x7FFFFFFF)
+		.delay (10).writeReg32 (0x70, 0x00000000, 0xFFFFFFFE);
+	i2c.list (3).add (kCommandI2CMode).add (2).writeI2C (i2cData, 4).rmwI2C (i2cMask, i2cValue, 2, 2);
+	config.list (3).readConfig (0x40, 4).rmwConfig (0x40, 0xFFFFFFF0, 0x00000006).waitReg32 (0x44, 1, 1);
+
+	printf ("BenchPFCursor: ns per command, heap allocations per execution\n");
+	printf ("  %-24s %7s %15s %15s\n", "", "", "copying iterator", "cursor");
+	bench ("register sequence", regs);
+	bench ("I2C with byte arrays", i2c);
+	bench ("config read-modify-write", config);
+
+	if (cursorAllocated)
+		printf ("BenchPFCursor: the cursor allocated\n");
+	return cursorAllocated ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Dispatch latency of the symbol-keyed table against the path it replaced: an if-chain over
+// the 12 built-in symbols, then a scan of the platform function array matching each entry
+// (platformFunctionMatch, an out-of-line call), then the superclass.  Measured for a built-in
+// hit, an on-demand hit and a call that falls through to the superclass.
+
+#include "HostTest.h"
+#include "U3PFDispatch.h"
+
+#define kBuiltins		12
+#define kOnDemand		40
+#define kQueries		1024
+#define kRounds			20000
+
+typedef struct
+{
+	const void		*key;
+	UInt32			selector;
+} DispatchEntry;
+
+static const void	*builtins[kBuiltins];
+static const void	*onDemand[kOnDemand];
+static DispatchEntry	*table;
+static UInt32		tableMask;
+
+static __attribute__((noinline)) bool platformFunctionMatch (const void *func, const void *key)
+{
+	return func == key;
+}
+
+static UInt32 oldDispatch (const void *key)
+{
+	UInt32 i;
+
+	for (i = 0; i < kBuiltins; i++)
+		if (key == builtins[i])
+			return i;
+
+	for (i = 0; i < kOnDemand; i++)
+		if (platformFunctionMatch (onDemand[i], key))
+			return kBuiltins + i;
+
+	return 0xFFFFFFFF;
+}
+
+static UInt32 newDispatch (const void *key)
+{
+	UInt32 slot = U3PFDispatchProbe (table, tableMask, key);
+
+	return table[slot].key ? table[slot].selector : 0xFFFFFFFF;
+}
+
+static double run (UInt32 (*dispatch)(const void *), const void **queries)
+{
+	UInt64				start;
+	UInt32				round, i;
+	volatile UInt32		sink = 0;
+
+	start = htNanoseconds ();
+	for (round = 0; round < kRounds; round++)
+		for (i = 0; i < kQueries; i++)
+			sink += dispatch (queries[i]);
+
+	return (double)(htNanoseconds () - start) / ((double)kRounds * kQueries);
+}
+
+int main (void)
+{
+	static const void	*queries[3][kQueries];
+	static const char	*names[3] = { "built-in hit", "on-demand hit", "fall-through" };
+	UInt32				seed = 12345, size, i, slot;
+
+	size = U3PFDispatchSlots (kBuiltins + kOnDemand);
+	table = (DispatchEntry *) calloc (size, sizeof(DispatchEntry));
+	tableMask = size - 1;
+
+	for (i = 0; i < kBuiltins + kOnDemand; i++) {
+		const void *key = malloc (40);
+
+		if (i < kBuiltins)
+			builtins[i] = key;
+		else
+			onDemand[i - kBuiltins] = key;
+		slot = U3PFDispatchProbe (table, tableMask, key);
+		table[slot].key = key;
+		table[slot].selector = i;
+	}
+
+	for (i = 0; i < kQueries; i++) {
+		queries[0][i] = builtins[htRandom (&seed) % kBuiltins];
+		queries[1][i] = onDemand[htRandom (&seed) % kOnDemand];
+		queries[2][i] = malloc (40);
+	}
+
+	printf ("BenchPFDispatch: %u built-in and %u on-demand functions, ns per call\n", kBuiltins, kOnDemand);
+	printf ("  %-16s %10s %10s\n", "", "if-chain", "table");
+	for (i = 0; i < 3; i++)
+		printf ("  %-16s %10.1f %10.1f\n", names[i], run (oldDispatch, queries[i]), run (newDispatch, queries[i]));
+
+	return 0;
+}
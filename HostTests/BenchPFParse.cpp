@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Parser throughput over the pfcorpus command sets, plus the largest sets a property can
+// carry.  For each set reports the mean cost of IOPFValidateCommandSet, commands per
+// second, and the 99.9th percentile of single calls - which includes the cost of reading
+// the clock around it, and is used rather than the maximum so a preemption doesn't count.  Malformed sets are timed too: rejecting one must cost no more than walking
+// the data it has.
+//
+//	BenchPFParse [corpus-dir]
+
+#include "HostTest.h"
+#include "PFCorpus.h"
+
+#define kRounds			200000
+#define kSamples		20000
+
+static PFCorpusEntry	corpus[kPFCorpusMaxEntries];
+static volatile UInt32	sink;
+static UInt64			samples[kSamples];
+
+static int compareSamples (const void *a, const void *b)
+{
+	UInt64 x = *(const UInt64 *)a, y = *(const UInt64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void bench (const char *name, const UInt32 *words, UInt32 byteLength)
+{
+	UInt32	count, result, i;
+	UInt64	start, elapsed;
+	double	perSet;
+
+	result = IOPFValidateCommandSet (words, byteLength, &count);
+
+	start = htNanoseconds ();
+	for (i = 0; i < kRounds; i++)
+		sink += IOPFValidateCommandSet (words, byteLength, NULL);
+	elapsed = htNanoseconds () - start;
+
+	for (i = 0; i < kSamples; i++) {
+		start = htNanoseconds ();
+		sink += IOPFValidateCommandSet (words, byteLength, NULL);
+		samples[i] = htNanoseconds () - start;
+	}
+	qsort (samples, kSamples, sizeof(samples[0]), compareSamples);
+
+	perSet = (double)elapsed / kRounds;
+	printf ("  %-24s %5u bytes %4u cmds %-7s %8.1f ns/set %6.2f ns/cmd %8.1f Mcmd/s %7llu ns p99.9\n",
+		name, (unsigned)byteLength, (unsigned)count, result ? ((result == kIOPFUnknownCmd) ? "unknown" : "badlen") : "ok",
+		perSet, count ? perSet / count : 0.0, count ? count * 1e3 / perSet : 0.0,
+		(unsigned long long)samples[kSamples - kSamples / 1000 - 1]);
+}
+
+int main (int argc, char **argv)
+{
+	static UInt32	big[kPFCorpusMaxWords];
+	UInt32			count, i, n;
+
+	count = pfCorpusLoad ((argc > 1) ? argv[1] : kPFCorpusDefaultDir, corpus, kPFCorpusMaxEntries);
+	if (!count)
+		return 1;
+
+	printf ("BenchPFParse: corpus\n");
+	for (i = 0; i < count; i++)
+		bench (corpus[i].name, corpus[i].words, corpus[i].byteLength);
+
+	// The most commands a property of kPFCorpusMaxWords can hold: a list of delays
+	printf ("BenchPFParse: largest sets\n");
+	n = (kPFCorpusMaxWords - 4) / (1 + kCommandDelayLength);
+	big[0] = 0x1234;
+	big[1] = kIOPFFlagOnDemand;
+	big[2] = kCommandCommandList;
+	big[3] = n;
+	for (i = 0; i < n; i++) {
+		big[4 + 2 * i] = kCommandDelay;
+		big[5 + 2 * i] = i;
+	}
+	bench ("delay list", big, (4 + 2 * n) * sizeof(UInt32));
+
+	// The same list claiming every command it could, so it ends in an error at the end
+	big[3] = 0xFFFFFFFF;
+	bench ("delay list, bad count", big, (4 + 2 * n) * sizeof(UInt32));
+
+	// One I2C write carrying the largest byte array - stepped over, not scanned
+	n = (kPFCorpusMaxWords - 4) * sizeof(UInt32);
+	big[2] = kCommandWriteI2C;
+	big[3] = n;
+	bench ("I2C write, large array", big, kPFCorpusMaxWords * sizeof(UInt32));
+
+	return 0;
+}
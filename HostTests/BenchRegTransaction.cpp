@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Cost of a batched register transaction against the same writes issued one at a time, the
+// way callers did before safeRegTransaction.  The port takes a real mutex and issues a real
+// memory barrier, so the numbers track the lock and fence counts the engine saves.
+
+#include <pthread.h>
+
+#include "HostTest.h"
+#include "U3RegTransaction.h"
+
+#define kBenchEntries		16
+#define kBenchRounds		200000
+
+class BenchRegPort
+{
+public:
+	typedef int	LockState;
+
+	volatile UInt32		regs[64];
+	pthread_mutex_t		mutex;
+	UInt32				locks, fences;
+
+	BenchRegPort () : locks(0), fences(0)	{ pthread_mutex_init (&mutex, NULL); }
+	~BenchRegPort ()						{ pthread_mutex_destroy (&mutex); }
+
+	LockState lock (UInt32 domainMask)		{ locks++; pthread_mutex_lock (&mutex); return 0; }
+	void unlock (UInt32 domainMask, LockState state)	{ pthread_mutex_unlock (&mutex); }
+	UInt32 lockDomain (UInt32 offset)		{ return (offset >> 6) & 3; }
+	SInt32 shadowIndex (UInt32 offset)		{ return -1; }
+	UInt32 shadow (SInt32 index)			{ return 0; }
+	void updateShadow (SInt32 index, UInt32 data)	{}
+	UInt32 load (UInt32 offset)				{ return regs[offset >> 2]; }
+	void store (UInt32 offset, UInt32 data)	{ regs[offset >> 2] = data; }
+	void fence (void)						{ fences++; __sync_synchronize (); }
+};
+
+static void run (const char *name, bool batched, bool masked)
+{
+	BenchRegPort			port;
+	u3_reg_transaction_t	list[kBenchEntries];
+	UInt64					start, elapsed;
+	UInt32					round, i;
+
+	for (i = 0; i < kBenchEntries; i++) {
+		list[i].op = kU3RegOpWrite;
+		list[i].offset = i << 2;
+		list[i].mask = masked ? 0x0000FFFF : 0xFFFFFFFF;
+		list[i].value = i;
+	}
+
+	start = htNanoseconds ();
+	for (round = 0; round < kBenchRounds; round++) {
+		if (batched)
+			U3RunRegTransaction (port, list, kBenchEntries);
+		else
+			for (i = 0; i < kBenchEntries; i++)
+				U3RunRegTransaction (port, &list[i], 1);
+	}
+	elapsed = htNanoseconds () - start;
+
+	printf ("  %-28s %6.1f ns/write  %5.2f locks/write  %5.2f fences/write\n", name,
+		(double)elapsed / ((double)kBenchRounds * kBenchEntries),
+		(double)port.locks / ((double)kBenchRounds * kBenchEntries),
+		(double)port.fences / ((double)kBenchRounds * kBenchEntries));
+}
+
+int main (void)
+{
+	printf ("BenchRegTransaction: %d writes per list\n", kBenchEntries);
+	run ("individual plain writes", false, false);
+	run ("batched plain writes", true, false);
+	run ("individual masked writes", false, true);
+	run ("batched masked writes", true, true);
+
+	return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Mutation fuzzer for the platform-do command parser.  Starting from the pfcorpus sets it
+// flips bits, plants boundary lengths and opcodes, cuts, grows and splices the data, then
+// walks each result with IOPlatformFunctionCursor placed against an unmapped page, so any
+// read past the end faults.  Each walk must stay within the data and agree with a plain
+// reference walk done in 64-bit arithmetic.
+//
+//	FuzzPFParse [corpus-dir [iterations [seed]]]
+
+#include "HostTest.h"
+#include "PFCorpus.h"
+
+#define kDefaultIterations	1000000
+
+static PFCorpusEntry	corpus[kPFCorpusMaxEntries];
+static UInt32			corpusCount;
+
+// Longwords of fixed parameters, -1 if the command can't be walked
+static int refFixedLength (UInt32 cmd)
+{
+	switch (cmd) {
+		case kCommandCommandList:			return kCommandCommandListLength;
+		case kCommandWriteGPIO:				return kCommandWriteGPIOLength;
+		case kCommandReadGPIO:				return kCommandReadGPIOLength;
+		case kCommandWriteReg32:			return kCommandWriteReg32Length;
+		case kCommandReadReg32:				return kCommandReadReg32Length;
+		case kCommandWriteReg16:			return kCommandWriteReg16Length;
+		case kCommandReadReg16:				return kCommandReadReg16Length;
+		case kCommandWriteReg8:				return kCommandWriteReg8Length;
+		case kCommandReadReg8:				return kCommandReadReg8Length;
+		case kCommandDelay:					return kCommandDelayLength;
+		case kCommandWaitReg32:				return kCommandWaitReg32Length;
+		case kCommandWaitReg16:				return kCommandWaitReg16Length;
+		case kCommandWaitReg8:				return kCommandWaitReg8Length;
+		case kCommandReadI2C:				return kCommandReadI2CLength;
+		case kCommandWriteI2C:				return kCommandWriteI2CLength;
+		case kCommandRMWI2C:				return kCommandRMWI2CLength;
+		case kCommandShiftBytesRight:		return kCommandShiftBytesRightLength;
+		case kCommandShiftBytesLeft:		return kCommandShiftBytesLeftLength;
+		case kCommandReadConfig:			return kCommandReadConfigLength;
+		case kCommandWriteConfig:			return kCommandWriteConfigLength;
+		case kCommandRMWConfig:				return kCommandRMWConfigLength;
+		case kCommandReadI2CSubAddr:		return kCommandReadI2CSubAddrLength;
+		case kCommandWriteI2CSubAddr:		return kCommandWriteI2CSubAddrLength;
+		case kCommandI2CMode:				return kCommandI2CModeLength;
+		case kCommandRMWI2CSubAddr:			return kCommandRMWI2CSubAddrLength;
+		case kCommandReadReg32MaskShRtXOR:	return kCommandReadReg32MaskShRtXORLength;
+		case kCommandReadReg16MaskShRtXOR:	return kCommandReadReg16MaskShRtXORLength;
+		case kCommandReadReg8MaskShRtXOR:	return kCommandReadReg8MaskShRtXORLength;
+		case kCommandWriteReg32ShLtMask:	return kCommandWriteReg32ShLtMaskLength;
+		case kCommandWriteReg16ShLtMask:	return kCommandWriteReg16ShLtMaskLength;
+		case kCommandWriteReg8ShLtMask:		return kCommandWriteReg8ShLtMaskLength;
+		case kCommandMaskandCompare:		return kCommandMaskandCompareLength;
+		default:							return -1;		// includes General I2C
+	}
+}
+
+// Byte array lengths following the fixed parameters at p
+static UInt64 refArrayBytes (UInt32 cmd, const UInt32 *p)
+{
+	switch (cmd) {
+		case kCommandWriteI2C:			return p[0];
+		case kCommandRMWI2C:			return (UInt64)p[0] + p[1];
+		case kCommandRMWConfig:			return (UInt64)p[1] + p[2];
+		case kCommandWriteI2CSubAddr:	return p[1];
+		case kCommandRMWI2CSubAddr:		return (UInt64)p[1] + p[2];
+		case kCommandMaskandCompare:	return 2 * (UInt64)p[0];
+		default:						return 0;
+	}
+}
+
+static UInt32 refWalk (const UInt32 *w, UInt32 byteLength, UInt32 *count)
+{
+	UInt64	n = byteLength / sizeof(UInt32), pos = 2, commands = 1, total;
+	int		fixed;
+
+	*count = 0;
+	if (n < 3)
+		return kIOPFNoError;
+
+	if (w[2] == kCommandCommandList) {
+		if (n < 4)
+			return kIOPFBadCmdLength;
+		commands = w[3];
+		pos = 4;
+	}
+
+	while (commands--) {
+		if (pos >= n)
+			return kIOPFBadCmdLength;
+		if ((fixed = refFixedLength (w[pos])) < 0)
+			return kIOPFUnknownCmd;
+		if (pos + 1 + fixed > n)
+			return kIOPFBadCmdLength;
+		total = 1 + fixed + (refArrayBytes (w[pos], &w[pos + 1]) + 3) / 4;
+		if (pos + total > n)
+			return kIOPFBadCmdLength;
+		pos += total;
+		(*count)++;
+	}
+
+	return kIOPFNoError;
+}
+
+static UInt32 interesting (UInt32 *seed)
+{
+	static const UInt32 values[] = {
+		0, 1, 2, 3, 4, 5, 7, 8, 0x10, 0x20, 0x21, 0xFF, 0x100, 0x3FFFFFFF, 0x40000000,
+		0x7FFFFFFF, 0x80000000, 0xFFFFFFFC, 0xFFFFFFFD, 0xFFFFFFFF
+	};
+
+	return values[htRandom (seed) % (sizeof(values) / sizeof(values[0]))];
+}
+
+// Applies one to four random mutations to words[0..*byteLength)
+static void mutate (UInt32 *words, UInt32 *byteLength, UInt32 *seed)
+{
+	UInt32 rounds = 1 + htRandom (seed) % 4, n, at, len, i;
+	const PFCorpusEntry *other;
+
+	while (rounds--) {
+		n = *byteLength / sizeof(UInt32);
+		at = n ? htRandom (seed) % n : 0;
+
+		switch (htRandom (seed) % 8) {
+			case 0:		// flip a bit
+				if (n)
+					words[at] ^= 1U << (htRandom (seed) % 32);
+				break;
+			case 1:		// boundary length
+				if (n)
+					words[at] = interesting (seed);
+				break;
+			case 2:		// opcode or small count
+				if (n)
+					words[at] = htRandom (seed) % (kCommandMaxCommand + 3);
+				break;
+			case 3:		// cut anywhere, including mid-longword
+				*byteLength = *byteLength ? htRandom (seed) % (*byteLength + 1) : 0;
+				break;
+			case 4:		// insert a longword
+				if (n < kPFCorpusMaxWords) {
+					memmove (&words[at + 1], &words[at], (n - at) * sizeof(UInt32));
+					words[at] = interesting (seed);
+					*byteLength = (n + 1) * sizeof(UInt32);
+				}
+				break;
+			case 5:		// delete a longword
+				if (n) {
+					memmove (&words[at], &words[at + 1], (n - at - 1) * sizeof(UInt32));
+					*byteLength = (n - 1) * sizeof(UInt32);
+				}
+				break;
+			case 6:		// repeat a run, growing a command list
+				len = n ? 1 + htRandom (seed) % (n - at) : 0;
+				if (len && (n + len <= kPFCorpusMaxWords)) {
+					memcpy (&words[n], &words[at], len * sizeof(UInt32));
+					*byteLength = (n + len) * sizeof(UInt32);
+				}
+				break;
+			case 7:		// splice in the tail of another set
+				other = &corpus[htRandom (seed) % corpusCount];
+				i = other->byteLength / sizeof(UInt32);
+				len = i ? htRandom (seed) % i : 0;
+				if (at + (i - len) <= kPFCorpusMaxWords) {
+					memcpy (&words[at], &other->words[len], (i - len) * sizeof(UInt32));
+					*byteLength = (at + i - len) * sizeof(UInt32);
+				}
+				break;
+		}
+	}
+}
+
+static void dump (const UInt32 *words, UInt32 byteLength)
+{
+	UInt32 i;
+
+	fprintf (stderr, "# %u bytes\n", (unsigned)byteLength);
+	for (i = 0; i < byteLength / sizeof(UInt32); i++)
+		fprintf (stderr, "%08x%s", (unsigned)words[i], ((i % 8) == 7) ? "\n" : " ");
+	fprintf (stderr, "\n");
+}
+
+int main (int argc, char **argv)
+{
+	static UInt32	words[kPFCorpusMaxWords];
+	PFGuardedBuffer	guarded (kPFCorpusMaxWords * sizeof(UInt32));
+	const UInt32	*data;
+	UInt32			iterations, seed, byteLength, result, expected, count, refCount, maxCount = 0;
+	UInt32			outcomes[3] = { 0, 0, 0 };
+	UInt64			i, start, elapsed;
+	bool			inBounds;
+
+	corpusCount = pfCorpusLoad ((argc > 1) ? argv[1] : kPFCorpusDefaultDir, corpus, kPFCorpusMaxEntries);
+	iterations = (argc > 2) ? strtoul (argv[2], NULL, 0) : kDefaultIterations;
+	seed = (argc > 3) ? strtoul (argv[3], NULL, 0) : 0x2545F491;
+	if (!corpusCount || !seed)
+		return 2;
+
+	start = htNanoseconds ();
+	for (i = 0; i < iterations; i++) {
+		const PFCorpusEntry *entry = &corpus[htRandom (&seed) % corpusCount];
+
+		memcpy (words, entry->words, entry->byteLength);
+		byteLength = entry->byteLength;
+		mutate (words, &byteLength, &seed);
+
+		data = guarded.place (words, byteLength);
+		result = pfCorpusWalk (data, byteLength, &count, &inBounds);
+		expected = refWalk (words, byteLength, &refCount);
+
+		if (!inBounds || (result != expected) || (count != refCount)) {
+			fprintf (stderr, "FuzzPFParse: iteration %llu: cursor %u after %u commands%s, reference %u after %u\n",
+				(unsigned long long)i, (unsigned)result, (unsigned)count, inBounds ? "" : " out of bounds",
+				(unsigned)expected, (unsigned)refCount);
+			dump (words, byteLength);
+			return 1;
+		}
+
+		if (result < 3)
+			outcomes[result]++;
+		if (count > maxCount)
+			maxCount = count;
+	}
+	elapsed = htNanoseconds () - start;
+
+	printf ("FuzzPFParse: %u inputs, %u well formed, %u unknown command, %u bad length, up to %u commands, %.0f inputs/s\n",
+		(unsigned)iterations, (unsigned)outcomes[kIOPFNoError], (unsigned)outcomes[kIOPFUnknownCmd],
+		(unsigned)outcomes[kIOPFBadCmdLength], (unsigned)maxCount,
+		elapsed ? iterations * 1e9 / elapsed : 0.0);
+
+	return 0;
+}
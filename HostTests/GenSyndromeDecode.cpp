@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Generates U3ECCSyndromeDecode.h, the perfect hash table U3DecodeSyndrome looks syndromes up
+// in, from SyndromeTable in U3ECCSyndrome.h.  Tries multipliers from a fixed xorshift sequence
+// at the smallest table size first, and takes the first under which every syndrome gets a slot
+// of its own.  The output is the same on every run, so make check can compare it against the
+// checked-in header.
+//
+//	GenSyndromeDecode > ../U3ECCSyndromeDecode.h
+
+#define U3_SYNDROME_GENERATOR 1
+
+#include <string.h>
+
+#include "HostTest.h"
+#include "U3ECCSyndrome.h"
+
+#define kMinBits		8
+#define kMaxBits		12
+#define kTriesPerSize	(1 << 20)
+
+static const char *license =
+	"/*\n"
+	" * Copyright (c) 2002-2007 Apple Inc. All rights reserved.\n"
+	" *\n"
+	" * @APPLE_LICENSE_HEADER_START@\n"
+	" * \n"
+	" * The contents of this file constitute Original Code as defined in and\n"
+	" * are subject to the Apple Public Source License Version 1.1 (the\n"
+	" * \"License\").  You may not use this file except in compliance with the\n"
+	" * License.  Please obtain a copy of the License at\n"
+	" * http://www.apple.com/publicsource and read it before using this file.\n"
+	" * \n"
+	" * This Original Code and all software distributed under the License are\n"
+	" * distributed on an \"AS IS\" basis, WITHOUT WARRANTY OF ANY KIND, EITHER\n"
+	" * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,\n"
+	" * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,\n"
+	" * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the\n"
+	" * License for the specific language governing rights and limitations\n"
+	" * under the License.\n"
+	" * \n"
+	" * @APPLE_LICENSE_HEADER_END@\n"
+	" */\n";
+
+// True if multiplier gives every syndrome its own slot, filling slots
+static bool tryMultiplier( UInt32 multiplier, UInt32 bits, UInt8 *slots )
+{
+	UInt32 bit, slot;
+
+	memset (slots, kU3SyndromeMultiBit, 1 << bits);
+	for (bit = 0; bit < kECCAllBits; bit++) {
+		slot = (SyndromeTable[bit] * multiplier) >> (32 - bits);
+		if (slots[slot] != kU3SyndromeMultiBit)
+			return false;
+		slots[slot] = bit;
+	}
+
+	return true;
+}
+
+int main (void)
+{
+	static UInt8	slots[1 << kMaxBits];
+	UInt32			bits, tries, multiplier = 0, state, i;
+	bool			found = false;
+
+	for (bits = kMinBits; !found && (bits <= kMaxBits); bits++) {
+		state = 0x2545F491;
+		for (tries = 0; !found && (tries < kTriesPerSize); tries++) {
+			multiplier = htRandom (&state) | 1;
+			found = tryMultiplier (multiplier, bits, slots);
+		}
+	}
+	if (!found) {
+		fprintf (stderr, "GenSyndromeDecode: no multiplier up to %u bits\n", kMaxBits);
+		return 1;
+	}
+	bits--;
+
+	printf ("%s", license);
+	printf ("\n// Generated by HostTests/GenSyndromeDecode from SyndromeTable in U3ECCSyndrome.h - do not edit.\n");
+	printf ("// Slot U3SyndromeSlot(SyndromeTable[bit]) holds bit; the other slots hold kU3SyndromeMultiBit.\n\n");
+	printf ("#ifndef _IOKIT_U3_ECC_SYNDROME_DECODE_H\n#define _IOKIT_U3_ECC_SYNDROME_DECODE_H\n\n");
+	printf ("#define kU3SyndromeHashMultiplier\t0x%08XU\n", (unsigned)multiplier);
+	printf ("#define kU3SyndromeHashBits\t\t\t%u\n\n", (unsigned)bits);
+	printf ("static const UInt8 gU3SyndromeDecode[1 << kU3SyndromeHashBits] =\n{\n");
+	for (i = 0; i < (1U << bits); i++)
+		printf ("%s0x%02X%s", ((i % 16) == 0) ? "\t" : "", slots[i],
+			(i + 1 == (1U << bits)) ? "\n" : (((i % 16) == 15) ? ",\n" : ", "));
+	printf ("};\n\n#endif /* _IOKIT_U3_ECC_SYNDROME_DECODE_H */\n");
+
+	return 0;
+}
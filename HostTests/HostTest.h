@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Minimal check and timing support for the host tests.  Each test is its own program; it
+// returns non-zero if any check failed, so make check stops at the first failing test.
+
+#ifndef _HOSTTESTS_HOSTTEST_H
+#define _HOSTTESTS_HOSTTEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <libkern/OSTypes.h>
+
+static int htFailures;
+
+#define HT_CHECK(cond)															\
+	do {																		\
+		if (!(cond)) {															\
+			htFailures++;														\
+			fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+		}																		\
+	} while (0)
+
+#define HT_CHECK_EQ(a, b)														\
+	do {																		\
+		unsigned long long _a = (unsigned long long)(a), _b = (unsigned long long)(b);	\
+		if (_a != _b) {															\
+			htFailures++;														\
+			fprintf (stderr, "%s:%d: check failed: %s == %s (0x%llx != 0x%llx)\n",	\
+				__FILE__, __LINE__, #a, #b, _a, _b);							\
+		}																		\
+	} while (0)
+
+static inline int htFinish (const char *name)
+{
+	printf ("%s: %s\n", name, htFailures ? "FAILED" : "ok");
+	return htFailures ? 1 : 0;
+}
+
+static inline UInt64 htNanoseconds (void)
+{
+	struct timespec	ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (UInt64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Deterministic xorshift generator, so a failing randomized run can be repeated
+static inline UInt32 htRandom (UInt32 *state)
+{
+	UInt32 x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+#endif /* _HOSTTESTS_HOSTTEST_H */
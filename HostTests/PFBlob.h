@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Builds platform-do command sets word by word, laid out as in the device tree property:
+// pHandle, flags, then one command or a command list.
+
+#ifndef _HOSTTESTS_PFBLOB_H
+#define _HOSTTESTS_PFBLOB_H
+
+#include <string.h>
+#include <libkern/OSTypes.h>
+
+#include "IOPlatformFunction.h"
+
+#define kPFBlobMaxWords		256
+
+class PFBlob
+{
+public:
+	UInt32		words[kPFBlobMaxWords];
+	UInt32		count;
+
+	PFBlob (UInt32 pHandle = 0x1234, UInt32 flags = kIOPFFlagOnDemand) : count(0)
+	{
+		add (pHandle);
+		add (flags);
+	}
+
+	PFBlob &add (UInt32 w)
+	{
+		if (count < kPFBlobMaxWords)
+			words[count++] = w;
+		return *this;
+	}
+
+	PFBlob &list (UInt32 commands)			{ return add (kCommandCommandList).add (commands); }
+	PFBlob &writeReg32 (UInt32 offset, UInt32 value, UInt32 keepMask)
+		{ return add (kCommandWriteReg32).add (offset).add (value).add (keepMask); }
+	PFBlob &waitReg32 (UInt32 offset, UInt32 value, UInt32 mask)
+		{ return add (kCommandWaitReg32).add (offset).add (value).add (mask); }
+	PFBlob &delay (UInt32 us)				{ return add (kCommandDelay).add (us); }
+	PFBlob &readConfig (UInt32 offset, UInt32 len)	{ return add (kCommandReadConfig).add (offset).add (len); }
+	PFBlob &rmwConfig (UInt32 offset, UInt32 mask, UInt32 value)
+		{ return add (kCommandRMWConfig).add (offset).add (4).add (4).add (4).add (mask).add (value); }
+
+	// Variable-length byte arrays are packed and padded as a whole to a longword
+	PFBlob &bytes (const UInt8 *data, UInt32 length)
+	{
+		UInt32 n = (length + 3) / 4;
+
+		if (count + n <= kPFBlobMaxWords) {
+			memset (&words[count], 0, n * 4);
+			memcpy (&words[count], data, length);
+			count += n;
+		}
+		return *this;
+	}
+
+	PFBlob &writeI2C (const UInt8 *data, UInt32 length)
+		{ return add (kCommandWriteI2C).add (length).bytes (data, length); }
+	PFBlob &rmwI2C (const UInt8 *mask, const UInt8 *value, UInt32 length, UInt32 total)
+	{
+		UInt8 arrays[64];
+
+		memcpy (arrays, mask, length);
+		memcpy (arrays + length, value, length);
+		return add (kCommandRMWI2C).add (length).add (length).add (total).bytes (arrays, 2 * length);
+	}
+
+	UInt32 byteLength (void) const			{ return count * sizeof(UInt32); }
+	IOPlatformFunctionCursor cursor (void) const	{ return IOPlatformFunctionCursor (words, byteLength ()); }
+};
+
+#endif /* _HOSTTESTS_PFBLOB_H */
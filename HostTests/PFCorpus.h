@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Loads the platform-do command sets in pfcorpus/ and places command data against an
+// unmapped page, so a parser that reads one longword past the end faults instead of
+// reading whatever follows.  See pfcorpus/README for the file format.
+
+#ifndef _HOSTTESTS_PFCORPUS_H
+#define _HOSTTESTS_PFCORPUS_H
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <libkern/OSTypes.h>
+
+#include "IOPlatformFunction.h"
+
+#define kPFCorpusDefaultDir		"pfcorpus"
+#define kPFCorpusMaxEntries		64
+#define kPFCorpusMaxWords		1024
+
+struct PFCorpusEntry {
+	char		name[64];
+	UInt32		words[kPFCorpusMaxWords];
+	UInt32		byteLength;
+	bool		expectOK;
+	UInt32		expectError;		// kIOPF* result of IOPFValidateCommandSet
+	UInt32		expectCount;		// commands walked
+};
+
+static int pfCorpusCompare (const void *a, const void *b)
+{
+	return strcmp (((const PFCorpusEntry *)a)->name, ((const PFCorpusEntry *)b)->name);
+}
+
+// Parses one .pf file, false if it can't be read or has no expect line
+static bool pfCorpusLoadFile (const char *path, PFCorpusEntry *entry)
+{
+	FILE			*file;
+	char			line[512], *p, *end, *hash;
+	unsigned long	word;
+	bool			haveExpect = false;
+
+	if (!(file = fopen (path, "r")))
+		return false;
+
+	entry->byteLength = 0;
+	while (fgets (line, sizeof(line), file)) {
+		if ((hash = strchr (line, '#'))) {
+			unsigned e = 0, n = 0;
+
+			if (sscanf (hash, "# expect error %u %u", &e, &n) == 2) {
+				entry->expectOK = false;
+				entry->expectError = e;
+				entry->expectCount = n;
+				haveExpect = true;
+			} else if (sscanf (hash, "# expect ok %u", &n) == 1) {
+				entry->expectOK = true;
+				entry->expectError = kIOPFNoError;
+				entry->expectCount = n;
+				haveExpect = true;
+			}
+			*hash = 0;
+		}
+
+		for (p = line; ; p = end) {
+			word = strtoul (p, &end, 16);
+			if (end == p)
+				break;
+			if (entry->byteLength / sizeof(UInt32) < kPFCorpusMaxWords) {
+				entry->words[entry->byteLength / sizeof(UInt32)] = (UInt32)word;
+				entry->byteLength += sizeof(UInt32);
+			}
+		}
+	}
+	fclose (file);
+
+	return haveExpect;
+}
+
+// Loads every .pf file in dir, sorted by name.  Returns the number loaded, 0 on error.
+static UInt32 pfCorpusLoad (const char *dir, PFCorpusEntry *entries, UInt32 maxEntries)
+{
+	DIR				*d;
+	struct dirent	*de;
+	char			path[1024];
+	size_t			len;
+	UInt32			count = 0;
+
+	if (!(d = opendir (dir))) {
+		fprintf (stderr, "can't open corpus %s\n", dir);
+		return 0;
+	}
+
+	while ((de = readdir (d)) && (count < maxEntries)) {
+		len = strlen (de->d_name);
+		if ((len < 4) || strcmp (de->d_name + len - 3, ".pf") || (len >= sizeof(entries->name)))
+			continue;
+
+		snprintf (path, sizeof(path), "%s/%s", dir, de->d_name);
+		strcpy (entries[count].name, de->d_name);
+		if (!pfCorpusLoadFile (path, &entries[count])) {
+			fprintf (stderr, "%s: unreadable or no expect line\n", path);
+			closedir (d);
+			return 0;
+		}
+		count++;
+	}
+	closedir (d);
+
+	qsort (entries, count, sizeof(*entries), pfCorpusCompare);
+	return count;
+}
+
+// A buffer whose end abuts a PROT_NONE page
+class PFGuardedBuffer
+{
+	UInt8		*base;
+	size_t		size;			// readable bytes, a multiple of the page size
+
+public:
+	PFGuardedBuffer (size_t maxBytes)
+	{
+		size_t page = (size_t)sysconf (_SC_PAGESIZE);
+
+		size = (maxBytes + page - 1) / page * page;
+		base = (UInt8 *)mmap (NULL, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+		if (base == MAP_FAILED) {
+			perror ("mmap");
+			exit (2);
+		}
+		mprotect (base + size, page, PROT_NONE);
+	}
+
+	// Copies the whole longwords of data so they end at the guard page.  A trailing partial
+	// longword is dropped: the parsers ignore it, and it would hide a one-longword overrun.
+	const UInt32 *place (const void *data, UInt32 byteLength)
+	{
+		UInt32 whole = byteLength & ~3U;
+
+		if (whole > size)
+			return NULL;
+		memcpy (base + size - whole, data, whole);
+		return (const UInt32 *)(base + size - whole);
+	}
+};
+
+// Walks data with the cursor, checking that every view lies within the data.  Returns the
+// cursor's error and the commands walked; *inBounds is false if a view strayed outside.
+static inline UInt32 pfCorpusWalk (const UInt32 *data, UInt32 byteLength, UInt32 *count, bool *inBounds)
+{
+	IOPlatformFunctionCursor	cursor (data, byteLength);
+	IOPFCommandView				view;
+	const UInt8					*start = (const UInt8 *)data, *end = start + (byteLength & ~3U);
+
+	*count = 0;
+	*inBounds = true;
+	while (cursor.next (&view)) {
+		if (((const UInt8 *)view.params < start) || ((const UInt8 *)(view.params + view.paramCount) > end))
+			*inBounds = false;
+		if (view.byteCount && ((view.bytes < start) || (view.byteCount > (UInt32)(end - view.bytes))))
+			*inBounds = false;
+		(*count)++;
+	}
+
+	return cursor.getError ();
+}
+
+#endif /* _HOSTTESTS_PFCORPUS_H */
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// A simulated U3 Lite, U3 Heavy or U4 on top of SimRegPort, for running the U3ChipState.h
+// sequences.  The SDK's register offsets and bits aren't available off the target, so the
+// chip is laid out with stand-in values: one register block per lock domain, the way
+// SimRegPort assigns domains, with the side effects the driver depends on -
+//
+//	APIEXCP (U3 and U4) and MESR (U3 and U4)	clear on read
+//	version register							read only, per variant
+//	toggle register								the MPIC reset bit is a pulse
+//
+// and the chip fault mask and toggle register shadowed, as gU3RegShadowTable does.  The
+// simInject functions raise DART and ECC errors the way the hardware reports them.
+
+#ifndef _HOSTTESTS_SIMCHIP_H
+#define _HOSTTESTS_SIMCHIP_H
+
+#include "SimRegPort.h"
+#include "U3ChipState.h"
+
+enum
+{
+	// API block, kU3LockDomainAPI
+	kSimAPIExcp			= 0x00,
+	kSimChipFaultMask	= 0x04,
+	kSimU4APIExcp		= 0x08,
+	kSimU4APIMask1		= 0x0C,
+	kSimHWInitState		= 0x10,
+	kSimToggle			= 0x14,
+
+	// memory controller block, kU3LockDomainMemCtl
+	kSimMEAR			= 0x40,
+	kSimMESR			= 0x44,
+	kSimU4MEAR1			= 0x48,
+	kSimU4MEAR2			= 0x4C,
+	kSimU4MESR			= 0x50,
+
+	// DART block, kU3LockDomainDART
+	kSimDARTCntl		= 0x80,
+	kSimDARTExcp		= 0x84,
+	kSimU4DARTExcp		= 0x88,
+
+	// HT block, kU3LockDomainHT, and the rest
+	kSimHTLinkFreq		= 0xC0,
+	kSimHTLinkConfig	= 0xC4,
+	kSimPMClockControl	= 0xC8,
+	kSimVSPSoftReset	= 0xCC,
+	kSimVersion			= 0xFC
+};
+
+enum
+{
+	kSimAPIDARTExcp		= 0x00000001,
+	kSimU4APIDARTExcp	= 0x00000002,
+	kSimAPIECCUEHigh	= 0x00000010,
+	kSimAPIECCCEHigh	= 0x00000020,
+	kSimAPIECCUELow		= 0x00000040,
+	kSimAPIECCCELow		= 0x00000080,
+	kSimU4APIECCUE		= 0x00000100,
+	kSimU4APIECCCE		= 0x00000200,
+
+	kSimDARTExcpWrite	= 0x40000000,
+	kSimMPICReset		= 0x00000001,
+	kSimMPICEnable		= 0x00000002,
+	kSimHWInitRunning	= 1,
+	kSimHWInitSleeping	= 2,
+
+	kSimVersionLite		= 0x30,
+	kSimVersionHeavy	= 0x35,
+	kSimVersionU4		= 0x40,
+	kSimVersionTooOld	= 0x20
+};
+
+struct SimUniNRegs
+{
+	enum
+	{
+		versionReg			= kSimVersion,
+		minVersion			= kSimVersionLite,
+		dartCntlReg			= kSimDARTCntl,
+		pmClockControlReg	= kSimPMClockControl,
+		vspSoftResetReg		= kSimVSPSoftReset,
+		hwInitStateReg		= kSimHWInitState,
+		hwInitRunning		= kSimHWInitRunning,
+		hwInitSleeping		= kSimHWInitSleeping,
+		toggleReg			= kSimToggle,
+		mpicEnableOutputs	= kSimMPICEnable
+	};
+
+	typedef U3RegField<kSimHTLinkFreq, 0x00000F00>		HTLinkFreqField;
+	typedef U3RegField<kSimHTLinkConfig, 0x70000000>	HTLinkOutWidthField;
+	typedef U3RegField<kSimHTLinkConfig, 0x07000000>	HTLinkInWidthField;
+
+	static bool isU4 (UInt32 version)			{ return version >= kSimVersionU4; }
+	static bool isU3Heavy (UInt32 version)		{ return version == kSimVersionHeavy; }
+};
+
+template <UInt32 Variant> struct SimChipTraits;
+
+template <> struct SimChipTraits<kU3VariantLite>
+{
+	enum
+	{
+		version				= kSimVersionLite,
+		hasPMClockControl	= true,
+		faultMaskReg		= kSimChipFaultMask,
+		faultExcpReg		= kSimAPIExcp,
+		dartExcpReg			= kSimDARTExcp,
+		dartExcpBit			= kSimAPIDARTExcp,
+		dartExcpBits		= kSimAPIDARTExcp | kSimU4APIDARTExcp,
+		dartWriteMask		= kSimDARTExcpWrite,
+		eccStyle			= kU3ECCNone,
+		eccExcpBits			= 0,
+		eccUEBits			= 0,
+		eccCEBits			= 0,
+		eccUpperBits		= 0,
+		memErrAddrReg		= kSimMEAR,
+		memErrAddrReg1		= 0,
+		memErrSyndromeReg	= kSimMESR
+	};
+
+	static UInt32 mesrFor (UInt32 syndrome)	{ return 0; }
+};
+
+template <> struct SimChipTraits<kU3VariantHeavy>
+{
+	enum
+	{
+		version				= kSimVersionHeavy,
+		hasPMClockControl	= true,
+		faultMaskReg		= kSimChipFaultMask,
+		faultExcpReg		= kSimAPIExcp,
+		dartExcpReg			= kSimDARTExcp,
+		dartExcpBit			= kSimAPIDARTExcp,
+		dartExcpBits		= kSimAPIDARTExcp | kSimU4APIDARTExcp,
+		dartWriteMask		= kSimDARTExcpWrite,
+		eccStyle			= kU3ECCU3Heavy,
+		eccExcpBits			= kSimAPIECCUEHigh | kSimAPIECCCEHigh | kSimAPIECCUELow | kSimAPIECCCELow,
+		eccUEBits			= kSimAPIECCUEHigh | kSimAPIECCUELow,
+		eccCEBits			= kSimAPIECCCEHigh | kSimAPIECCCELow,
+		eccUpperBits		= kSimAPIECCUEHigh | kSimAPIECCCEHigh,
+		memErrAddrReg		= kSimMEAR,
+		memErrAddrReg1		= 0,
+		memErrSyndromeReg	= kSimMESR
+	};
+
+	typedef U3RegField<kSimMEAR, 0x00000E00>	RankField;
+	typedef U3RegField<kSimMESR, 0x00FF0000>	SyndromeUpperField;
+	typedef U3RegField<kSimMESR, 0x000000FF>	SyndromeLowerField;
+
+	static UInt32 mesrFor (UInt32 syndrome)
+	{
+		return U3SetRegField<SyndromeLowerField> (U3SetRegField<SyndromeUpperField> (0, syndrome >> 8), syndrome & 0xFF);
+	}
+};
+
+template <> struct SimChipTraits<kU3VariantU4>
+{
+	enum
+	{
+		version				= kSimVersionU4,
+		hasPMClockControl	= false,
+		faultMaskReg		= kSimU4APIMask1,
+		faultExcpReg		= kSimU4APIExcp,
+		dartExcpReg			= kSimU4DARTExcp,
+		dartExcpBit			= kSimAPIDARTExcp,
+		dartExcpBits		= kSimAPIDARTExcp | kSimU4APIDARTExcp,
+		dartWriteMask		= kSimDARTExcpWrite,
+		eccStyle			= kU3ECCU4,
+		eccExcpBits			= kSimU4APIECCUE | kSimU4APIECCCE,
+		eccUEBits			= kSimU4APIECCUE,
+		eccCEBits			= kSimU4APIECCCE,
+		eccUpperBits		= 0,
+		memErrAddrReg		= kSimU4MEAR1,
+		memErrAddrReg1		= kSimU4MEAR2,
+		memErrSyndromeReg	= kSimU4MESR
+	};
+
+	typedef U3RegField<kSimU4MEAR1, 0x00007000>	RankField;
+	typedef U3RegField<kSimU4MESR, 0x0000FFFF>	SyndromeField;
+
+	static UInt32 mesrFor (UInt32 syndrome)	{ return U3SetRegField<SyndromeField> (0, syndrome); }
+};
+
+// The driver's classification of these registers, with SimRegPort's domains
+static const u3_reg_access_t gSimRegAccessTable[] =
+{
+	{ kSimAPIExcp,			kU3RegAccessReadSideEffects,	kU3LockDomainAPI },
+	{ kSimU4APIExcp,		kU3RegAccessReadSideEffects,	kU3LockDomainAPI },
+	{ kSimChipFaultMask,	kU3RegAccessRMW,				kU3LockDomainAPI },
+	{ kSimU4APIMask1,		kU3RegAccessRMW,				kU3LockDomainAPI },
+	{ kSimToggle,			kU3RegAccessRMW,				kU3LockDomainAPI },
+	{ kSimMESR,				kU3RegAccessReadSideEffects,	kU3LockDomainMemCtl },
+	{ kSimU4MESR,			kU3RegAccessReadSideEffects,	kU3LockDomainMemCtl },
+	{ kSimMEAR,				kU3RegAccessPlain,				kU3LockDomainMemCtl },
+	{ kSimU4MEAR1,			kU3RegAccessPlain,				kU3LockDomainMemCtl },
+	{ kSimU4MEAR2,			kU3RegAccessPlain,				kU3LockDomainMemCtl },
+	{ kSimDARTCntl,			kU3RegAccessPlain,				kU3LockDomainDART },
+	{ kSimDARTExcp,			kU3RegAccessPlain,				kU3LockDomainDART },
+	{ kSimU4DARTExcp,		kU3RegAccessPlain,				kU3LockDomainDART },
+	{ kSimHTLinkFreq,		kU3RegAccessPlain,				kU3LockDomainHT },
+	{ kSimHTLinkConfig,		kU3RegAccessPlain,				kU3LockDomainHT }
+};
+
+static inline void simBuildRegAccessIndex (u3_reg_access_t *index)
+{
+	U3BuildRegAccessIndex (gSimRegAccessTable, sizeof(gSimRegAccessTable) / sizeof(gSimRegAccessTable[0]), index);
+}
+
+// A chip of the given variant as it comes out of reset: every register clear but the version,
+// chip faults masked, counts cleared.
+template <UInt32 Variant> void simPowerOn (SimRegPort *port)
+{
+	typedef SimChipTraits<Variant>	Chip;
+
+	*port = SimRegPort ();
+
+	port->behaviour[kSimAPIExcp >> 2] = kSimRegClearOnRead;
+	port->behaviour[kSimU4APIExcp >> 2] = kSimRegClearOnRead;
+	port->behaviour[kSimMESR >> 2] = kSimRegClearOnRead;
+	port->behaviour[kSimU4MESR >> 2] = kSimRegClearOnRead;
+	port->behaviour[kSimVersion >> 2] = kSimRegReadOnly;
+	port->behaviour[kSimToggle >> 2] = kSimRegToggle;
+	port->pulseBits[kSimToggle >> 2] = kSimMPICReset;
+	port->regs[kSimVersion >> 2] = Chip::version;
+
+	port->shadowOffset[0] = kSimToggle;
+	port->shadowVolatile[0] = kSimMPICReset;
+	port->shadowOffset[1] = Chip::faultMaskReg;
+}
+
+// Latch an error as the hardware would: the error registers first, then the exception bits
+template <class Chip> void simInjectDARTExcp (SimRegPort *port, UInt32 dartexcp)
+{
+	port->regs[Chip::dartExcpReg >> 2] = dartexcp;
+	port->regs[Chip::faultExcpReg >> 2] |= Chip::dartExcpBit;
+}
+
+template <class Chip> void simInjectECC (SimRegPort *port, UInt32 excpBits, UInt32 mear, UInt32 syndrome)
+{
+	port->regs[Chip::memErrAddrReg >> 2] = mear;
+	port->regs[Chip::memErrSyndromeReg >> 2] = Chip::mesrFor (syndrome);
+	port->regs[Chip::faultExcpReg >> 2] |= excpBits;
+}
+
+// True while an unmasked exception holds the chip fault line
+template <class Chip> bool simChipFaultAsserted (const SimRegPort *port)
+{
+	return (port->regs[Chip::faultExcpReg >> 2] & port->regs[Chip::faultMaskReg >> 2]) != 0;
+}
+
+#endif /* _HOSTTESTS_SIMCHIP_H */
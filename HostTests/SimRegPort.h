@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// A simulated Uni-N register file that implements the U3RegTransaction.h port.  Every lock,
+// load, store and fence is counted and logged, so tests can check what the engine issued.
+// Registers are plain memory unless given one of the side effects the driver depends on;
+// SimChip.h lays out a whole chip with them.
+
+#ifndef _HOSTTESTS_SIMREGPORT_H
+#define _HOSTTESTS_SIMREGPORT_H
+
+#include <string.h>
+#include <libkern/OSTypes.h>
+
+#define kSimRegCount		64		// registers at offsets 0, 4, ... 0xFC
+#define kSimShadowCount		2
+#define kSimLogSize			256
+
+// What a register does besides hold its value
+enum
+{
+	kSimRegPlain		= 0,
+	kSimRegClearOnRead	= 1,	// a load returns the value and clears it, like APIEXCP and MESR
+	kSimRegReadOnly		= 2,	// stores are dropped, like the version register
+	kSimRegToggle		= 3		// pulse bits of a store act once and read back clear, like the MPIC reset
+};
+
+class SimRegPort
+{
+public:
+	typedef int	LockState;
+
+	UInt32		regs[kSimRegCount];
+	UInt32		shadowOffset[kSimShadowCount];
+	UInt32		shadowValue[kSimShadowCount];
+	UInt32		shadowVolatile[kSimShadowCount];	// bits not carried forward, as in gU3RegShadowTable
+	UInt8		behaviour[kSimRegCount];			// kSimReg*
+	UInt32		pulseBits[kSimRegCount];			// kSimRegToggle only
+
+	UInt32		locks, unlocks, lockedMask, loads, stores, fences;
+	UInt32		clearingReads, droppedStores, pulses;	// side effects that happened
+	char		log[kSimLogSize];					// one letter per access: L load, S store, F fence
+	UInt32		logLength;
+
+	SimRegPort ()
+	{
+		memset (this, 0, sizeof(*this));
+		shadowOffset[0] = shadowOffset[1] = 0xFFFFFFFF;
+	}
+
+	void clearCounts (void)
+	{
+		locks = unlocks = lockedMask = loads = stores = fences = logLength = 0;
+		clearingReads = droppedStores = pulses = 0;
+		log[0] = 0;
+	}
+
+	// Offsets 0x00-0x3F are domain 0, 0x40-0x7F domain 1, and so on
+	UInt32 lockDomain (UInt32 offset)				{ return (offset >> 6) & 3; }
+
+	LockState lock (UInt32 domainMask)
+	{
+		locks++;
+		lockedMask = domainMask;
+		return 42;
+	}
+
+	void unlock (UInt32 domainMask, LockState state)
+	{
+		unlocks++;
+		if ((domainMask != lockedMask) || (state != 42))
+			lockedMask = 0xDEAD;
+	}
+
+	SInt32 shadowIndex (UInt32 offset)
+	{
+		for (SInt32 i = 0; i < kSimShadowCount; i++)
+			if (shadowOffset[i] == offset)
+				return i;
+		return -1;
+	}
+
+	UInt32 shadow (SInt32 index)					{ return shadowValue[index]; }
+
+	void updateShadow (SInt32 index, UInt32 data)
+	{
+		if (index >= 0)
+			shadowValue[index] = data & ~shadowVolatile[index];
+	}
+
+	UInt32 load (UInt32 offset)
+	{
+		UInt32 data = regs[offset >> 2];
+
+		loads++;
+		note ('L');
+		if (behaviour[offset >> 2] == kSimRegClearOnRead) {
+			regs[offset >> 2] = 0;
+			if (data)
+				clearingReads++;
+		}
+		return data;
+	}
+
+	void store (UInt32 offset, UInt32 data)
+	{
+		stores++;
+		note ('S');
+		switch (behaviour[offset >> 2]) {
+			case kSimRegReadOnly:
+				droppedStores++;
+				return;
+
+			case kSimRegToggle:
+				if (data & pulseBits[offset >> 2])
+					pulses++;
+				data &= ~pulseBits[offset >> 2];
+				break;
+		}
+		regs[offset >> 2] = data;
+	}
+
+	void fence (void)								{ fences++; note ('F'); }
+
+private:
+	void note (char c)
+	{
+		if (logLength < kSimLogSize - 1) {
+			log[logLength++] = c;
+			log[logLength] = 0;
+		}
+	}
+};
+
+#endif /* _HOSTTESTS_SIMREGPORT_H */
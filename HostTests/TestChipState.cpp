@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Runs the U3ChipState.h sequences - start's variant selection, sleep and wake, the HT link
+// and the chip fault handler - against a simulated U3 Lite, U3 Heavy and U4.  Errors are
+// injected the way the hardware latches them, and the checks cover what the chip sees as
+// well as what the driver decides: clear-on-read registers are read once, under their lock,
+// and the chip fault mask is closed while the fault is captured and restored after.
+
+#include "HostTest.h"
+#include "SimChip.h"
+
+static u3_reg_access_t	regIndex[kU3RegAccessSlots];
+
+template <UInt32 Variant> static UInt32 startVariant (void)
+{
+	SimRegPort port;
+
+	simPowerOn<Variant> (&port);
+	return U3ChipVariantFor<SimUniNRegs> (port.load (SimUniNRegs::versionReg));
+}
+
+static void testVersionRegisters (void)
+{
+	SimRegPort port;
+
+	HT_CHECK_EQ (startVariant<kU3VariantLite> (), kU3VariantLite);
+	HT_CHECK_EQ (startVariant<kU3VariantHeavy> (), kU3VariantHeavy);
+	HT_CHECK_EQ (startVariant<kU3VariantU4> (), kU3VariantU4);
+	HT_CHECK_EQ (U3ChipVariantFor<SimUniNRegs> (kSimVersionTooOld), kU3NumVariants);
+
+	// The version register can't be written
+	simPowerOn<kU3VariantHeavy> (&port);
+	port.store (kSimVersion, kSimVersionU4);
+	HT_CHECK_EQ (port.droppedStores, 1);
+	HT_CHECK_EQ (port.load (kSimVersion), kSimVersionHeavy);
+}
+
+// A DART write exception is captured, cleared and reported; a read exception only cleared
+template <UInt32 Variant> static void testDARTExcp (void)
+{
+	typedef SimChipTraits<Variant>	Chip;
+	SimRegPort						port;
+	u3_chip_fault_state_t			state;
+	u3_chip_fault_decode_t			decode;
+	UInt32							savedMask;
+
+	simPowerOn<Variant> (&port);
+	port.store (Chip::faultMaskReg, Chip::dartExcpBit);
+	port.updateShadow (port.shadowIndex (Chip::faultMaskReg), Chip::dartExcpBit);
+
+	simInjectDARTExcp<Chip> (&port, kSimDARTExcpWrite | 0x1234);
+	HT_CHECK (simChipFaultAsserted<Chip> (&port));
+
+	port.clearCounts ();
+	savedMask = U3CaptureChipFault<Chip> (port, regIndex, &state);
+	HT_CHECK_EQ (savedMask, Chip::dartExcpBit);
+	HT_CHECK_EQ (state.apiexcp, Chip::dartExcpBit);
+	HT_CHECK_EQ (state.dartexcp, kSimDARTExcpWrite | 0x1234);
+	HT_CHECK_EQ (state.mesr, 0);
+	HT_CHECK_EQ (port.clearingReads, 1);
+	HT_CHECK_EQ (port.regs[Chip::faultExcpReg >> 2], 0);
+	HT_CHECK_EQ (port.regs[Chip::faultMaskReg >> 2], 0);
+
+	// Mask, exception register and DART exception register: one lock for the transaction,
+	// none for the plain DART register
+	HT_CHECK_EQ (port.locks, 1);
+	HT_CHECK_EQ (port.lockedMask, 1 << kU3LockDomainAPI);
+
+	U3DecodeChipFault<Chip> (&state, &decode);
+	HT_CHECK_EQ (decode.actions, kU3FaultDARTWrite);
+
+	U3RestoreChipFaultMask<Chip> (port, savedMask);
+	HT_CHECK_EQ (port.regs[Chip::faultMaskReg >> 2], Chip::dartExcpBit);
+	HT_CHECK (!simChipFaultAsserted<Chip> (&port));
+
+	// A second capture finds nothing: the exception was cleared by the first
+	savedMask = U3CaptureChipFault<Chip> (port, regIndex, &state);
+	HT_CHECK_EQ (state.apiexcp, 0);
+	U3RestoreChipFaultMask<Chip> (port, savedMask);
+
+	simInjectDARTExcp<Chip> (&port, 0x1234);
+	savedMask = U3CaptureChipFault<Chip> (port, regIndex, &state);
+	U3DecodeChipFault<Chip> (&state, &decode);
+	HT_CHECK_EQ (decode.actions, 0);
+}
+
+// Captures an injected ECC error and checks the decode
+template <UInt32 Variant> static void checkECC (UInt32 excpBits, UInt32 rank, UInt32 syndrome,
+	UInt32 actions, UInt32 dimm, UInt32 dimmCount)
+{
+	typedef SimChipTraits<Variant>	Chip;
+	SimRegPort						port;
+	u3_chip_fault_state_t			state;
+	u3_chip_fault_decode_t			decode;
+
+	simPowerOn<Variant> (&port);
+	simInjectECC<Chip> (&port, excpBits, U3SetRegField<typename Chip::RankField> (0, rank), syndrome);
+
+	port.clearCounts ();
+	U3CaptureChipFault<Chip> (port, regIndex, &state);
+	HT_CHECK_EQ (state.apiexcp, excpBits);
+	HT_CHECK_EQ (state.mesr, Chip::mesrFor (syndrome));
+
+	// APIEXCP and MESR were each read once, which cleared them; MESR under its own lock
+	HT_CHECK_EQ (port.regs[Chip::faultExcpReg >> 2], 0);
+	HT_CHECK_EQ (port.regs[Chip::memErrSyndromeReg >> 2], 0);
+	HT_CHECK_EQ (port.clearingReads, syndrome ? 2 : 1);
+	HT_CHECK_EQ (port.locks, 2);
+	HT_CHECK_EQ (port.lockedMask, 1 << kU3LockDomainMemCtl);
+
+	U3DecodeChipFault<Chip> (&state, &decode);
+	HT_CHECK_EQ (decode.actions, actions);
+	HT_CHECK_EQ (decode.rank, rank);
+	HT_CHECK_EQ (decode.dimm, dimm);
+	HT_CHECK_EQ (decode.dimmCount, dimmCount);
+}
+
+static void testU3HeavyECC (void)
+{
+	// Correctable, one half flagged: the CE bit decides
+	checkECC<kU3VariantHeavy> (kSimAPIECCCELow, 3, SyndromeTable[5], kU3FaultECCCorrectable, 2, 1);
+	checkECC<kU3VariantHeavy> (kSimAPIECCCEHigh, 3, SyndromeTable[5], kU3FaultECCCorrectable, 3, 1);
+
+	// Both halves flagged: a data bit narrows it to its DIMM, a check bit or a multi-bit
+	// syndrome leaves both
+	checkECC<kU3VariantHeavy> (kSimAPIECCCEHigh | kSimAPIECCCELow, 4, SyndromeTable[70], kU3FaultECCCorrectable, 5, 1);
+	checkECC<kU3VariantHeavy> (kSimAPIECCCEHigh | kSimAPIECCCELow, 4, SyndromeTable[12], kU3FaultECCCorrectable, 4, 1);
+	checkECC<kU3VariantHeavy> (kSimAPIECCCEHigh | kSimAPIECCCELow, 4, SyndromeTable[130], kU3FaultECCCorrectable, 4, 2);
+	checkECC<kU3VariantHeavy> (kSimAPIECCCEHigh | kSimAPIECCCELow, 4, 0x00FF, kU3FaultECCCorrectable, 4, 2);
+
+	// Uncorrectable: the UE bits decide, and a correctable error with it doesn't matter
+	checkECC<kU3VariantHeavy> (kSimAPIECCUELow, 1, 0, kU3FaultECCUncorrectable, 0, 1);
+	checkECC<kU3VariantHeavy> (kSimAPIECCUEHigh | kSimAPIECCCELow, 1, 0, kU3FaultECCUncorrectable, 1, 1);
+	checkECC<kU3VariantHeavy> (kSimAPIECCUEHigh | kSimAPIECCUELow, 6, 0, kU3FaultECCUncorrectable, 6, 2);
+}
+
+static void testU4ECC (void)
+{
+	// The syndrome names the DIMM of the rank
+	checkECC<kU3VariantU4> (kSimU4APIECCCE, 4, SyndromeTable[5], kU3FaultECCCorrectable, 4, 1);
+	checkECC<kU3VariantU4> (kSimU4APIECCCE, 4, SyndromeTable[100], kU3FaultECCCorrectable, 5, 1);
+	checkECC<kU3VariantU4> (kSimU4APIECCCE, 2, SyndromeTable[140], kU3FaultECCCorrectable, 2, 1);
+
+	// An uncorrectable error names the rank
+	checkECC<kU3VariantU4> (kSimU4APIECCUE, 6, 0, kU3FaultECCUncorrectable, 6, 2);
+	checkECC<kU3VariantU4> (kSimU4APIECCUE | kSimU4APIECCCE, 2, 0, kU3FaultECCUncorrectable, 2, 2);
+}
+
+// U3 Lite has no ECC: an ECC bit is not read as one, and the memory controller isn't touched
+static void testLiteHasNoECC (void)
+{
+	typedef SimChipTraits<kU3VariantLite>	Chip;
+	SimRegPort								port;
+	u3_chip_fault_state_t					state;
+	u3_chip_fault_decode_t					decode;
+
+	simPowerOn<kU3VariantLite> (&port);
+	simInjectECC<SimChipTraits<kU3VariantHeavy> > (&port, kSimAPIECCCELow, 0x200, SyndromeTable[5]);
+
+	U3CaptureChipFault<Chip> (port, regIndex, &state);
+	U3DecodeChipFault<Chip> (&state, &decode);
+	HT_CHECK_EQ (state.mear, 0);
+	HT_CHECK_EQ (state.mesr, 0);
+	HT_CHECK (port.regs[kSimMESR >> 2] != 0);
+	HT_CHECK_EQ (decode.actions, 0);
+}
+
+// Save, sleep, lose power, wake and restore
+template <UInt32 Variant> static void testSleepWake (bool hasMPIC)
+{
+	typedef SimChipTraits<Variant>	Chip;
+	SimRegPort						port;
+	u3_uni_n_saved_t				saved = { 0, 0, 0 };
+	u3_reg_transaction_t			list[kU3UniNRestoreEntries];
+	UInt32							count;
+
+	simPowerOn<Variant> (&port);
+	port.regs[kSimDARTCntl >> 2] = 0xDA000001;
+	port.regs[kSimPMClockControl >> 2] = 0xC1000002;
+	port.regs[kSimVSPSoftReset >> 2] = 0x55000003;
+	port.regs[kSimHWInitState >> 2] = kSimHWInitRunning;
+	port.regs[kSimToggle >> 2] = kSimMPICEnable | 0x100;
+	port.updateShadow (0, kSimMPICEnable | 0x100);
+
+	port.clearCounts ();
+	U3SaveUniNState<SimUniNRegs> (port, regIndex, Chip::hasPMClockControl, &saved);
+	HT_CHECK_EQ (saved.dartCntl, 0xDA000001);
+	HT_CHECK_EQ (saved.clockCntl, Chip::hasPMClockControl ? 0xC1000002 : 0);
+	HT_CHECK_EQ (saved.vspSoftReset, Chip::hasPMClockControl ? 0x55000003 : 0);
+	HT_CHECK_EQ (port.locks, 0);
+
+	count = U3BuildUniNSleep<SimUniNRegs> (hasMPIC, list);
+	HT_CHECK (count <= kU3UniNSleepEntries);
+	HT_CHECK (U3RunRegTransaction (port, list, count));
+	HT_CHECK_EQ (port.regs[kSimHWInitState >> 2], kSimHWInitSleeping);
+	HT_CHECK_EQ (port.regs[kSimToggle >> 2], hasMPIC ? 0x100 : (kSimMPICEnable | 0x100));
+
+	// Power comes back with the registers reset; the driver reloads its shadows before restoring
+	simPowerOn<Variant> (&port);
+	port.regs[kSimPMClockControl >> 2] = 0xEEEEEEEE;
+	port.regs[kSimVSPSoftReset >> 2] = 0xEEEEEEEE;
+
+	count = U3BuildUniNRestore<SimUniNRegs> (&saved, hasMPIC, Chip::hasPMClockControl, list);
+	HT_CHECK (count <= kU3UniNRestoreEntries);
+	port.clearCounts ();
+	HT_CHECK (U3RunRegTransaction (port, list, count));
+	HT_CHECK_EQ (port.locks, 1);
+	HT_CHECK_EQ (port.regs[kSimHWInitState >> 2], kSimHWInitRunning);
+	HT_CHECK_EQ (port.regs[kSimDARTCntl >> 2], 0xDA000001);
+	HT_CHECK_EQ (port.regs[kSimToggle >> 2], hasMPIC ? kSimMPICEnable : 0);
+	HT_CHECK_EQ (port.regs[kSimPMClockControl >> 2], Chip::hasPMClockControl ? 0xC1000002 : 0xEEEEEEEE);
+	HT_CHECK_EQ (port.regs[kSimVSPSoftReset >> 2], Chip::hasPMClockControl ? 0x55000003 : 0xEEEEEEEE);
+	HT_CHECK_EQ (port.regs[kSimVersion >> 2], Chip::version);
+}
+
+// The MPIC reset bit is a pulse: it acts once and never comes back from the shadow
+static void testTogglePulse (void)
+{
+	SimRegPort				port;
+	u3_reg_transaction_t	write = { kU3RegOpWrite, kSimToggle, kSimMPICEnable | kSimMPICReset, kSimMPICEnable | kSimMPICReset };
+
+	simPowerOn<kU3VariantHeavy> (&port);
+	HT_CHECK (U3RunRegTransaction (port, &write, 1));
+	HT_CHECK_EQ (port.pulses, 1);
+	HT_CHECK_EQ (port.regs[kSimToggle >> 2], kSimMPICEnable);
+	HT_CHECK_EQ (port.shadow (0), kSimMPICEnable);
+
+	// A later masked write of another bit doesn't pulse the reset again
+	write.mask = write.value = 0x100;
+	HT_CHECK (U3RunRegTransaction (port, &write, 1));
+	HT_CHECK_EQ (port.pulses, 1);
+	HT_CHECK_EQ (port.regs[kSimToggle >> 2], kSimMPICEnable | 0x100);
+}
+
+static void testHTLink (void)
+{
+	SimRegPort	port;
+	UInt32		outWidth, inWidth;
+
+	simPowerOn<kU3VariantU4> (&port);
+	port.regs[kSimHTLinkFreq >> 2] = 0xA00000A5;
+	port.regs[kSimHTLinkConfig >> 2] = 0x80000081;
+
+	port.clearCounts ();
+	U3SetHTLinkFrequency<SimUniNRegs> (port, 6);
+	HT_CHECK_EQ (port.regs[kSimHTLinkFreq >> 2], 0xA00006A5);
+	HT_CHECK_EQ (U3GetHTLinkFrequency<SimUniNRegs> (port, regIndex), 6);
+
+	U3SetHTLinkWidth<SimUniNRegs> (port, 5, 3);
+	HT_CHECK_EQ (port.regs[kSimHTLinkConfig >> 2], 0xD3000081);
+	U3GetHTLinkWidth<SimUniNRegs> (port, regIndex, &outWidth, &inWidth);
+	HT_CHECK_EQ (outWidth, 5);
+	HT_CHECK_EQ (inWidth, 3);
+
+	// Each set is one locked read-modify-write; the gets take no lock
+	HT_CHECK_EQ (port.stores, 2);
+	HT_CHECK_EQ (port.locks, 2);
+	HT_CHECK_EQ (port.lockedMask, 1 << kU3LockDomainHT);
+
+	// Sleep puts the link back to its defaults
+	U3SetHTLinkFrequency<SimUniNRegs> (port, 0);
+	U3SetHTLinkWidth<SimUniNRegs> (port, 0, 0);
+	HT_CHECK_EQ (port.regs[kSimHTLinkFreq >> 2], 0xA00000A5);
+	HT_CHECK_EQ (port.regs[kSimHTLinkConfig >> 2], 0x80000081);
+}
+
+int main (void)
+{
+	simBuildRegAccessIndex (regIndex);
+
+	testVersionRegisters ();
+	testDARTExcp<kU3VariantLite> ();
+	testDARTExcp<kU3VariantHeavy> ();
+	testDARTExcp<kU3VariantU4> ();
+	testU3HeavyECC ();
+	testU4ECC ();
+	testLiteHasNoECC ();
+	testSleepWake<kU3VariantLite> (false);
+	testSleepWake<kU3VariantHeavy> (true);
+	testSleepWake<kU3VariantU4> (true);
+	testTogglePulse ();
+	testHTLink ();
+
+	return htFinish ("TestChipState");
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Checks the ECC syndrome decode: every SyndromeTable entry round-trips through the generated
+// table to its own bit, every one of the 65536 syndromes decodes the same through the table as
+// through the search it replaces, and U3 Heavy's syndrome bytes and the DIMM choice give the
+// bits U4 reports.
+
+#include "HostTest.h"
+#include "U3ECCSyndrome.h"
+
+// The search the generated table replaced, as the reference it is checked against
+static UInt32 scanSyndrome (UInt32 syndrome)
+{
+	UInt32 bit;
+
+	for (bit = 0; bit < kECCAllBits; bit++)
+		if (SyndromeTable[bit] == syndrome)
+			return bit;
+
+	return kU3SyndromeMultiBit;
+}
+
+static void testRoundTrip (void)
+{
+	UInt32 bit;
+
+	for (bit = 0; bit < kECCAllBits; bit++) {
+		HT_CHECK_EQ (U3DecodeSyndrome (SyndromeTable[bit]), bit);
+		HT_CHECK_EQ (scanSyndrome (SyndromeTable[bit]), bit);
+	}
+}
+
+static void testEverySyndrome (void)
+{
+	UInt32 syndrome, bit, singles = 0, mismatches = 0;
+
+	for (syndrome = 0; syndrome <= 0xFFFF; syndrome++) {
+		bit = U3DecodeSyndrome (syndrome);
+		if (bit != scanSyndrome (syndrome))
+			mismatches++;
+		if (bit != kU3SyndromeMultiBit)
+			singles++;
+	}
+
+	HT_CHECK_EQ (mismatches, 0);
+	HT_CHECK_EQ (singles, kECCAllBits);		// so no two bits share a syndrome
+	HT_CHECK_EQ (U3DecodeSyndrome (0), kU3SyndromeMultiBit);
+	HT_CHECK_EQ (U3DecodeSyndrome (0x10000 | SyndromeTable[5]), kU3SyndromeMultiBit);
+}
+
+static void testCheckBits (void)
+{
+	UInt32 bit;
+
+	// The check bits are the identity part of the code: each flips only its own syndrome bit
+	for (bit = kU3SyndromeFirstCheckBit; bit < kECCAllBits; bit++)
+		HT_CHECK_EQ (U3DecodeSyndrome (0x8000 >> (bit - kU3SyndromeFirstCheckBit)), bit);
+}
+
+static void testU3HeavyAndDIMM (void)
+{
+	UInt32 bit;
+
+	for (bit = 0; bit < kECCAllBits; bit++) {
+		UInt32 syndrome = SyndromeTable[bit];
+
+		HT_CHECK_EQ (U3DecodeSyndrome (U3HeavySyndrome (syndrome >> 8, syndrome & 0xFF)), bit);
+		HT_CHECK_EQ (U3SyndromeBitOnUpperDIMM (bit), (bit >= 64) && (bit < 128));
+	}
+
+	HT_CHECK_EQ (U3HeavySyndrome (0x1C2, 0x349), 0xC249);		// extra field bits are dropped
+	HT_CHECK (!U3SyndromeBitOnUpperDIMM (kU3SyndromeMultiBit));
+}
+
+int main (void)
+{
+	testRoundTrip ();
+	testEverySyndrome ();
+	testCheckBits ();
+	testU3HeavyAndDIMM ();
+
+	return htFinish ("TestECCSyndrome");
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Checks the platform-do op compiler (U3CompilePFCommands, used by compilePlatformFunction)
+// on constructed command sets, and runs the register ops it produces through
+// U3WriteRegKeepingBits on the simulated register file.
+
+#include "HostTest.h"
+#include "SimRegPort.h"
+#include "PFBlob.h"
+#include "U3RegTransaction.h"
+#include "U3PFCompile.h"
+
+#define kMaxOps		16
+
+static UInt32 compile (const PFBlob &blob, u3_pf_op_t *ops, UInt32 *flags, UInt32 maxOps = kMaxOps)
+{
+	return U3CompilePFCommands (blob.cursor (), blob.words[0], ops, maxOps, flags);
+}
+
+static void testWriteRegFoldsTheMask (void)
+{
+	u3_pf_op_t	ops[kMaxOps];
+	UInt32		flags;
+	PFBlob		plain, masked;
+
+	plain.writeReg32 (0x40, 0x12345678, 0xFFFFFFFF);
+	HT_CHECK_EQ (compile (plain, ops, &flags), 1);
+	HT_CHECK_EQ (flags, 0);
+	HT_CHECK_EQ (ops[0].opcode, kU3PFOpWriteReg);
+	HT_CHECK_EQ (ops[0].offset, 0x40);
+	HT_CHECK_EQ (ops[0].value, 0x12345678);
+	HT_CHECK_EQ (ops[0].keepMask, 0);		// all ones is a plain store
+
+	masked.writeReg32 (0x44, 0x00000300, 0xFFFFF0FF);
+	HT_CHECK_EQ (compile (masked, ops, &flags), 1);
+	HT_CHECK_EQ (ops[0].keepMask, 0xFFFFF0FF);
+}
+
+static void testConfigSequence (void)
+{
+	u3_pf_op_t	ops[kMaxOps];
+	UInt32		flags;
+	PFBlob		blob;
+
+	blob.list (3).readConfig (0x50, 4).rmwConfig (0x50, 0xFFFF00FF, 0x00002200).writeReg32 (0x48, 1, 0xFFFFFFFF);
+	HT_CHECK_EQ (compile (blob, ops, &flags), 3);
+	HT_CHECK_EQ (flags, kU3PFCompileConfig);
+	HT_CHECK_EQ (ops[0].opcode, kU3PFOpReadConfig);
+	HT_CHECK_EQ (ops[0].offset, 0x50);
+	HT_CHECK_EQ (ops[1].opcode, kU3PFOpRMWConfig);
+	HT_CHECK_EQ (ops[1].offset, 0x50);
+	HT_CHECK_EQ (ops[1].keepMask, 0xFFFF00FF);
+	HT_CHECK_EQ (ops[1].value, 0x00002200);
+	HT_CHECK_EQ (ops[2].opcode, kU3PFOpWriteReg);
+}
+
+static void testParks (void)
+{
+	u3_pf_op_t	ops[kMaxOps];
+	UInt32		flags;
+	PFBlob		blob;
+
+	blob.list (3).writeReg32 (0x40, 1, 0xFFFFFFFE).delay (100).waitReg32 (0x44, 0x10, 0x30);
+	HT_CHECK_EQ (compile (blob, ops, &flags), 3);
+	HT_CHECK_EQ (flags, kU3PFCompileParks);
+	HT_CHECK_EQ (ops[1].opcode, kU3PFOpDelay);
+	HT_CHECK_EQ (ops[1].value, 100);
+	HT_CHECK_EQ (ops[2].opcode, kU3PFOpWaitReg);
+	HT_CHECK_EQ (ops[2].offset, 0x44);
+	HT_CHECK_EQ (ops[2].value, 0x10);
+	HT_CHECK_EQ (ops[2].keepMask, 0x30);
+}
+
+// Everything the compiler must refuse, leaving the function to the interpreter
+static void testRejects (void)
+{
+	static const UInt8	i2cData[3] = { 1, 2, 3 };
+	u3_pf_op_t			ops[kMaxOps];
+	UInt32				flags;
+
+	{	PFBlob b; b.rmwConfig (0x50, 0xFF, 0x01);					// no read before the modify
+		HT_CHECK_EQ (compile (b, ops, &flags), 0); }
+	{	PFBlob b(0); b.list (2).readConfig (0x50, 4).rmwConfig (0x50, 0xFF, 0x01);	// config without a pHandle
+		HT_CHECK_EQ (compile (b, ops, &flags), 0); }
+	{	PFBlob b; b.list (2).readConfig (0x50, 2).rmwConfig (0x50, 0xFF, 0x01);	// not 32 bits wide
+		HT_CHECK_EQ (compile (b, ops, &flags), 0); }
+	{	PFBlob b; b.list (2).readConfig (0x50, 4);
+		b.add (kCommandRMWConfig).add (0x50).add (2).add (2).add (4).add (0xFFFF0001);	// 16 bit arrays
+		HT_CHECK_EQ (compile (b, ops, &flags), 0); }
+	{	PFBlob b; b.writeI2C (i2cData, 3);							// not a Uni-N command
+		HT_CHECK_EQ (compile (b, ops, &flags), 0); }
+	{	PFBlob b; b.list (2).writeReg32 (0x40, 1, 0xFFFFFFFF).add (kCommandWriteReg32).add (0x44);	// truncated
+		HT_CHECK_EQ (compile (b, ops, &flags), 0); }
+	{	PFBlob b; b.list (3).writeReg32 (0x40, 1, 0xFFFFFFFF).writeReg32 (0x44, 1, 0xFFFFFFFF).writeReg32 (0x48, 1, 0xFFFFFFFF);
+		HT_CHECK_EQ (compile (b, ops, &flags, 2), 0);				// more commands than room
+		HT_CHECK_EQ (compile (b, ops, &flags, 3), 3); }
+}
+
+// Compiled register writes on the simulated register file
+static void testWriteRegOps (void)
+{
+	SimRegPort	port;
+	u3_pf_op_t	ops[kMaxOps];
+	UInt32		flags;
+	PFBlob		blob;
+
+	port.regs[0x40 >> 2] = 0xAAAAAAAA;
+	port.regs[0x44 >> 2] = 0xAAAAAAAA;
+	port.regs[0x48 >> 2] = 0xAAAAAAAA;
+	port.shadowOffset[0] = 0x48;
+	port.shadowValue[0] = 0x0000FFFF;		// shadow, not hardware, is what gets kept
+	port.shadowVolatile[0] = 0x00000001;
+
+	blob.list (3).writeReg32 (0x40, 0x11111111, 0xFFFFFFFF).writeReg32 (0x44, 0x00000055, 0xFFFFFF00)
+		.writeReg32 (0x48, 0x00050000, 0x0000FFFF);
+	HT_CHECK_EQ (compile (blob, ops, &flags), 3);
+
+	for (UInt32 i = 0; i < 3; i++)
+		U3WriteRegKeepingBits (port, ops[i].offset, ops[i].keepMask, ops[i].value);
+
+	HT_CHECK_EQ (port.regs[0x40 >> 2], 0x11111111);
+	HT_CHECK_EQ (port.regs[0x44 >> 2], 0xAAAAAA55);
+	HT_CHECK_EQ (port.regs[0x48 >> 2], 0x0005FFFF);
+	HT_CHECK_EQ (port.shadowValue[0], 0x0005FFFE);
+	HT_CHECK_EQ (port.loads, 1);			// only the unshadowed masked write reads
+	HT_CHECK_EQ (port.fences, 3);
+}
+
+int main (void)
+{
+	testWriteRegFoldsTheMask ();
+	testConfigSequence ();
+	testParks ();
+	testRejects ();
+	testWriteRegOps ();
+
+	return htFinish ("TestPFCompile");
+}
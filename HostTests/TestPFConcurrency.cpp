@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Stress test of the platform function locking.  Threads run compiled programs concurrently
+// through U3RunPFOps, with conflict sets from U3PFRegDomains and the config gate picked by the
+// compiler, exactly as runPlatformProgram does.  The simulated hardware checks every access:
+// a register may only be touched by the thread holding its lock domain, a nub's config space
+// only by the owner of its gate, and nothing may write a nub's config between a program's
+// read and its modify.  Each access yields the CPU so runs interleave even on one CPU.
+// Parked programs (Delay, WaitReg32) run from thread calls in the kext and are not simulated.
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "HostTest.h"
+#include "PFBlob.h"
+#include "U3RegTransaction.h"
+#include "U3PFCompile.h"
+
+#define kDomains			4
+#define kNubs				2
+#define kThreads			4
+#define kRunsPerThread		20000
+#define kPrograms			8
+
+struct SimHardware
+{
+	UInt32				regs[64];
+	pthread_mutex_t		domainLock[kDomains];
+	pthread_t			domainOwner[kDomains];
+	bool				domainHeld[kDomains];
+
+	UInt32				config[kNubs][16];
+	UInt32				configWrites[kNubs];
+	pthread_mutex_t		gateLock[kNubs];
+	pthread_t			gateOwner[kNubs];
+	bool				gateHeld[kNubs];
+
+	volatile UInt32		violations, inFlight, maxInFlight;
+};
+
+static SimHardware	hw;
+
+static void violation (const char *what, UInt32 where)
+{
+	if (__sync_fetch_and_add (&hw.violations, 1) < 10)
+		fprintf (stderr, "TestPFConcurrency: %s 0x%x\n", what, where);
+}
+
+// One per run, for the program's nub
+class StressPort
+{
+public:
+	typedef int	LockState;
+
+	StressPort (SInt32 nub) : nub(nub), readAt(0) {}
+
+	UInt32 lockDomain (UInt32 offset)				{ return (offset >> 6) & (kDomains - 1); }
+
+	LockState lock (UInt32 domainMask)
+	{
+		for (UInt32 d = 0; d < kDomains; d++)
+			if (domainMask & (1 << d)) {
+				pthread_mutex_lock (&hw.domainLock[d]);
+				hw.domainOwner[d] = pthread_self ();
+				hw.domainHeld[d] = true;
+			}
+		return 0;
+	}
+
+	void unlock (UInt32 domainMask, LockState state)
+	{
+		for (SInt32 d = kDomains - 1; d >= 0; d--)
+			if (domainMask & (1 << d)) {
+				hw.domainHeld[d] = false;
+				pthread_mutex_unlock (&hw.domainLock[d]);
+			}
+	}
+
+	SInt32 shadowIndex (UInt32 offset)				{ return -1; }
+	UInt32 shadow (SInt32 index)					{ return 0; }
+	void updateShadow (SInt32 index, UInt32 data)	{}
+	void fence (void)								{}
+
+	UInt32 load (UInt32 offset)
+	{
+		checkDomain (offset);
+		sched_yield ();
+		return hw.regs[offset >> 2];
+	}
+
+	void store (UInt32 offset, UInt32 data)
+	{
+		checkDomain (offset);
+		hw.regs[offset >> 2] = data;
+		sched_yield ();
+	}
+
+	void lockGate (void)
+	{
+		pthread_mutex_lock (&hw.gateLock[nub]);
+		hw.gateOwner[nub] = pthread_self ();
+		hw.gateHeld[nub] = true;
+	}
+
+	void unlockGate (void)
+	{
+		hw.gateHeld[nub] = false;
+		pthread_mutex_unlock (&hw.gateLock[nub]);
+	}
+
+	UInt32 configRead (UInt32 offset)
+	{
+		checkGate ();
+		readAt = hw.configWrites[nub];
+		sched_yield ();
+		return hw.config[nub][offset >> 2];
+	}
+
+	void configWrite (UInt32 offset, UInt32 data)
+	{
+		checkGate ();
+		if (hw.configWrites[nub] != readAt)
+			violation ("config written between read and modify on nub", nub);
+		hw.config[nub][offset >> 2] = data;
+		hw.configWrites[nub]++;
+		sched_yield ();
+	}
+
+	void execOp (const u3_pf_op_t *op, UInt32 *data, UInt32 lockDomains)
+	{
+		U3ExecPFOp (*this, op, data, lockDomains);
+	}
+
+private:
+	SInt32	nub;
+	UInt32	readAt;
+
+	void checkDomain (UInt32 offset)
+	{
+		UInt32 d = lockDomain (offset);
+
+		if (!hw.domainHeld[d] || !pthread_equal (hw.domainOwner[d], pthread_self ()))
+			violation ("register accessed without its domain", offset);
+	}
+
+	void checkGate (void)
+	{
+		if ((nub < 0) || !hw.gateHeld[nub] || !pthread_equal (hw.gateOwner[nub], pthread_self ()))
+			violation ("config accessed without the gate of nub", nub);
+	}
+};
+
+struct Program
+{
+	u3_pf_op_t		ops[8];
+	UInt32			opCount;
+	UInt32			regDomains;
+	bool			gated;
+	SInt32			nub;
+	UInt32			runs;
+};
+
+static Program	programs[kPrograms];
+
+static void compile (Program *program, const PFBlob &blob, SInt32 nub)
+{
+	StressPort	port(nub);
+	UInt32		flags;
+
+	program->opCount = U3CompilePFCommands (blob.cursor (), blob.words[0], program->ops, 8, &flags);
+	HT_CHECK (program->opCount != 0);
+	program->regDomains = U3PFRegDomains (port, program->ops, program->opCount);
+	program->gated = (flags & kU3PFCompileConfig) != 0;
+	program->nub = nub;
+}
+
+static void *runThread (void *arg)
+{
+	UInt32	seed = (UInt32)(unsigned long)arg, n, data;
+
+	for (n = 0; n < kRunsPerThread; n++) {
+		Program		*program = &programs[htRandom (&seed) % kPrograms];
+		StressPort	port(program->nub);
+		UInt32		inFlight = __sync_add_and_fetch (&hw.inFlight, 1), max;
+
+		while ((max = hw.maxInFlight) < inFlight && !__sync_bool_compare_and_swap (&hw.maxInFlight, max, inFlight))
+			;
+
+		data = 0;
+		U3RunPFOps (port, program->ops, program->opCount, program->regDomains, program->gated, &data);
+		__sync_fetch_and_add (&program->runs, 1);
+		__sync_sub_and_fetch (&hw.inFlight, 1);
+	}
+
+	return NULL;
+}
+
+int main (void)
+{
+	pthread_t	threads[kThreads];
+	UInt32		i;
+
+	for (i = 0; i < kDomains; i++)
+		pthread_mutex_init (&hw.domainLock[i], NULL);
+	for (i = 0; i < kNubs; i++)
+		pthread_mutex_init (&hw.gateLock[i], NULL);
+
+	// Register-only programs, one or two domains each
+	{ PFBlob b; b.list (2).writeReg32 (0x00, 0x1, ~0x1U).writeReg32 (0x04, 0x2, ~0x2U); compile (&programs[0], b, -1); }
+	{ PFBlob b; b.writeReg32 (0x40, 0x4, ~0x4U); compile (&programs[1], b, -1); }
+	{ PFBlob b; b.list (2).writeReg32 (0x80, 0x8, ~0x8U).writeReg32 (0xC0, 0x10, ~0x10U); compile (&programs[2], b, -1); }
+	{ PFBlob b; b.list (2).writeReg32 (0x0C, 0x20, ~0x20U).writeReg32 (0x4C, 0x40, 0xFFFFFFFF); compile (&programs[3], b, -1); }
+
+	// Config read-modify-writes, two per nub, some followed by a register write
+	{ PFBlob b(0x100); b.list (3).readConfig (0x10, 4).rmwConfig (0x10, ~0xFU, 0x5).writeReg32 (0x08, 0x80, ~0x80U);
+		compile (&programs[4], b, 0); }
+	{ PFBlob b(0x100); b.list (2).readConfig (0x10, 4).rmwConfig (0x10, ~0xF0U, 0x50); compile (&programs[5], b, 0); }
+	{ PFBlob b(0x200); b.list (3).readConfig (0x20, 4).rmwConfig (0x20, ~0xFU, 0xA).writeReg32 (0x44, 0x100, ~0x100U);
+		compile (&programs[6], b, 1); }
+	{ PFBlob b(0x200); b.list (2).readConfig (0x20, 4).rmwConfig (0x20, ~0xF00U, 0xA00); compile (&programs[7], b, 1); }
+
+	// The conflict sets the compiler derived
+	HT_CHECK_EQ (programs[0].regDomains, 1 << 0);
+	HT_CHECK_EQ (programs[2].regDomains, (1 << 2) | (1 << 3));
+	HT_CHECK_EQ (programs[3].regDomains, (1 << 0) | (1 << 1));
+	HT_CHECK_EQ (programs[5].regDomains, 0);
+	HT_CHECK (!programs[0].gated && programs[4].gated && programs[7].gated);
+
+	for (i = 0; i < kThreads; i++)
+		pthread_create (&threads[i], NULL, runThread, (void *)(unsigned long)(0x1234567 * (i + 1)));
+	for (i = 0; i < kThreads; i++)
+		pthread_join (threads[i], NULL);
+
+	HT_CHECK_EQ (hw.violations, 0);
+	for (i = 0; i < kPrograms; i++)
+		HT_CHECK (programs[i].runs > 0);
+
+	// Every program's bits are set, none lost to a racing read-modify-write
+	HT_CHECK_EQ (hw.regs[0x00 >> 2], 0x1);
+	HT_CHECK_EQ (hw.regs[0x04 >> 2], 0x2);
+	HT_CHECK_EQ (hw.regs[0x08 >> 2], 0x80);
+	HT_CHECK_EQ (hw.regs[0x44 >> 2], 0x100);
+	HT_CHECK_EQ (hw.config[0][0x10 >> 2], 0x55);
+	HT_CHECK_EQ (hw.config[1][0x20 >> 2], 0xA0A);
+
+	printf ("  %u runs on %u threads, up to %u in flight at once\n", kThreads * kRunsPerThread, kThreads, hw.maxInFlight);
+	HT_CHECK (hw.maxInFlight > 1);
+
+	return htFinish ("TestPFConcurrency");
+}
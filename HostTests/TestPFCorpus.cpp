@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Runs the command set corpus through IOPFValidateCommandSet and the cursor with each set
+// placed against an unmapped page.  Every set must give its expected result, and every
+// prefix of a well-formed set must either walk the whole set or end in an error - a cut
+// off property must never pass as a shorter program.
+
+#include "HostTest.h"
+#include "PFCorpus.h"
+
+static PFCorpusEntry	corpus[kPFCorpusMaxEntries];
+
+static void testEntry (const PFCorpusEntry *entry, PFGuardedBuffer *guarded)
+{
+	const UInt32	*data;
+	UInt32			result, count, walked, length;
+	bool			inBounds;
+
+	data = guarded->place (entry->words, entry->byteLength);
+	result = IOPFValidateCommandSet (data, entry->byteLength, &count);
+	if ((result != entry->expectError) || (count != entry->expectCount)) {
+		htFailures++;
+		fprintf (stderr, "%s: result %u after %u commands, expected %u after %u\n",
+			entry->name, (unsigned)result, (unsigned)count,
+			(unsigned)entry->expectError, (unsigned)entry->expectCount);
+	}
+
+	for (length = 0; length <= entry->byteLength; length++) {
+		data = guarded->place (entry->words, length);
+		result = pfCorpusWalk (data, length, &walked, &inBounds);
+		if (!inBounds) {
+			htFailures++;
+			fprintf (stderr, "%s: view outside the first %u bytes\n", entry->name, (unsigned)length);
+		}
+
+		// Fewer than pHandle, flags and a command is an empty set, not an error
+		if (!entry->expectOK || (length < 3 * sizeof(UInt32)) || ((length & ~3U) == entry->byteLength))
+			continue;
+		if (result == kIOPFNoError) {
+			htFailures++;
+			fprintf (stderr, "%s: first %u bytes walk cleanly\n", entry->name, (unsigned)length);
+		}
+	}
+}
+
+int main (int argc, char **argv)
+{
+	PFGuardedBuffer	guarded (kPFCorpusMaxWords * sizeof(UInt32));
+	UInt32			count, i, good = 0;
+
+	count = pfCorpusLoad ((argc > 1) ? argv[1] : kPFCorpusDefaultDir, corpus, kPFCorpusMaxEntries);
+	HT_CHECK (count > 0);
+
+	for (i = 0; i < count; i++) {
+		testEntry (&corpus[i], &guarded);
+		if (corpus[i].expectOK)
+			good++;
+	}
+
+	// The corpus should keep both kinds of set
+	HT_CHECK (good > 0);
+	HT_CHECK (good < count);
+
+	return htFinish ("TestPFCorpus");
+}
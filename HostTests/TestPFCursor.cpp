@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Checks IOPlatformFunctionCursor: views point into the command data rather than copies, a
+// command list is flattened, byte arrays are found and padding skipped, every malformed
+// length ends the walk with an error instead of a read past the end, and a walk allocates
+// nothing.
+
+#include "HostTest.h"
+#include "AllocCount.h"
+#include "PFBlob.h"
+
+static void testSingleCommand (void)
+{
+	PFBlob						blob;
+	IOPlatformFunctionCursor	cursor (0, 0);
+	IOPFCommandView				view;
+
+	blob.writeReg32 (0x40, 0x11, 0xFFFFFF00);
+	cursor = blob.cursor ();
+
+	HT_CHECK (cursor.next (&view));
+	HT_CHECK_EQ (view.cmd, kCommandWriteReg32);
+	HT_CHECK_EQ (view.paramCount, kCommandWriteReg32Length);
+	HT_CHECK (view.params == &blob.words[3]);		// in place, after pHandle, flags and the opcode
+	HT_CHECK_EQ (view.params[0], 0x40);
+	HT_CHECK_EQ (view.params[2], 0xFFFFFF00);
+	HT_CHECK (view.bytes == NULL);
+	HT_CHECK_EQ (view.byteCount, 0);
+	HT_CHECK (!cursor.next (&view));
+	HT_CHECK_EQ (cursor.getError (), kIOPFNoError);
+}
+
+static void testListIsFlattened (void)
+{
+	static const UInt8			data[5] = { 0xA0, 0xA1, 0xA2, 0xA3, 0xA4 };
+	PFBlob						blob;
+	IOPlatformFunctionCursor	cursor (0, 0);
+	IOPFCommandView				view;
+	UInt32						count;
+
+	// The I2C write's 5 bytes are padded to 2 longwords, the delay after it must still be found
+	blob.list (4).writeReg32 (0x40, 1, 0).writeI2C (data, 5).delay (250).rmwConfig (0x50, 0xFFFF00FF, 0x1100);
+	cursor = blob.cursor ();
+
+	HT_CHECK (cursor.next (&view) && view.cmd == kCommandWriteReg32);
+	HT_CHECK (cursor.next (&view) && view.cmd == kCommandWriteI2C);
+	HT_CHECK_EQ (view.byteCount, 5);
+	HT_CHECK (view.bytes == (const UInt8 *)&blob.words[10]);
+	HT_CHECK (view.bytes && view.bytes[0] == 0xA0 && view.bytes[4] == 0xA4);
+	HT_CHECK (cursor.next (&view) && view.cmd == kCommandDelay);
+	HT_CHECK_EQ (view.params[0], 250);
+	HT_CHECK (cursor.next (&view) && view.cmd == kCommandRMWConfig);
+	HT_CHECK_EQ (view.byteCount, 8);
+	HT_CHECK_EQ (*(const UInt32 *)view.bytes, 0xFFFF00FF);
+	HT_CHECK_EQ (*(const UInt32 *)(view.bytes + 4), 0x1100);
+	HT_CHECK (!cursor.next (&view));
+	HT_CHECK_EQ (cursor.getError (), kIOPFNoError);
+
+	HT_CHECK_EQ (IOPFValidateCommandSet (blob.words, blob.byteLength (), &count), kIOPFNoError);
+	HT_CHECK_EQ (count, 4);
+}
+
+static void testArrayLayouts (void)
+{
+	static const UInt8			mask[3] = { 0xF0, 0x0F, 0xFF }, value[3] = { 0x01, 0x02, 0x03 };
+	PFBlob						blob;
+	IOPlatformFunctionCursor	cursor (0, 0);
+	IOPFCommandView				view;
+
+	blob.list (3).rmwI2C (mask, value, 3, 3);
+	blob.add (kCommandMaskandCompare).add (2).add (0xFFFF1234);		// 2 mask bytes, 2 compare bytes
+	blob.delay (1);
+	cursor = blob.cursor ();
+
+	HT_CHECK (cursor.next (&view) && view.cmd == kCommandRMWI2C);
+	HT_CHECK_EQ (view.byteCount, 6);
+	HT_CHECK (view.bytes && view.bytes[2] == 0xFF && view.bytes[3] == 0x01);
+	HT_CHECK (cursor.next (&view) && view.cmd == kCommandMaskandCompare);
+	HT_CHECK_EQ (view.byteCount, 4);
+	HT_CHECK (cursor.next (&view) && view.cmd == kCommandDelay);
+	HT_CHECK_EQ (cursor.getError (), kIOPFNoError);
+}
+
+static void expectError (const char *what, const PFBlob &blob, UInt32 error, UInt32 goodCommands)
+{
+	UInt32 count;
+
+	HT_CHECK_EQ (IOPFValidateCommandSet (blob.words, blob.byteLength (), &count), error);
+	HT_CHECK_EQ (count, goodCommands);
+	if (htFailures)
+		fprintf (stderr, "  in %s\n", what);
+}
+
+static void testMalformed (void)
+{
+	{ PFBlob b; b.add (kCommandMaxCommand + 1).add (0);
+		expectError ("unknown command", b, kIOPFUnknownCmd, 0); }
+	{ PFBlob b; b.list (2).delay (1).add (kCommandGeneralI2C).add (0);
+		expectError ("general I2C", b, kIOPFUnknownCmd, 1); }
+	{ PFBlob b; b.add (kCommandWriteReg32).add (0x40).add (1);
+		expectError ("truncated fixed parameters", b, kIOPFBadCmdLength, 0); }
+	{ PFBlob b; b.add (kCommandWriteI2C).add (9).add (0);
+		expectError ("byte array past the end", b, kIOPFBadCmdLength, 0); }
+	{ PFBlob b; b.add (kCommandRMWI2C).add (0x40000000).add (0x40000000).add (0).add (0);
+		expectError ("array lengths that overflow", b, kIOPFBadCmdLength, 0); }
+	{ PFBlob b; b.add (kCommandRMWConfig).add (0x50).add (0xFFFFFFFC).add (8).add (4).add (0).add (0);
+		expectError ("array length that wraps", b, kIOPFBadCmdLength, 0); }
+	{ PFBlob b; b.add (kCommandCommandList);
+		expectError ("list without a count", b, kIOPFBadCmdLength, 0); }
+	{ PFBlob b; b.list (3).delay (1).delay (2);
+		expectError ("list longer than its data", b, kIOPFBadCmdLength, 2); }
+	{ PFBlob b; b.count = 2;
+		expectError ("no command", b, kIOPFNoError, 0); }
+	{ PFBlob b; b.list (0).delay (1);
+		expectError ("empty list", b, kIOPFNoError, 0); }
+
+	HT_CHECK_EQ (IOPFValidateCommandSet (NULL, 64, NULL), kIOPFNoError);
+}
+
+static void testWalkDoesNotAllocate (void)
+{
+	static const UInt8			data[7] = { 1, 2, 3, 4, 5, 6, 7 };
+	PFBlob						blob;
+	IOPFCommandView				view;
+	UInt32						n, count = 0;
+
+	blob.list (5).writeReg32 (0x40, 1, 0).writeI2C (data, 7).readConfig (0x50, 4).rmwConfig (0x50, 0xFF, 1).delay (3);
+
+	htAllocations = 0;
+	htAllocCounting = true;
+	for (n = 0; n < 1000; n++) {
+		IOPlatformFunctionCursor cursor (blob.words, blob.byteLength ());
+
+		while (cursor.next (&view))
+			count++;
+	}
+	htAllocCounting = false;
+
+	HT_CHECK_EQ (count, 5000);
+	HT_CHECK_EQ (htAllocations, 0);
+
+	// and the counter does see allocations
+	htAllocCounting = true;
+	delete new IOPlatformFunctionCursor (blob.words, blob.byteLength ());
+	htAllocCounting = false;
+	HT_CHECK_EQ (htAllocations, 1);
+}
+
+int main (void)
+{
+	testSingleCommand ();
+	testListIsFlattened ();
+	testArrayLayouts ();
+	testMalformed ();
+	testWalkDoesNotAllocate ();
+
+	return htFinish ("TestPFCursor");
+}
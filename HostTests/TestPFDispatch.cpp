@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Checks the callPlatformFunction dispatch table helpers in U3PFDispatch.h the way AppleU3
+// uses them: the 12 built-in selectors and a set of on-demand functions entered in order,
+// every key found with its selector, the first entry for a key kept, misses ending at an
+// empty slot, and probe sequences kept short by the half-full sizing.
+
+#include <string.h>
+
+#include "HostTest.h"
+#include "U3PFDispatch.h"
+
+#define kBuiltins		12		// kU3NumBuiltinPF
+#define kMaxKeys		512
+
+typedef struct
+{
+	const void		*key;
+	UInt32			selector;
+} DispatchEntry;
+
+typedef struct
+{
+	DispatchEntry	*table;
+	UInt32			mask;
+} DispatchTable;
+
+static void build (DispatchTable *dt, const void **keys, UInt32 count)
+{
+	UInt32 size = U3PFDispatchSlots (count), i, slot;
+
+	dt->table = (DispatchEntry *) calloc (size, sizeof(DispatchEntry));
+	dt->mask = size - 1;
+
+	// As addPlatformFunctionEntry - a key that is already there is not replaced
+	for (i = 0; i < count; i++) {
+		slot = U3PFDispatchProbe (dt->table, dt->mask, keys[i]);
+		if (!dt->table[slot].key) {
+			dt->table[slot].key = keys[i];
+			dt->table[slot].selector = i;
+		}
+	}
+}
+
+static const DispatchEntry *lookup (const DispatchTable *dt, const void *key)
+{
+	UInt32 slot = U3PFDispatchProbe (dt->table, dt->mask, key);
+
+	return dt->table[slot].key ? &dt->table[slot] : NULL;
+}
+
+static UInt32 probeLength (const DispatchTable *dt, const void *key)
+{
+	UInt32 slot, n = 1;
+
+	for (slot = U3PFHash(key) & dt->mask; dt->table[slot].key && dt->table[slot].key != key; slot = (slot + 1) & dt->mask)
+		n++;
+	return n;
+}
+
+static void testSizing (void)
+{
+	HT_CHECK_EQ (U3PFDispatchSlots (0), 16);
+	HT_CHECK_EQ (U3PFDispatchSlots (8), 16);
+	HT_CHECK_EQ (U3PFDispatchSlots (9), 32);
+	HT_CHECK_EQ (U3PFDispatchSlots (kBuiltins + 40), 128);
+	for (UInt32 n = 0; n < 1000; n++) {
+		UInt32 size = U3PFDispatchSlots (n);
+		HT_CHECK ((size & (size - 1)) == 0);
+		HT_CHECK (size >= 2 * n);
+	}
+}
+
+// keys come from the allocator, like OSSymbols, or are placed a fixed distance apart, which
+// is where a multiplicative hash clusters if it is taken from the wrong bits
+static void testKeys (const char *name, const void **keys, UInt32 count, const void **misses, UInt32 missCount)
+{
+	DispatchTable		dt;
+	const DispatchEntry	*e;
+	UInt32				i, n, worst = 0, total = 0;
+
+	build (&dt, keys, count);
+
+	for (i = 0; i < count; i++) {
+		HT_CHECK ((e = lookup (&dt, keys[i])) != NULL);
+		if (e)
+			HT_CHECK_EQ (e->selector, i);
+		n = probeLength (&dt, keys[i]);
+		total += n;
+		if (n > worst)
+			worst = n;
+	}
+
+	for (i = 0; i < missCount; i++)
+		HT_CHECK (lookup (&dt, misses[i]) == NULL);
+
+	printf ("  %-24s %3u keys in %4u slots, %.2f probes average, %u worst\n", name, count,
+		dt.mask + 1, (double)total / count, worst);
+	HT_CHECK ((double)total / count < 2.0);
+	HT_CHECK (worst <= 16);
+
+	free (dt.table);
+}
+
+static void testFirstEntryWins (void)
+{
+	static char		objects[4][32];
+	const void		*keys[5] = { objects[0], objects[1], objects[2], objects[1], objects[3] };
+	DispatchTable	dt;
+
+	build (&dt, keys, 5);
+	HT_CHECK (lookup (&dt, objects[1]) != NULL && lookup (&dt, objects[1])->selector == 1);
+	HT_CHECK (lookup (&dt, objects[3]) != NULL && lookup (&dt, objects[3])->selector == 4);
+	free (dt.table);
+}
+
+int main (void)
+{
+	static const UInt32	strides[] = { 16, 32, 48, 64, 96, 128, 256 };
+	static char			packed[2 * kMaxKeys * 256];
+	const void			*keys[kMaxKeys], *misses[kMaxKeys];
+	char				name[32];
+	UInt32				i, s;
+
+	testSizing ();
+	testFirstEntryWins ();
+
+	for (i = 0; i < kMaxKeys; i++) {
+		keys[i] = malloc (40);
+		misses[i] = malloc (40);
+	}
+	testKeys ("allocated, typical", keys, kBuiltins + 40, misses, kMaxKeys);
+	testKeys ("allocated, large", keys, kMaxKeys, misses, kMaxKeys);
+
+	// Keys a fixed distance apart, misses in between
+	for (s = 0; s < sizeof(strides) / sizeof(strides[0]); s++) {
+		for (i = 0; i < kMaxKeys; i++) {
+			keys[i] = &packed[2 * i * strides[s]];
+			misses[i] = &packed[(2 * i + 1) * strides[s]];
+		}
+		snprintf (name, sizeof(name), "%u bytes apart", strides[s]);
+		testKeys (name, keys, kBuiltins + 40, misses, kMaxKeys);
+		testKeys (name, keys, kMaxKeys, misses, kMaxKeys);
+	}
+
+	return htFinish ("TestPFDispatch");
+}
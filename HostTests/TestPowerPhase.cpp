@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Checks the power phase merge: buildPowerPhase turns the WriteReg ops of every register-only
+// program into one transaction batch with U3PFOpToRegWrite.  Running the batch must leave the
+// registers and shadows exactly as running the programs one after another does, under a
+// single lock and with fewer fences.
+
+#include <string.h>
+
+#include "HostTest.h"
+#include "SimRegPort.h"
+#include "PFBlob.h"
+#include "U3RegTransaction.h"
+#include "U3PFCompile.h"
+
+#define kMaxOps		64
+
+static void setup (SimRegPort *port, UInt32 *seed)
+{
+	for (UInt32 i = 0; i < kSimRegCount; i++)
+		port->regs[i] = htRandom (seed);
+
+	port->shadowOffset[0] = 0x10;
+	port->shadowValue[0] = port->regs[0x10 >> 2] & ~0x0000000FU;
+	port->shadowVolatile[0] = 0x0000000F;
+	port->shadowOffset[1] = 0x14;
+	port->shadowValue[1] = port->regs[0x14 >> 2];
+}
+
+// Single-op edge cases of the conversion, then whole random phases
+static void testConversion (void)
+{
+	static const UInt32 cases[][2] = {		// keepMask, value
+		{ 0, 0x12345678 }, { 0xFFFF0000, 0x00001234 }, { 0xFFFF0000, 0x00FF1234 },
+		{ 0x0000FFFF, 0xFFFF0000 }, { 0xFFFFFFFE, 0x00000001 }, { 0xFFFFFFFF, 0 }
+	};
+	u3_reg_transaction_t	entry;
+	u3_pf_op_t				op;
+	UInt32					i, reg, seed = 7;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		op.opcode = kU3PFOpWriteReg;
+		op.offset = 0x20;
+		op.keepMask = cases[i][0];
+		op.value = cases[i][1];
+		U3PFOpToRegWrite (&op, &entry);
+
+		HT_CHECK_EQ (entry.op, kU3RegOpWrite);
+		HT_CHECK_EQ (entry.offset, 0x20);
+		for (UInt32 n = 0; n < 1000; n++) {
+			reg = htRandom (&seed);
+			HT_CHECK_EQ ((reg & ~entry.mask) | (entry.value & entry.mask), (reg & op.keepMask) | op.value);
+		}
+	}
+}
+
+static void testMergedPhase (void)
+{
+	UInt32					seed = 0xC0FFEE, iteration, p, i, programCount, opCount, flags, total;
+	u3_pf_op_t				ops[8][kMaxOps];
+	UInt32					counts[8];
+	u3_reg_transaction_t	batch[8 * kMaxOps];
+
+	for (iteration = 0; iteration < 500; iteration++) {
+		SimRegPort	merged, separate;
+
+		setup (&merged, &seed);
+		memcpy (separate.regs, merged.regs, sizeof(merged.regs));
+		memcpy (separate.shadowOffset, merged.shadowOffset, sizeof(merged.shadowOffset));
+		memcpy (separate.shadowValue, merged.shadowValue, sizeof(merged.shadowValue));
+		memcpy (separate.shadowVolatile, merged.shadowVolatile, sizeof(merged.shadowVolatile));
+
+		// A phase of register-only programs, some hitting the shadowed registers
+		programCount = 1 + htRandom (&seed) % 8;
+		for (p = 0; p < programCount; p++) {
+			PFBlob	blob;
+
+			opCount = 1 + htRandom (&seed) % 4;
+			if (opCount > 1)
+				blob.list (opCount);
+			for (i = 0; i < opCount; i++) {
+				UInt32 keep = (htRandom (&seed) % 3 == 0) ? 0xFFFFFFFF : htRandom (&seed);
+				blob.writeReg32 ((htRandom (&seed) % 8) << 2 | 0x10, htRandom (&seed) & ~keep, keep);
+			}
+			counts[p] = U3CompilePFCommands (blob.cursor (), blob.words[0], ops[p], kMaxOps, &flags);
+			HT_CHECK_EQ (counts[p], opCount);
+		}
+
+		// As buildPowerPhase merges them, then as they would run one by one
+		for (p = total = 0; p < programCount; p++)
+			for (i = 0; i < counts[p]; i++)
+				U3PFOpToRegWrite (&ops[p][i], &batch[total++]);
+		HT_CHECK (U3RunRegTransaction (merged, batch, total));
+
+		for (p = 0; p < programCount; p++) {
+			separate.lock (0x3F);
+			for (i = 0; i < counts[p]; i++)
+				U3WriteRegKeepingBits (separate, ops[p][i].offset, ops[p][i].keepMask, ops[p][i].value);
+			separate.unlock (0x3F, 42);
+		}
+
+		HT_CHECK (memcmp (merged.regs, separate.regs, sizeof(merged.regs)) == 0);
+		HT_CHECK (memcmp (merged.shadowValue, separate.shadowValue, sizeof(merged.shadowValue)) == 0);
+		HT_CHECK_EQ (merged.locks, 1);
+		HT_CHECK (merged.fences <= separate.fences);
+	}
+}
+
+int main (void)
+{
+	testConversion ();
+	testMergedPhase ();
+
+	return htFinish ("TestPowerPhase");
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Checks the register access classification: the index finds every classified register and
+// nothing else, the first entry for a repeated offset wins, and a classified read takes its
+// domain lock only for registers with read side effects or that are read-modify-written - a
+// plain register, listed or not, is a single load with no lock at all.
+
+#include "HostTest.h"
+#include "SimRegPort.h"
+#include "U3RegAccess.h"
+
+// Laid out like the Uni-N blocks the real table covers; the offsets are stand-ins
+static const u3_reg_access_t table[] =
+{
+	{ 0x30,		kU3RegAccessReadSideEffects,	kU3LockDomainAPI },		// API exception, clear on read
+	{ 0x34,		kU3RegAccessRMW,				kU3LockDomainAPI },		// fault mask
+	{ 0x40,		kU3RegAccessReadSideEffects,	kU3LockDomainMemCtl },	// MESR
+	{ 0x44,		kU3RegAccessRMW,				kU3LockDomainMemCtl },	// MCCR
+	{ 0x48,		kU3RegAccessPlain,				kU3LockDomainMemCtl },	// MEAR
+	{ 0x80,		kU3RegAccessPlain,				kU3LockDomainDART },
+	{ 0xC0,		kU3RegAccessPlain,				kU3LockDomainHT },
+	{ 0xC4,		kU3RegAccessPlain,				kU3LockDomainHT },
+	{ 0xF0,		kU3RegAccessRMW,				kU3LockDomainToggle },
+	{ 0x40,		kU3RegAccessPlain,				kU3LockDomainMisc }		// repeated, must lose
+};
+
+#define kTableCount		(sizeof(table) / sizeof(table[0]))
+
+static u3_reg_access_t	regIndex[kU3RegAccessSlots];
+
+static void testIndex (void)
+{
+	const u3_reg_access_t	*access;
+	UInt32					i, offset, found = 0;
+
+	for (i = 0; i < kTableCount - 1; i++) {
+		access = U3FindRegAccess (regIndex, table[i].offset);
+		HT_CHECK (access != 0);
+		if (access) {
+			HT_CHECK_EQ (access->flags, table[i].flags);
+			HT_CHECK_EQ (access->domain, table[i].domain);
+		}
+	}
+
+	// The first entry for 0x40 wins over the repeat
+	access = U3FindRegAccess (regIndex, 0x40);
+	HT_CHECK (access && (access->domain == kU3LockDomainMemCtl));
+
+	// Every other offset in the register space is unlisted
+	for (offset = 0; offset < 0x10000; offset += 4)
+		if (U3FindRegAccess (regIndex, offset))
+			found++;
+	HT_CHECK_EQ (found, kTableCount - 1);
+}
+
+static void testPlainReadsTakeNoLock (void)
+{
+	SimRegPort	port;
+	UInt32		offset, i, reads = 0;
+
+	for (offset = 0; offset < kSimRegCount * 4; offset += 4)
+		port.regs[offset >> 2] = 0x1000 + offset;
+
+	for (offset = 0; offset < kSimRegCount * 4; offset += 4) {
+		const u3_reg_access_t *access = U3FindRegAccess (regIndex, offset);
+
+		if (access && (access->flags & kU3RegAccessSerialized))
+			continue;
+		for (i = 0; i < 100; i++) {
+			HT_CHECK_EQ (U3ReadRegClassified (port, regIndex, offset), 0x1000 + offset);
+			reads++;
+		}
+	}
+
+	HT_CHECK (reads > 0);
+	HT_CHECK_EQ (port.loads, reads);
+	HT_CHECK_EQ (port.locks, 0);
+	HT_CHECK_EQ (port.unlocks, 0);
+}
+
+static void testSerializedReadsLockTheirDomain (void)
+{
+	UInt32 i;
+
+	for (i = 0; i < kTableCount - 1; i++) {
+		SimRegPort port;
+
+		if (!(table[i].flags & kU3RegAccessSerialized))
+			continue;
+
+		port.regs[table[i].offset >> 2] = 0xC0DE0000 | i;
+		HT_CHECK_EQ (U3ReadRegClassified (port, regIndex, table[i].offset), 0xC0DE0000 | i);
+		HT_CHECK_EQ (port.locks, 1);
+		HT_CHECK_EQ (port.unlocks, 1);
+		HT_CHECK_EQ (port.lockedMask, 1 << table[i].domain);
+		HT_CHECK_EQ (port.loads, 1);
+	}
+}
+
+int main (void)
+{
+	U3BuildRegAccessIndex (table, kTableCount, regIndex);
+
+	testIndex ();
+	testPlainReadsTakeNoLock ();
+	testSerializedReadsLockTheirDomain ();
+
+	return htFinish ("TestRegAccess");
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Checks the U3RegField accessors against a bit-by-bit reference: shifts derived from the
+// mask, get/set round trips, neighbouring bits left alone and oversized values truncated.
+// TestRegFieldRejects.cpp covers the fields that must not compile.
+
+#include "HostTest.h"
+#include "U3RegField.h"
+
+typedef U3RegField<0x10, 0x0000000F>	LowField;
+typedef U3RegField<0x10, 0x00000F00>	MidField;
+typedef U3RegField<0x10, 0xE0000000>	TopField;
+typedef U3RegField<0x14, 0x80000000>	Bit31Field;
+typedef U3RegField<0x14, 0x00000001>	Bit0Field;
+typedef U3RegField<0x18, 0xFFFFFFFF>	WholeField;
+
+U3_CHECK_REG_FIELD(LowField);
+U3_CHECK_REG_FIELD(MidField);
+U3_CHECK_REG_FIELD(TopField);
+U3_CHECK_REG_FIELD(Bit31Field);
+U3_CHECK_REG_FIELD(WholeField);
+U3_CHECK_REG_FIELD_SHIFT(LowField, 0);
+U3_CHECK_REG_FIELD_SHIFT(MidField, 8);
+U3_CHECK_REG_FIELD_SHIFT(TopField, 29);
+U3_CHECK_REG_FIELD_SHIFT(Bit31Field, 31);
+U3_CHECK_REG_FIELD_SHIFT(WholeField, 0);
+U3_CHECK_REG_FIELDS_DISJOINT(LowField, MidField);
+U3_CHECK_REG_FIELDS_DISJOINT(MidField, TopField);
+U3_CHECK_REG_FIELDS_DISJOINT(Bit31Field, Bit0Field);
+U3_CHECK_REG_FIELDS_DISJOINT(LowField, Bit0Field);		// same bits, different registers
+
+// The field accessors, written out one bit at a time
+static UInt32 referenceGet (UInt32 mask, UInt32 regValue)
+{
+	UInt32 bit, out = 0, outBit = 0;
+
+	for (bit = 0; bit < 32; bit++)
+		if (mask & (1U << bit))
+			out |= ((regValue >> bit) & 1) << outBit++;
+	return out;
+}
+
+static UInt32 referenceSet (UInt32 mask, UInt32 regValue, UInt32 fieldValue)
+{
+	UInt32 bit, inBit = 0;
+
+	for (bit = 0; bit < 32; bit++)
+		if (mask & (1U << bit)) {
+			if (inBit < 32 && ((fieldValue >> inBit) & 1))
+				regValue |= 1U << bit;
+			else
+				regValue &= ~(1U << bit);
+			inBit++;
+		}
+	return regValue;
+}
+
+template <class Field> static void checkField (UInt32 *seed)
+{
+	UInt32 i, regValue, fieldValue, width = referenceGet ((UInt32)Field::mask, 0xFFFFFFFF) + 1;
+
+	// Every value of a narrow field, against a few register backgrounds
+	if (width != 0 && width <= 256)
+		for (fieldValue = 0; fieldValue < width; fieldValue++)
+			for (i = 0; i < 4; i++) {
+				regValue = (i == 0) ? 0 : (i == 1) ? 0xFFFFFFFF : htRandom (seed);
+				HT_CHECK_EQ (U3GetRegField<Field>(U3SetRegField<Field>(regValue, fieldValue)), fieldValue);
+				HT_CHECK_EQ (U3SetRegField<Field>(regValue, fieldValue) & ~(UInt32)Field::mask,
+					regValue & ~(UInt32)Field::mask);
+			}
+
+	for (i = 0; i < 100000; i++) {
+		regValue = htRandom (seed);
+		fieldValue = htRandom (seed);
+		HT_CHECK_EQ (U3GetRegField<Field>(regValue), referenceGet ((UInt32)Field::mask, regValue));
+		HT_CHECK_EQ (U3SetRegField<Field>(regValue, fieldValue),
+			referenceSet ((UInt32)Field::mask, regValue, fieldValue));
+	}
+}
+
+int main (void)
+{
+	UInt32 seed = 0x9E3779B9;
+
+	HT_CHECK_EQ (LowField::offset, 0x10);
+	HT_CHECK_EQ ((UInt32)TopField::mask, 0xE0000000);
+
+	checkField<LowField> (&seed);
+	checkField<MidField> (&seed);
+	checkField<TopField> (&seed);
+	checkField<Bit31Field> (&seed);
+	checkField<Bit0Field> (&seed);
+	checkField<WholeField> (&seed);
+
+	// Values wider than the field are cut to it, not carried into the next field
+	HT_CHECK_EQ (U3SetRegField<LowField>(0, 0x1F), 0x0000000F);
+	HT_CHECK_EQ (U3SetRegField<MidField>(0, 0x1F), 0x00000F00);
+	HT_CHECK_EQ (U3SetRegField<TopField>(0, 0xF), 0xE0000000);
+	HT_CHECK_EQ (U3SetRegField<MidField>(U3SetRegField<LowField>(0, 0xA), 0x5), 0x0000050A);
+
+	return htFinish ("TestRegField");
+}
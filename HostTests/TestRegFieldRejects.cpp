@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Field descriptors that must be rejected at compile time.  make check compiles this file once
+// per REJECT case and fails if any of them compiles; REJECT=0 is the control that must build.
+
+#include "HostTest.h"
+#include "U3RegField.h"
+
+typedef U3RegField<0x20, 0x000000F0>	GoodField;
+U3_CHECK_REG_FIELD(GoodField);
+
+#if REJECT == 1
+typedef U3RegField<0x20, 0x00000000>	EmptyField;
+U3_CHECK_REG_FIELD(EmptyField);
+#elif REJECT == 2
+typedef U3RegField<0x20, 0x00000F0F>	SplitField;
+U3_CHECK_REG_FIELD(SplitField);
+#elif REJECT == 3
+typedef U3RegField<0x22, 0x0000000F>	MisalignedField;
+U3_CHECK_REG_FIELD(MisalignedField);
+#elif REJECT == 4
+typedef U3RegField<0x20, 0x00000180>	OverlappingField;
+U3_CHECK_REG_FIELDS_DISJOINT(GoodField, OverlappingField);
+#elif REJECT == 5
+U3_CHECK_REG_FIELD_SHIFT(GoodField, 3);
+#endif
+
+int main (void)
+{
+	return 0;
+}
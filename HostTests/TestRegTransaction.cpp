@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+// Checks U3RunRegTransaction, the engine behind AppleU3::safeRegTransaction: the whole list
+// runs under one lock of exactly the domains it spans, stores are fenced only ahead of a load
+// and once at the end, driver-owned registers are modified from their shadow, and the result
+// matches applying the entries one at a time.
+
+#include <string.h>
+
+#include "HostTest.h"
+#include "SimRegPort.h"
+#include "U3RegTransaction.h"
+
+static u3_reg_transaction_t entry (UInt32 op, UInt32 offset, UInt32 mask, UInt32 value)
+{
+	u3_reg_transaction_t t = { op, offset, mask, value };
+	return t;
+}
+
+static void testRejectsBadLists (void)
+{
+	SimRegPort				port;
+	u3_reg_transaction_t	list[2];
+
+	HT_CHECK (!U3RunRegTransaction (port, (u3_reg_transaction_t *)0, 1));
+	list[0] = entry (kU3RegOpWrite, 0x10, 0xFFFFFFFF, 1);
+	HT_CHECK (!U3RunRegTransaction (port, list, 0));
+
+	// An unknown op anywhere in the list fails it before anything is touched
+	list[1] = entry (7, 0x14, 0xFFFFFFFF, 2);
+	HT_CHECK (!U3RunRegTransaction (port, list, 2));
+	HT_CHECK_EQ (port.locks, 0);
+	HT_CHECK_EQ (port.stores, 0);
+	HT_CHECK_EQ (port.regs[0x10 >> 2], 0);
+}
+
+static void testLocksSpannedDomainsOnce (void)
+{
+	SimRegPort				port;
+	u3_reg_transaction_t	list[4];
+
+	list[0] = entry (kU3RegOpWrite, 0x04, 0xFFFFFFFF, 1);	// domain 0
+	list[1] = entry (kU3RegOpRead, 0xC0, 0, 0);				// domain 3
+	list[2] = entry (kU3RegOpWrite, 0x08, 0x0F, 2);			// domain 0
+	list[3] = entry (kU3RegOpRead, 0xC4, 0, 0);				// domain 3
+
+	HT_CHECK (U3RunRegTransaction (port, list, 4));
+	HT_CHECK_EQ (port.locks, 1);
+	HT_CHECK_EQ (port.unlocks, 1);
+	HT_CHECK_EQ (port.lockedMask, (1 << 0) | (1 << 3));
+}
+
+static void testFencesOnlyWhereOrderingNeedsThem (void)
+{
+	SimRegPort				port;
+	u3_reg_transaction_t	list[5];
+
+	// Two plain writes go out back to back, the read behind them is fenced, the RMW's own
+	// read needs no fence, and the last read is fenced behind the RMW's store
+	list[0] = entry (kU3RegOpWrite, 0x00, 0xFFFFFFFF, 1);
+	list[1] = entry (kU3RegOpWrite, 0x04, 0xFFFFFFFF, 2);
+	list[2] = entry (kU3RegOpRead, 0x08, 0, 0);
+	list[3] = entry (kU3RegOpWrite, 0x0C, 0x00FF, 3);
+	list[4] = entry (kU3RegOpRead, 0x10, 0, 0);
+
+	HT_CHECK (U3RunRegTransaction (port, list, 5));
+	HT_CHECK (strcmp (port.log, "SSFLLSFL") == 0);
+
+	// Ending on a store fences once at the end
+	port.clearCounts ();
+	HT_CHECK (U3RunRegTransaction (port, list, 2));
+	HT_CHECK (strcmp (port.log, "SSF") == 0);
+}
+
+static void testFullMaskSkipsTheRead (void)
+{
+	SimRegPort				port;
+	u3_reg_transaction_t	list[1];
+
+	port.regs[0x20 >> 2] = 0x12345678;
+	list[0] = entry (kU3RegOpWrite, 0x20, 0xFFFFFFFF, 0xCAFEF00D);
+
+	HT_CHECK (U3RunRegTransaction (port, list, 1));
+	HT_CHECK_EQ (port.loads, 0);
+	HT_CHECK_EQ (port.regs[0x20 >> 2], 0xCAFEF00D);
+}
+
+static void testShadowedWritesUseTheShadow (void)
+{
+	SimRegPort				port;
+	u3_reg_transaction_t	list[2];
+
+	port.shadowOffset[0] = 0x30;
+	port.shadowVolatile[0] = 0x80000000;
+	port.shadowValue[0] = 0x0000AA00;
+	port.regs[0x30 >> 2] = 0x8000AA00;	// hardware has set a volatile bit
+
+	list[0] = entry (kU3RegOpWrite, 0x30, 0x000000FF, 0x00000055);
+	list[1] = entry (kU3RegOpRead, 0x30, 0, 0);
+
+	HT_CHECK (U3RunRegTransaction (port, list, 2));
+	HT_CHECK (strcmp (port.log, "SFL") == 0);
+	HT_CHECK_EQ (port.regs[0x30 >> 2], 0x0000AA55);
+	HT_CHECK_EQ (port.shadowValue[0], 0x0000AA55);
+	HT_CHECK_EQ (list[1].value, 0x0000AA55);
+}
+
+// Random lists against a reference that applies each entry on its own
+static void testMatchesEntryByEntry (void)
+{
+	UInt32					seed = 0x2545F491, iteration, i, count;
+	u3_reg_transaction_t	list[16];
+	UInt32					model[kSimRegCount], expectedReads[16];
+
+	for (iteration = 0; iteration < 2000; iteration++) {
+		SimRegPort port;
+
+		for (i = 0; i < kSimRegCount; i++)
+			port.regs[i] = model[i] = htRandom (&seed);
+
+		count = 1 + (htRandom (&seed) % 16);
+		for (i = 0; i < count; i++) {
+			UInt32 offset = (htRandom (&seed) % 8) << 2;		// few registers, so entries collide
+			UInt32 mask = (htRandom (&seed) & 1) ? 0xFFFFFFFF : htRandom (&seed);
+
+			list[i] = entry (htRandom (&seed) & 1, offset, mask, htRandom (&seed));
+			if (list[i].op == kU3RegOpRead)
+				expectedReads[i] = model[offset >> 2];
+			else
+				model[offset >> 2] = (model[offset >> 2] & ~mask) | (list[i].value & mask);
+		}
+
+		HT_CHECK (U3RunRegTransaction (port, list, count));
+		HT_CHECK (memcmp (port.regs, model, sizeof(model)) == 0);
+		for (i = 0; i < count; i++)
+			if (list[i].op == kU3RegOpRead)
+				HT_CHECK_EQ (list[i].value, expectedReads[i]);
+		HT_CHECK_EQ (port.locks, 1);
+	}
+}
+
+int main (void)
+{
+	testRejectsBadLists ();
+	testLocksSpannedDomainsOnce ();
+	testFencesOnlyWhereOrderingNeedsThem ();
+	testFullMaskSkipsTheRead ();
+	testShadowedWritesUseTheShadow ();
+	testMatchesEntryByEntry ();
+
+	return htFinish ("TestRegTransaction");
+}
@@ -0,0 +1,21 @@
+/*
+ * Host stand-in for the kernel's <libkern/OSTypes.h>, so the kext headers that only need
+ * the fixed-size types build with the system compiler.
+ */
+
+#ifndef _HOSTTESTS_OSTYPES_H
+#define _HOSTTESTS_OSTYPES_H
+
+#include <stdint.h>
+
+typedef uint8_t		UInt8;
+typedef uint16_t	UInt16;
+typedef uint32_t	UInt32;
+typedef uint64_t	UInt64;
+typedef int8_t		SInt8;
+typedef int16_t		SInt16;
+typedef int32_t		SInt32;
+typedef int64_t		SInt64;
+typedef UInt8		Boolean;
+
+#endif /* _HOSTTESTS_OSTYPES_H */
@@ -51,6 +51,10 @@
 
 #ifdef IOPFDEBUG
 #	ifdef PFPARSE
+#		ifdef __linux__
+// glibc declares its own dprintf(int, const char *, ...) in stdio.h
+#			define dprintf pfparse_dprintf
+#		endif
 __BEGIN_DECLS
 		void dprintf(const char *fmt, ...);
 __END_DECLS
@@ -171,6 +175,186 @@ enum {
 	kIOPFBadCmdLength				= 2
 };
 
+// One command, as yielded by IOPlatformFunctionCursor
+struct IOPFCommandView {
+	UInt32			cmd;			// kCommand* opcode
+	UInt32			paramCount;		// longwords of fixed parameters at params
+	const UInt32	*params;
+	const UInt8		*bytes;			// byte arrays of a variable-length command, else NULL
+	UInt32			byteCount;
+};
+
+/*!
+    @class IOPlatformFunctionCursor
+    @abstract A stack-allocatable, read-only walk over the commands of a single command set.
+    @discussion
+    Unlike IOPlatformFunctionIterator it allocates nothing and copies nothing: each step yields an
+    IOPFCommandView pointing into the command data, and a command list is flattened into its
+    subcommands.  The data is laid out as in a platform-do property - pHandle, flags, then one
+    command or a command list.  Every length is checked against the data remaining, so a
+    malformed command ends the walk with kIOPFBadCmdLength rather than reading past the end.
+    Variable-length commands are followed by their byte arrays, packed and padded as a whole
+    to a longword boundary.
+*/
+class IOPlatformFunctionCursor
+{
+private:
+	const UInt32	*cmdPtr;
+	UInt32			lenRemaining;		// longwords
+	UInt32			listRemaining;		// subcommands left, or 1 for a single command
+	UInt32			error;
+
+	// Longwords of fixed parameters for cmd, 0 with error set for an unknown command
+	static UInt32 fixedLength (UInt32 cmd, UInt32 *result)
+	{
+		static const UInt8 lengths[kCommandMaxCommand + 1] = {
+			kCommandCommandListLength, kCommandWriteGPIOLength, kCommandReadGPIOLength,
+			kCommandWriteReg32Length, kCommandReadReg32Length, kCommandWriteReg16Length,
+			kCommandReadReg16Length, kCommandWriteReg8Length, kCommandReadReg8Length,
+			kCommandDelayLength, kCommandWaitReg32Length, kCommandWaitReg16Length,
+			kCommandWaitReg8Length, kCommandReadI2CLength, kCommandWriteI2CLength,
+			kCommandRMWI2CLength, kCommandGeneralI2CLength, kCommandShiftBytesRightLength,
+			kCommandShiftBytesLeftLength, kCommandReadConfigLength, kCommandWriteConfigLength,
+			kCommandRMWConfigLength, kCommandReadI2CSubAddrLength, kCommandWriteI2CSubAddrLength,
+			kCommandI2CModeLength, kCommandRMWI2CSubAddrLength, kCommandReadReg32MaskShRtXORLength,
+			kCommandReadReg16MaskShRtXORLength, kCommandReadReg8MaskShRtXORLength,
+			kCommandWriteReg32ShLtMaskLength, kCommandWriteReg16ShLtMaskLength,
+			kCommandWriteReg8ShLtMaskLength, kCommandMaskandCompareLength
+		};
+
+		// General I2C has no defined layout, so it can't be walked over
+		if ((cmd > kCommandMaxCommand) || (cmd == kCommandGeneralI2C)) {
+			*result = kIOPFUnknownCmd;
+			return 0;
+		}
+
+		return lengths[cmd];
+	}
+
+	// Bytes in the arrays following a variable-length command's fixed parameters
+	static UInt32 arrayBytes (UInt32 cmd, const UInt32 *params, bool *overflow)
+	{
+		UInt32 a = 0, b = 0;
+
+		switch (cmd) {
+			case kCommandWriteI2C:			a = params[0];					break;	// count
+			case kCommandRMWI2C:			a = params[0]; b = params[1];	break;	// mask, value
+			case kCommandRMWConfig:			a = params[1]; b = params[2];	break;	// offset, mask, value
+			case kCommandWriteI2CSubAddr:	a = params[1];					break;	// subaddr, count
+			case kCommandRMWI2CSubAddr:		a = params[1]; b = params[2];	break;	// subaddr, mask, value
+			case kCommandMaskandCompare:	a = b = params[0];				break;	// mask, compare
+			default:						return 0;
+		}
+
+		*overflow = (a > 0x3FFFFFFF) || (b > 0x3FFFFFFF);
+		return a + b;
+	}
+
+public:
+	IOPlatformFunctionCursor (const UInt32 *data, UInt32 byteLength)
+		{ reset (data, byteLength); }
+
+	void reset (const UInt32 *data, UInt32 byteLength)
+	{
+		cmdPtr = data;
+		lenRemaining = data ? byteLength / sizeof(UInt32) : 0;
+		listRemaining = 0;
+		error = kIOPFNoError;
+
+		// Skip pHandle and flags, then open the command list if there is one
+		if (lenRemaining < 3) {
+			lenRemaining = 0;
+			return;
+		}
+		cmdPtr += 2;
+		lenRemaining -= 2;
+
+		if (*cmdPtr == kCommandCommandList) {
+			if (lenRemaining < 1 + kCommandCommandListLength) {
+				error = kIOPFBadCmdLength;
+				lenRemaining = 0;
+				return;
+			}
+			listRemaining = cmdPtr[1];
+			cmdPtr += 1 + kCommandCommandListLength;
+			lenRemaining -= 1 + kCommandCommandListLength;
+		} else
+			listRemaining = 1;
+	}
+
+	// kIOPFNoError unless the walk was ended by a malformed command
+	UInt32 getError () const { return error; }
+
+	/*!
+        @function next
+        @abstract Returns the next command in view, or false at the end of the set or on error.
+	*/
+	bool next (IOPFCommandView *view)
+	{
+		UInt32	fixed, bytes, total;
+		bool	overflow = false;
+
+		if (!listRemaining || (error != kIOPFNoError))
+			return false;
+
+		// A command list that claims more subcommands than the data holds
+		if (!lenRemaining) {
+			error = kIOPFBadCmdLength;
+			return false;
+		}
+
+		view->cmd = cmdPtr[0];
+		fixed = fixedLength (view->cmd, &error);
+		if ((error != kIOPFNoError) || (1 + fixed > lenRemaining)) {
+			if (error == kIOPFNoError)
+				error = kIOPFBadCmdLength;
+			return false;
+		}
+
+		bytes = arrayBytes (view->cmd, cmdPtr + 1, &overflow);
+		total = 1 + fixed + ((bytes + 3) / sizeof(UInt32));
+		if (overflow || (total > lenRemaining)) {
+			error = kIOPFBadCmdLength;
+			return false;
+		}
+
+		view->paramCount = fixed;
+		view->params = cmdPtr + 1;
+		view->bytes = bytes ? (const UInt8 *)(cmdPtr + 1 + fixed) : NULL;
+		view->byteCount = bytes;
+
+		cmdPtr += total;
+		lenRemaining -= total;
+		listRemaining--;
+
+		return true;
+	}
+};
+
+/*!
+    @function IOPFValidateCommandSet
+    @abstract Walks a whole command set and reports whether every command in it is well formed.
+    @param data The command set, laid out as in a platform-do property
+    @param byteLength Length of data in bytes
+    @param commandCount If not NULL, returns the number of commands walked (subcommands, for a list)
+    @result kIOPFNoError, or the error that ended the walk.
+    @discussion Available with PFPARSE too, so a parser tool can reject data the scan functions would overrun.
+*/
+static inline UInt32 IOPFValidateCommandSet (const UInt32 *data, UInt32 byteLength, UInt32 *commandCount)
+{
+	IOPlatformFunctionCursor	cursor (data, byteLength);
+	IOPFCommandView				view;
+	UInt32						count = 0;
+
+	while (cursor.next (&view))
+		count++;
+
+	if (commandCount)
+		*commandCount = count;
+
+	return cursor.getError();
+}
+
 #ifndef PFPARSE
 #define mypfobject this
 /*!
@@ -266,6 +450,14 @@ public:
         @result Returns the internal value as an 16-bit value.
     */
     virtual IOPlatformFunctionIterator *getCommandIterator();
+
+    /*!
+        @function getCommandCursor
+        @abstract A member function which returns a cursor over the command data.  Unlike getCommandIterator it allocates nothing, see IOPlatformFunctionCursor.
+        @result Returns the cursor by value, positioned at the first command.
+    */
+    IOPlatformFunctionCursor getCommandCursor() const
+		{ return IOPlatformFunctionCursor (platformFunctionPtr, platformFunctionDataLen); }
     /*!
         @function publishPlatformFunction
         @abstract A member function which publishes the platform function in the IORegistry
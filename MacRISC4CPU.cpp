@@ -43,6 +43,7 @@ __END_DECLS
 #include <IOKit/pwr_mgt/RootDomain.h>
 
 #include "MacRISC4CPU.h"
+#include "U3.h"
 
 #define kMacRISC_GPIO_DIRECTION_BIT	2
 
@@ -135,15 +136,15 @@ bool MacRISC4CPU::start(IOService *provider)
     keyLargo_turnOffIO = OSSymbol::withCString("keyLargo_turnOffIO");
     keyLargo_writeRegUInt8 = OSSymbol::withCString("keyLargo_writeRegUInt8");
     keyLargo_setPowerSupply = OSSymbol::withCString("setPowerSupply");
-    UniNSetPowerState = OSSymbol::withCString("UniNSetPowerState");
-    UniNPrepareForSleep = OSSymbol::withCString("UniNPrepareForSleep");
+    uniN_setupUATAforSleep = OSSymbol::withCString("setupUATAforSleep");
+    pmu_setSpeedNow = OSSymbol::withCString("setSpeedNow");
+    pmu_sleepNow = OSSymbol::withCString("sleepNow");
     i2c_openI2CBus = OSSymbol::withCString("openI2CBus");
     i2c_closeI2CBus = OSSymbol::withCString("closeI2CBus");
     i2c_setCombinedMode = OSSymbol::withCString("setCombinedMode");
     i2c_setStandardSubMode = OSSymbol::withCString("setStandardSubMode");
     i2c_readI2CBus = OSSymbol::withCString("readI2CBus");
     i2c_writeI2CBus = OSSymbol::withCString("writeI2CBus");
-	u3APIPhyDisableProcessor1 = OSSymbol::withCString("u3APIPhyDisableProcessor1");
     
     macRISC4PE = OSDynamicCast(MacRISC4PE, getPlatform());
     if (macRISC4PE == 0) return false;
@@ -363,14 +364,15 @@ bool MacRISC4CPU::start(IOService *provider)
 
     registerService();
 
-	if (!(uniN = waitForService(serviceMatching("AppleU3")))) return false;
+	// Uni-N power management is called directly through AppleU3's typed interface
+	if (!(uniN = OSDynamicCast (AppleU3, waitForService(serviceMatching("AppleU3"))))) return false;
 	/*
 	 * If numCPUs is one, disable *any* second processor that might be present because it could
 	 * be running and stealing cycles on the bus [3249029].  This also fixes a hang when 
 	 * boot-args cpus=1 is set [3273619]  
 	 */
 	if (numCPUs == 1) 
-		uniN->callPlatformFunction (u3APIPhyDisableProcessor1, false, (void *)0, (void *)0, (void *)0, (void *)0);
+		uniN->u3APIPhyDisableProcessor1 ();
 
 	// We have to get a pointer to the timebase driver now -- when we're syncing timebase, we'll be at
 	// interrupt context and can't go looking for drivers
@@ -468,7 +470,7 @@ bool MacRISC4CPU::start(IOService *provider)
 
 	// Some systems require special handling of Ultra-ATA at sleep.
 	// Call UniN to prepare for that, if necessary
-	uniN->callPlatformFunction ("setupUATAforSleep", false, (void *)0, (void *)0, (void *)0, (void *)0);
+	uniN->callPlatformFunction (uniN_setupUATAforSleep, false, (void *)0, (void *)0, (void *)0, (void *)0);
 
 	if (cpusRegEntry) cpusRegEntry->release();
 	if (cpu0RegEntry) cpu0RegEntry->release();
@@ -485,8 +487,7 @@ void MacRISC4CPU::initCPU(bool boot)
 
     if (!boot && bootCPU) {
 		// Tell Uni-N to enter normal mode.
-		uniN->callPlatformFunction (UniNSetPowerState, false, (void *)kUniNNormal,
-			(void *)0, (void *)0, (void *)0);
+		uniN->uniNSetPowerState (kUniNNormal);
     
 		/*
 		* If numCPUs is one, disable *any* second processor that might be present because it could
@@ -495,7 +496,7 @@ void MacRISC4CPU::initCPU(bool boot)
 		* to cover the wake from sleep case.
 		*/
 		if (numCPUs == 1) 
-			uniN->callPlatformFunction (u3APIPhyDisableProcessor1, false, (void *)0, (void *)0, (void *)0, (void *)0);
+			uniN->u3APIPhyDisableProcessor1 ();
 		
         if (!processorSpeedChange) {
 			// Notify our pci children to restore their state
@@ -505,6 +506,9 @@ void MacRISC4CPU::initCPU(bool boot)
 					pciDriver->setDevicePowerState (NULL, 3);
 
 			keyLargo->callPlatformFunction(keyLargo_restoreRegisterState, false, 0, 0, 0, 0);
+
+			// Now the bridges are back, Uni-N can run the wake functions that go through them
+			uniN->uniNWakeComplete ();
 	
 			// Enables the interrupts for this CPU.
 			if (macRISC4PE->getMachineType() == kMacRISC4TypePowerMac) {
@@ -547,20 +551,24 @@ void MacRISC4CPU::quiesceCPU(void)
 {
     if (bootCPU)
     {
+		// Nothing powers down for a speed change, so U3 skips its sleep and wake functions
+		if (processorSpeedChange)
+			uniN->uniNBeginSpeedChange ();
+
         // Have U3 save state
-		uniN->callPlatformFunction (UniNSetPowerState, false, (void *)(kUniNSave),
-			(void *)0, (void *)0, (void *)0);
+		uniN->uniNSetPowerState (kUniNSave);
 
 		if (!gPHibernateState || !*gPHibernateState) {
 			// Tell U3 to enter sleep mode if not hibernating
 			// For U3, this has to be done before telling the PMU to start going to sleep
-			uniN->callPlatformFunction (UniNSetPowerState, false, (void *)(kUniNSleep),
-				(void *)0, (void *)0, (void *)0);
+			uniN->uniNSetPowerState (kUniNSleep);
         }
 
         if (processorSpeedChange) {
-            // Send PMU command to speed the system
-            pmu->callPlatformFunction("setSpeedNow", false, (void *)currentProcessorSpeed, 0, 0, 0);
+			// Let U3 retune before slowing down - it retunes after speeding up from initCPU's
+			// kUniNNormal - then send PMU command to change the system speed
+			uniN->uniNSetBusSpeed (currentProcessorSpeed);
+            pmu->callPlatformFunction(pmu_setSpeedNow, false, (void *)currentProcessorSpeed, 0, 0, 0);
         } else {
 			/*
 			 * Send PMU command to shutdown system before io is turned off
@@ -569,7 +577,7 @@ void MacRISC4CPU::quiesceCPU(void)
 			 * the cpu, so unnecessary delays, like kprints must be avoided.
 			 */
 			if (!gPHibernateState || !*gPHibernateState)
-				pmu->callPlatformFunction("sleepNow", false, 0, 0, 0, 0);
+				pmu->callPlatformFunction(pmu_sleepNow, false, 0, 0, 0, 0);
 	
 			// Disables the interrupts for this CPU.
 			if (!haveSleptMPIC && (macRISC4PE->getMachineType() == kMacRISC4TypePowerMac))
@@ -688,8 +696,7 @@ void MacRISC4CPU::haltCPU(void)
 				gPHibernateState = (UInt32 *) data->getBytesNoCopy();
 		}
         
-		uniN->callPlatformFunction (UniNPrepareForSleep, false, 
-			(void *)0, (void *)0, (void *)0, (void *)0);
+		uniN->prepareForSleep ();
 		// Notify our pci children to save their state
 		if (!topLevelPCIBridgeCount) {
 			// First build list of top level bridges - only need to do once as these don't change
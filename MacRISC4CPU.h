@@ -36,6 +36,7 @@
 
 class MacRISC4PE;
 class MacRISC4CPUInterruptController;
+class AppleU3;
 
 // data structure to hold platform-specific timebase sync parameters
 typedef struct
@@ -63,7 +64,7 @@ private:
     bool				haveSleptMPIC;
     UInt32				l2crValue;
     MacRISC4PE			*macRISC4PE;
-	IOService			*uniN;
+	AppleU3				*uniN;
 	IOService			*ioPPlugin;
 	OSDictionary		*ioPPluginDict;
     UInt32				numCPUs;
@@ -94,8 +95,9 @@ private:
     const OSSymbol 		*keyLargo_turnOffIO;
     const OSSymbol 		*keyLargo_writeRegUInt8;
     const OSSymbol 		*keyLargo_setPowerSupply;
-    const OSSymbol 		*UniNSetPowerState;
-    const OSSymbol 		*UniNPrepareForSleep;
+    const OSSymbol 		*uniN_setupUATAforSleep;
+    const OSSymbol 		*pmu_setSpeedNow;
+    const OSSymbol 		*pmu_sleepNow;
 
     const OSSymbol 		*i2c_openI2CBus;
     const OSSymbol 		*i2c_closeI2CBus;
@@ -103,7 +105,6 @@ private:
 	const OSSymbol 		*i2c_setStandardSubMode;
     const OSSymbol 		*i2c_readI2CBus;
     const OSSymbol 		*i2c_writeI2CBus;
-    const OSSymbol 		*u3APIPhyDisableProcessor1;
 
 	static	void			sEnableCPUTimeBase( cpu_id_t self, boolean_t enable );
 
@@ -38,6 +38,7 @@ __END_DECLS
 
 #include <IOKit/IODeviceTreeSupport.h>
 #include <IOKit/IOKitKeys.h>
+#include <IOKit/IOUserClient.h>
 #include "MacRISC4PE.h"
 //#include <IOKit/pci/IOPCIDevice.h>
 
@@ -62,6 +63,29 @@ extern char *gIOMacRISC4PMTree;
 
 OSDefineMetaClassAndStructors(MacRISC4PE, ApplePlatformExpert);
 
+// callPlatformFunction selectors, for statistics
+enum
+{
+	kMacRISC4PFGetDefaultBusSpeeds = 0,
+	kMacRISC4PFPlatformIsPortable,
+	kMacRISC4PFSetSleepSupported,
+	kMacRISC4PFSuperclass,				// passed on to ApplePlatformExpert
+	kMacRISC4NumPF
+};
+
+// Selectors we answer in callPlatformFunction, interned once in start so that every call,
+// including the ones we pass on, is decided with pointer compares
+static const OSSymbol *gPlatformIsPortableKey;
+static const OSSymbol *gIOPMSetSleepSupportedKey;
+
+static const char *gMacRISC4PFNames[kMacRISC4NumPF] =
+{
+	"GetDefaultBusSpeeds",
+	"PlatformIsPortable",
+	"IOPMSetSleepSupported",
+	"ApplePlatformExpert"
+};
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 bool MacRISC4PE::start(IOService *provider)
@@ -74,12 +98,25 @@ bool MacRISC4PE::start(IOService *provider)
 							*powerMgtEntry,
 							* aCPURegEntry;
     UInt32			   		*primInfo;
-	const OSSymbol			*nameValueSymbol;
+	const OSSymbol			*nameValueSymbol, *pfName;
 	const OSData			*nameValueData;
 	OSDictionary			*pluginDict, *platFuncDict;
 	bool					result, spuNeedsRamFix;
+	UInt32					i;
 	
 	kprintf ("MacRISC4PE::start - entered\n");
+
+	gPlatformIsPortableKey = OSSymbol::withCString ("PlatformIsPortable");
+	gIOPMSetSleepSupportedKey = OSSymbol::withCString ("IOPMSetSleepSupported");
+
+	// Statistics for callPlatformFunction, published through setProperties
+	if ((pfStats = MacRISC4PFStats::withSelectorCount (kMacRISC4NumPF)) != NULL)
+		for (i = 0; i < kMacRISC4NumPF; i++)
+			if ((pfName = OSSymbol::withCString (gMacRISC4PFNames[i])) != NULL)
+			{
+				pfStats->setSelectorName (i, pfName);
+				pfName->release();
+			}
 	
     setChipSetType(kChipSetTypeCore2001);
 	
@@ -404,6 +441,14 @@ bool MacRISC4PE::start(IOService *provider)
     return result;
 }
 
+void MacRISC4PE::free( void )
+{
+	if (pfStats)
+		pfStats->release();
+
+	super::free();
+}
+
 IORegistryEntry * MacRISC4PE::retrievePowerMgtEntry (void)
 {
     IORegistryEntry *     theEntry = 0;
@@ -675,22 +720,52 @@ IOReturn MacRISC4PE::callPlatformFunction(const OSSymbol *functionName,
 					void *param1, void *param2,
 					void *param3, void *param4)
 {
+	IOReturn	result;
+	UInt32		selector;
+	UInt64		startTime;
+
+	startTime = mach_absolute_time();
+
     if (functionName == gGetDefaultBusSpeedsKey)
     {
         getDefaultBusSpeeds((long *)param1, (unsigned long **)param2);
-        return kIOReturnSuccess;
+		selector = kMacRISC4PFGetDefaultBusSpeeds;
+        result = kIOReturnSuccess;
     }
-  
-    if (functionName->isEqualTo("PlatformIsPortable")) {
+    else if (functionName == gPlatformIsPortableKey) {
 		*(bool *) param1 = isPortable;
-        return kIOReturnSuccess;
+		selector = kMacRISC4PFPlatformIsPortable;
+        result = kIOReturnSuccess;
     }
-    
-    if (functionName->isEqualTo("IOPMSetSleepSupported")) {
-		return slotsMacRISC4->determineSleepSupport ();
+    else if (functionName == gIOPMSetSleepSupportedKey) {
+		selector = kMacRISC4PFSetSleepSupported;
+		result = slotsMacRISC4->determineSleepSupport ();
     }
-    
-    return super::callPlatformFunction(functionName, waitForFunction, param1, param2, param3, param4);
+    else {
+		selector = kMacRISC4PFSuperclass;
+		result = super::callPlatformFunction(functionName, waitForFunction, param1, param2, param3, param4);
+	}
+
+	if (pfStats)
+		pfStats->record (selector, mach_absolute_time() - startTime, result != kIOReturnSuccess);
+
+	return result;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+IOReturn MacRISC4PE::setProperties( OSObject *properties )
+{
+	IOReturn result;
+
+	// Resetting the counters and taking snapshots is for administrators only
+	if (IOUserClient::clientHasPrivilege (current_task(), kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+		return kIOReturnNotPrivileged;
+
+	if (pfStats && ((result = pfStats->handleSetProperties (this, properties)) != kIOReturnUnsupported))
+		return result;
+
+	return super::setProperties (properties);
 }
 
 void MacRISC4PE::getDefaultBusSpeeds(long *numSpeeds, unsigned long **speedList)
@@ -66,6 +66,7 @@ private:
 							cannotSleep;
 	IOService				*ioPPluginNub;
 	IOService				*plFuncNub;
+	MacRISC4PFStats			*pfStats;			// per-selector callPlatformFunction statistics
 
     void getDefaultBusSpeeds(long *numSpeeds, unsigned long **speedList);
 	//IOReturn instantiatePlatformFunctions (IOService *nub, OSArray **pfArray);
@@ -76,10 +77,12 @@ private:
 
 public:
     virtual bool start(IOService *provider);
+    virtual void free( void );
     virtual bool platformAdjustService(IOService *service);
     virtual IOReturn callPlatformFunction(const OSSymbol *functionName,
 					bool waitForFunction, void *param1, void *param2,
                     void *param3, void *param4);
+	virtual IOReturn setProperties( OSObject *properties );
 };
 
 #endif // _IOKIT_MACRISC4PE_H
\ No newline at end of file
@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+#include <IOKit/IOLib.h>
+#include <libkern/OSAtomic.h>
+#include <libkern/c++/OSNumber.h>
+
+__BEGIN_DECLS
+#include <kern/cpu_number.h>
+__END_DECLS
+
+#include "MacRISC4PFStats.h"
+
+#define super OSObject
+OSDefineMetaClassAndStructors(MacRISC4PFStats, OSObject)
+
+// **********************************************************************************
+// withSelectorCount
+//
+// **********************************************************************************
+MacRISC4PFStats *MacRISC4PFStats::withSelectorCount( UInt32 count )
+{
+	MacRISC4PFStats *me = new MacRISC4PFStats;
+
+	if (me && !me->initWithSelectorCount (count))
+	{
+		me->release();
+		me = NULL;
+	}
+
+	return me;
+}
+
+// **********************************************************************************
+// initWithSelectorCount
+//
+// **********************************************************************************
+bool MacRISC4PFStats::initWithSelectorCount( UInt32 count )
+{
+	UInt32 cpu;
+
+	if (!super::init() || (count == 0))
+		return false;
+
+	selectorCount = count;
+
+	selectorNames = (const OSSymbol **) IOMalloc( count * sizeof(const OSSymbol *) );
+	if (!selectorNames)
+		return false;
+	bzero (selectorNames, count * sizeof(const OSSymbol *));
+
+	// Separate allocations keep each CPU's counters off the other CPUs' cache lines
+	for (cpu = 0; cpu < kPFStatsMaxCPUs; cpu++)
+	{
+		cpuStats[cpu] = (pf_selector_stats_t *) IOMallocAligned( count * sizeof(pf_selector_stats_t), 128 );
+		if (!cpuStats[cpu])
+			return false;
+		bzero (cpuStats[cpu], count * sizeof(pf_selector_stats_t));
+	}
+
+	return true;
+}
+
+// **********************************************************************************
+// free
+//
+// **********************************************************************************
+void MacRISC4PFStats::free( void )
+{
+	UInt32 i;
+
+	for (i = 0; i < kPFStatsMaxCPUs; i++)
+		if (cpuStats[i])
+			IOFreeAligned( cpuStats[i], selectorCount * sizeof(pf_selector_stats_t) );
+
+	if (selectorNames)
+	{
+		for (i = 0; i < selectorCount; i++)
+			if (selectorNames[i])
+				selectorNames[i]->release();
+
+		IOFree( selectorNames, selectorCount * sizeof(const OSSymbol *) );
+	}
+
+	super::free();
+
+	return;
+}
+
+// **********************************************************************************
+// setSelectorName
+//
+// Called by the owner while it builds its dispatch tables, before any record()
+// **********************************************************************************
+void MacRISC4PFStats::setSelectorName( UInt32 selector, const OSSymbol *name )
+{
+	if ((selector >= selectorCount) || !name)
+		return;
+
+	name->retain();
+	if (selectorNames[selector])
+		selectorNames[selector]->release();
+	selectorNames[selector] = name;
+
+	return;
+}
+
+// **********************************************************************************
+// record
+//
+// May be called at interrupt level.  The caller may migrate between reading the CPU
+// number and updating the counters, so the updates are atomic - but they almost always
+// land on the current CPU's cache lines.
+// **********************************************************************************
+void MacRISC4PFStats::record( UInt32 selector, UInt64 elapsed, bool failed )
+{
+	pf_selector_stats_t	*stats;
+	UInt32				cpu, elapsed32, oldMax;
+
+	if ((selector >= selectorCount) || ((cpu = cpu_number()) >= kPFStatsMaxCPUs))
+		return;
+
+	stats = &cpuStats[cpu][selector];
+
+	OSIncrementAtomic ((volatile SInt32 *) &stats->calls);
+	if (failed)
+		OSIncrementAtomic ((volatile SInt32 *) &stats->failures);
+	OSAddAtomic64 ((SInt64) elapsed, (volatile SInt64 *) &stats->totalTime);
+
+	elapsed32 = (elapsed > 0xFFFFFFFFULL) ? 0xFFFFFFFF : (UInt32) elapsed;
+	do {
+		oldMax = stats->maxTime;
+		if (elapsed32 <= oldMax)
+			break;
+	} while (!OSCompareAndSwap (oldMax, elapsed32, (volatile UInt32 *) &stats->maxTime));
+
+	return;
+}
+
+// **********************************************************************************
+// reset
+//
+// A call in flight on another CPU may still land in the old totals
+// **********************************************************************************
+void MacRISC4PFStats::reset( void )
+{
+	UInt32 cpu;
+
+	for (cpu = 0; cpu < kPFStatsMaxCPUs; cpu++)
+		bzero ((void *) cpuStats[cpu], selectorCount * sizeof(pf_selector_stats_t));
+
+	return;
+}
+
+// **********************************************************************************
+// copySnapshot
+//
+// Returns a new dictionary with one entry per selector that has been called
+// **********************************************************************************
+OSDictionary *MacRISC4PFStats::copySnapshot( void )
+{
+	OSDictionary	*snapshot, *entry;
+	OSNumber		*number;
+	UInt32			selector, cpu, calls, failures, maxTime;
+	UInt64			totalTime;
+
+	if ((snapshot = OSDictionary::withCapacity (selectorCount)) == NULL)
+		return NULL;
+
+	for (selector = 0; selector < selectorCount; selector++)
+	{
+		if (!selectorNames[selector])
+			continue;
+
+		calls = failures = maxTime = 0;
+		totalTime = 0;
+		for (cpu = 0; cpu < kPFStatsMaxCPUs; cpu++)
+		{
+			calls += cpuStats[cpu][selector].calls;
+			failures += cpuStats[cpu][selector].failures;
+			totalTime += cpuStats[cpu][selector].totalTime;
+			if (cpuStats[cpu][selector].maxTime > maxTime)
+				maxTime = cpuStats[cpu][selector].maxTime;
+		}
+
+		if (calls == 0)
+			continue;
+
+		if ((entry = OSDictionary::withCapacity (4)) == NULL)
+			continue;
+
+		if (number = OSNumber::withNumber (calls, 32)) {
+			entry->setObject (kPFStatsCallsKey, number);
+			number->release();
+		}
+		if (number = OSNumber::withNumber (failures, 32)) {
+			entry->setObject (kPFStatsFailuresKey, number);
+			number->release();
+		}
+		if (number = OSNumber::withNumber (totalTime, 64)) {
+			entry->setObject (kPFStatsTotalTimeKey, number);
+			number->release();
+		}
+		if (number = OSNumber::withNumber (maxTime, 32)) {
+			entry->setObject (kPFStatsMaxTimeKey, number);
+			number->release();
+		}
+
+		snapshot->setObject (selectorNames[selector], entry);
+		entry->release();
+	}
+
+	return snapshot;
+}
+
+// **********************************************************************************
+// handleSetProperties
+//
+// Called from the owner's setProperties.  Returns kIOReturnUnsupported if properties
+// holds neither of our keys, so the owner can pass it on.
+// **********************************************************************************
+IOReturn MacRISC4PFStats::handleSetProperties( IORegistryEntry *owner, OSObject *properties )
+{
+	OSDictionary	*dict, *snapshot;
+	IOReturn		result = kIOReturnUnsupported;
+
+	if ((dict = OSDynamicCast (OSDictionary, properties)) == NULL)
+		return kIOReturnUnsupported;
+
+	if (dict->getObject (kPFStatsResetKey))
+	{
+		reset();
+		result = kIOReturnSuccess;
+	}
+
+	if (dict->getObject (kPFStatsSnapshotKey))
+	{
+		if ((snapshot = copySnapshot()) == NULL)
+			return kIOReturnNoMemory;
+
+		owner->setProperty (kPFStatsKey, snapshot);
+		snapshot->release();
+		result = kIOReturnSuccess;
+	}
+
+	return result;
+}
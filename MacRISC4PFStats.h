@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+#ifndef _IOKIT_MACRISC4PFSTATS_H
+#define _IOKIT_MACRISC4PFSTATS_H
+
+#include <libkern/c++/OSObject.h>
+#include <libkern/c++/OSSymbol.h>
+#include <libkern/c++/OSDictionary.h>
+#include <IOKit/IORegistryEntry.h>
+
+// setProperties keys understood by the platform function dispatchers (AppleU3, MacRISC4PE).
+// Setting kPFStatsSnapshotKey to any value publishes a fresh kPFStatsKey dictionary; setting
+// kPFStatsResetKey to any value zeroes the counters.
+#define kPFStatsKey				"PlatformFunctionStats"
+#define kPFStatsSnapshotKey		"PlatformFunctionStatsSnapshot"
+#define kPFStatsResetKey		"PlatformFunctionStatsReset"
+
+// Keys of each selector's dictionary in a snapshot.  Times are in absolute time units.
+#define kPFStatsCallsKey		"Calls"
+#define kPFStatsFailuresKey		"Failures"
+#define kPFStatsTotalTimeKey	"TotalTime"
+#define kPFStatsMaxTimeKey		"MaxTime"
+
+#define kPFStatsMaxCPUs			4
+
+typedef struct _pf_selector_stats_t
+{
+	volatile UInt32		calls;
+	volatile UInt32		failures;
+	volatile UInt64		totalTime;
+	volatile UInt32		maxTime;		// saturates at 0xFFFFFFFF
+	UInt32				reserved;
+} pf_selector_stats_t;
+
+/*!
+    @class MacRISC4PFStats
+    @abstract Per-selector call counters and latencies for a callPlatformFunction dispatcher.
+    @discussion Each CPU updates its own array of counters with atomic operations, so recording
+    never takes a lock.  Selectors are small integers chosen by the owner, which names each one
+    once with setSelectorName.  copySnapshot sums the CPUs into an OSDictionary keyed by name.
+*/
+class MacRISC4PFStats : public OSObject
+{
+    OSDeclareDefaultStructors(MacRISC4PFStats)
+
+private:
+	UInt32					selectorCount;
+	const OSSymbol			**selectorNames;
+	pf_selector_stats_t		*cpuStats[kPFStatsMaxCPUs];
+
+public:
+	static MacRISC4PFStats *withSelectorCount( UInt32 count );
+	virtual bool initWithSelectorCount( UInt32 count );
+	virtual void free( void );
+
+	void setSelectorName( UInt32 selector, const OSSymbol *name );
+	void record( UInt32 selector, UInt64 elapsed, bool failed );
+	void reset( void );
+	OSDictionary *copySnapshot( void );
+	IOReturn handleSetProperties( IORegistryEntry *owner, OSObject *properties );
+};
+
+#endif /* _IOKIT_MACRISC4PFSTATS_H */
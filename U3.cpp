@@ -28,6 +28,8 @@
 
 
 #include <IOKit/platform/ApplePlatformExpert.h>
+#include <IOKit/IODeviceMemory.h>
+#include <IOKit/IOMultiMemoryDescriptor.h>
 
 #include "U3.h"
 #include "MacRISC4PE.h"
@@ -42,9 +44,218 @@ __END_DECLS
 
 static const OSSymbol *symsafeReadRegUInt32;
 static const OSSymbol *symsafeWriteRegUInt32;
+static const OSSymbol *symsafeRegTransactionUInt32;
 static const OSSymbol *symUniNSetPowerState;
 static const OSSymbol *symUniNPrepareForSleep;
 
+// Register classification.  Serialized registers are read under their domain lock, everything
+// else is a plain register and is read without a lock (see safeReadRegUInt32).  Registers not
+// listed are plain and in kU3LockDomainMisc.  The U3 and U4 offsets are both listed; the first
+// match wins, so an offset collision between the two still maps an offset to a single lock.
+static const u3_reg_access_t gU3RegAccessTable[] =
+{
+	{ kU3APIExceptionRegister,		kU3RegAccessReadSideEffects,	kU3LockDomainAPI },		// clear on read
+	{ kU4APIExceptionRegister,		kU3RegAccessReadSideEffects,	kU3LockDomainAPI },		// clear on read
+	{ kU3ChipFaultMaskRegister,		kU3RegAccessRMW,				kU3LockDomainAPI },
+	{ kU4APIMask1Register,			kU3RegAccessRMW,				kU3LockDomainAPI },
+	{ kU3MemErrorSyndromeRegister,	kU3RegAccessReadSideEffects,	kU3LockDomainMemCtl },	// reading clears ECC state
+	{ kU4MemErrorSyndromeRegister,	kU3RegAccessReadSideEffects,	kU3LockDomainMemCtl },	// reading clears ECC state
+	{ kU3MemCheckCtrlRegister,		kU3RegAccessRMW,				kU3LockDomainMemCtl },
+	{ kU4MemCheckCtrlRegister,		kU3RegAccessRMW,				kU3LockDomainMemCtl },
+	{ kU3MemErrorAddressRegister,	kU3RegAccessPlain,				kU3LockDomainMemCtl },
+	{ kU4MemErrorAddressRegister1,	kU3RegAccessPlain,				kU3LockDomainMemCtl },
+	{ kU4MemErrorAddressRegister2,	kU3RegAccessPlain,				kU3LockDomainMemCtl },
+	{ kU3DARTCntlRegister,			kU3RegAccessPlain,				kU3LockDomainDART },
+	{ kU3DARTExceptionRegister,		kU3RegAccessPlain,				kU3LockDomainDART },
+	{ kU4DARTExceptionRegister,		kU3RegAccessPlain,				kU3LockDomainDART },
+	{ kU3HTLinkFreqRegister,		kU3RegAccessPlain,				kU3LockDomainHT },
+	{ kU3HTLinkConfigRegister,		kU3RegAccessPlain,				kU3LockDomainHT },
+	{ kU3ToggleRegister,			kU3RegAccessRMW,				kU3LockDomainToggle }
+};
+
+// The index of gU3RegAccessTable that register accesses look up (see U3RegAccess.h).  It is
+// only written before anything can access a register.
+typedef char regAccessIndexIsHalfEmpty[(kU3RegAccessSlots >= 2 * (sizeof(gU3RegAccessTable) / sizeof(gU3RegAccessTable[0]))) ? 1 : -1];
+
+static u3_reg_access_t gU3RegAccessIndex[kU3RegAccessSlots];
+static bool gU3RegAccessIndexBuilt;
+
+// phandles are small integers or package addresses, so drop the low bits before mixing
+#define U3_PHANDLE_HASH(ph)	((((UInt32)(ph) >> 2) * 2654435761U) >> 16)
+
+// Uni-N pages that AppleU3UserClient may map read-only for monitoring - the version, HT link,
+// memory controller and DART control registers.  createRegWindow drops any candidate page that
+// holds a register with read side effects, so a monitor can never clear hardware state.
+static const UInt32 gU3RegWindowCandidates[] =
+{
+	kUniNVersion,
+	kU3HTLinkConfigRegister,
+	kU3HTLinkFreqRegister,
+	kU3MemCheckCtrlRegister,
+	kU4MemCheckCtrlRegister,
+	kU3DARTCntlRegister
+};
+
+// Driver-owned registers kept in regShadow[].  The MPIC reset bit in the toggle register is
+// treated as a pulse - it is written when asked for but never carried forward from the shadow.
+static const u3_reg_shadow_t gU3RegShadowTable[kU3NumShadowRegs] =
+{
+	{ kU3ToggleRegister,			kU3ShadowOnU3 | kU3ShadowOnU4,	kU3MPICReset },
+	{ kU3ChipFaultMaskRegister,		kU3ShadowOnU3,					0 },
+	{ kU4APIMask1Register,			kU3ShadowOnU4,					0 },
+	{ kU3MemCheckCtrlRegister,		kU3ShadowOnU3,					0 }
+};
+
+// Register fields decoded by the driver
+typedef U3RegField<kU3HTLinkFreqRegister, 0x00000F00>										U3HTLinkFreqField;
+typedef U3RegField<kU3HTLinkConfigRegister, 0x70000000>										U3HTLinkOutWidthField;
+typedef U3RegField<kU3HTLinkConfigRegister, 0x07000000>										U3HTLinkInWidthField;
+typedef U3RegField<kU3MemCheckCtrlRegister, kU3MCCR_ECC_EN>									U3MCCREccEnableField;
+typedef U3RegField<kU3MemErrorAddressRegister, kU3MEAR_RNK_A_mask>							U3MEARRankField;
+typedef U3RegField<kU4MemErrorAddressRegister1, kU4MEAR_RK_mask>							U4MEARRankField;
+typedef U3RegField<kU3MemErrorSyndromeRegister, (kU3MESR_ECC_SYNDROME_mask << 8)>			U3MESRUpperSyndromeField;
+typedef U3RegField<kU3MemErrorSyndromeRegister, kU3MESR_ECC_SYNDROME_mask>					U3MESRLowerSyndromeField;
+typedef U3RegField<kU4MemErrorSyndromeRegister, 0x0000FFFF>									U4MESRSyndromeField;
+typedef U3RegField<kU3DARTExceptionRegister, kU3DARTExcpLogAdrsMask>						U3DARTExcpLogAdrsField;
+typedef U3RegField<kU4DARTExceptionRegister, kU4DARTExcpLogAdrsMask>						U4DARTExcpLogAdrsField;
+typedef U3RegField<kU4DARTExceptionRegister, kU4DARTExcpXCDMask>							U4DARTExcpXCDField;
+
+U3_CHECK_REG_FIELD(U3HTLinkFreqField);
+U3_CHECK_REG_FIELD(U3HTLinkOutWidthField);
+U3_CHECK_REG_FIELD(U3HTLinkInWidthField);
+U3_CHECK_REG_FIELD(U3MCCREccEnableField);
+U3_CHECK_REG_FIELD(U3MEARRankField);
+U3_CHECK_REG_FIELD(U4MEARRankField);
+U3_CHECK_REG_FIELD(U3MESRUpperSyndromeField);
+U3_CHECK_REG_FIELD(U3MESRLowerSyndromeField);
+U3_CHECK_REG_FIELD(U4MESRSyndromeField);
+U3_CHECK_REG_FIELD(U3DARTExcpLogAdrsField);
+U3_CHECK_REG_FIELD(U4DARTExcpLogAdrsField);
+U3_CHECK_REG_FIELD(U4DARTExcpXCDField);
+U3_CHECK_REG_FIELD_SHIFT(U3MEARRankField, kU3MEAR_RNK_A_shift);
+U3_CHECK_REG_FIELD_SHIFT(U4MEARRankField, kU4MEAR_RK_shift);
+U3_CHECK_REG_FIELD_SHIFT(U3DARTExcpLogAdrsField, kU3DARTExcpLogAdrsShift);
+U3_CHECK_REG_FIELD_SHIFT(U4DARTExcpLogAdrsField, kU4DARTExcpLogAdrsShift);
+U3_CHECK_REG_FIELDS_DISJOINT(U3HTLinkOutWidthField, U3HTLinkInWidthField);
+U3_CHECK_REG_FIELDS_DISJOINT(U3MESRUpperSyndromeField, U3MESRLowerSyndromeField);
+U3_CHECK_REG_FIELDS_DISJOINT(U4DARTExcpLogAdrsField, U4DARTExcpXCDField);
+
+// Registers every variant has, the Regs of U3ChipState.h
+struct U3UniNRegs
+{
+	enum
+	{
+		versionReg			= kUniNVersion,
+		minVersion			= kUniNVersion3,
+		dartCntlReg			= kU3DARTCntlRegister,
+		pmClockControlReg	= kU3PMClockControl,
+		vspSoftResetReg		= kUniNVSPSoftReset,
+		hwInitStateReg		= kUniNHWInitState,
+		hwInitRunning		= kUniNHWInitStateRunning,
+		hwInitSleeping		= kUniNHWInitStateSleeping,
+		toggleReg			= kU3ToggleRegister,
+		mpicEnableOutputs	= kU3MPICEnableOutputs
+	};
+
+	typedef U3HTLinkFreqField		HTLinkFreqField;
+	typedef U3HTLinkOutWidthField	HTLinkOutWidthField;
+	typedef U3HTLinkInWidthField	HTLinkInWidthField;
+
+	static bool isU4( UInt32 version )			{ return IS_U4(version); }
+	static bool isU3Heavy( UInt32 version )		{ return IS_U3_HEAVY(version); }
+};
+
+// Per-variant register maps.  The chip fault path is instantiated once per variant from these.
+template <> struct U3ChipTraits<kU3VariantLite>
+{
+	enum
+	{
+		shadowChip			= kU3ShadowOnU3,
+		faultMaskReg		= kU3ChipFaultMaskRegister,
+		faultExcpReg		= kU3APIExceptionRegister,
+		dartExcpReg			= kU3DARTExceptionRegister,
+		dartExcpBit			= kU3API_DARTExcp,					// unmasked by setupDARTExcp
+		dartExcpBits		= kU3API_DARTExcp | kU4API_DARTExcp,	// either one reports a DART exception
+		dartWriteMask		= kU3DARTExcpRQOPMask,
+		eccStyle			= kU3ECCNone,
+		eccExcpBits			= 0,			// no ECC on U3 Lite
+		eccUEBits			= 0,
+		eccCEBits			= 0,
+		eccUpperBits		= 0,
+		memCheckCtrlReg		= kU3MemCheckCtrlRegister,
+		memCheckMaskBits	= 0,
+		memErrAddrReg		= kU3MemErrorAddressRegister,
+		memErrAddrReg1		= 0,
+		memErrSyndromeReg	= kU3MemErrorSyndromeRegister,
+		expectChipFault		= false,
+		hasPMClockControl	= true
+	};
+};
+
+template <> struct U3ChipTraits<kU3VariantHeavy>
+{
+	enum
+	{
+		shadowChip			= kU3ShadowOnU3,
+		faultMaskReg		= kU3ChipFaultMaskRegister,
+		faultExcpReg		= kU3APIExceptionRegister,
+		dartExcpReg			= kU3DARTExceptionRegister,
+		dartExcpBit			= kU3API_DARTExcp,					// unmasked by setupDARTExcp
+		dartExcpBits		= kU3API_DARTExcp | kU4API_DARTExcp,	// either one reports a DART exception
+		dartWriteMask		= kU3DARTExcpRQOPMask,
+		eccStyle			= kU3ECCU3Heavy,
+		eccExcpBits			= kU3API_ECC_UE_H | kU3API_ECC_CE_H | kU3API_ECC_UE_L | kU3API_ECC_CE_L,
+		eccUEBits			= kU3API_ECC_UE_H | kU3API_ECC_UE_L,
+		eccCEBits			= kU3API_ECC_CE_H | kU3API_ECC_CE_L,
+		eccUpperBits		= kU3API_ECC_UE_H | kU3API_ECC_CE_H,	// errors in the upper DIMM of the pair
+		memCheckCtrlReg		= kU3MemCheckCtrlRegister,
+		memCheckMaskBits	= kU3MCCR_ECC_UE_MASK_H | kU3MCCR_ECC_CE_MASK_H | kU3MCCR_ECC_UE_MASK_L | kU3MCCR_ECC_CE_MASK_L,
+		memErrAddrReg		= kU3MemErrorAddressRegister,
+		memErrAddrReg1		= 0,
+		memErrSyndromeReg	= kU3MemErrorSyndromeRegister,
+		expectChipFault		= true,
+		hasPMClockControl	= true
+	};
+
+	typedef U3MEARRankField				RankField;
+	typedef U3MESRUpperSyndromeField	SyndromeUpperField;
+	typedef U3MESRLowerSyndromeField	SyndromeLowerField;
+};
+
+template <> struct U3ChipTraits<kU3VariantU4>
+{
+	enum
+	{
+		shadowChip			= kU3ShadowOnU4,
+		faultMaskReg		= kU4APIMask1Register,
+		faultExcpReg		= kU4APIExceptionRegister,
+		dartExcpReg			= kU4DARTExceptionRegister,
+		dartExcpBit			= kU3API_DARTExcp,					// unmasked by setupDARTExcp
+		dartExcpBits		= kU3API_DARTExcp | kU4API_DARTExcp,	// either one reports a DART exception
+		dartWriteMask		= kU4DARTExcpRQOPMask,
+		eccStyle			= kU3ECCU4,
+		eccExcpBits			= kU4API_ECC_UEExcp | kU4API_ECC_CEExcp,
+		eccUEBits			= kU4API_ECC_UEExcp,
+		eccCEBits			= kU4API_ECC_CEExcp,
+		eccUpperBits		= 0,			// the syndrome says which DIMM of the rank
+		memCheckCtrlReg		= kU4MemCheckCtrlRegister,
+		memCheckMaskBits	= kU4MCCR_ECC_UE_MASK | kU4MCCR_ECC_CE_MASK,
+		memErrAddrReg		= kU4MemErrorAddressRegister1,
+		memErrAddrReg1		= kU4MemErrorAddressRegister2,
+		memErrSyndromeReg	= kU4MemErrorSyndromeRegister,
+		expectChipFault		= true,
+		hasPMClockControl	= false		// ClockControl moved to the SPU and VSPSoftReset is gone
+	};
+
+	typedef U4MEARRankField				RankField;
+	typedef U4MESRSyndromeField			SyndromeField;
+};
+
+#define U3_CHIP_MAP(v)	{ (v), U3ChipTraits<v>::shadowChip, U3ChipTraits<v>::faultMaskReg, U3ChipTraits<v>::dartExcpBit, \
+							U3ChipTraits<v>::eccExcpBits, U3ChipTraits<v>::memCheckCtrlReg, U3ChipTraits<v>::memCheckMaskBits, \
+							U3ChipTraits<v>::expectChipFault, U3ChipTraits<v>::hasPMClockControl, \
+							&AppleU3::chipFaultFor<v>, &AppleU3::readChipFaultStateFor<v>, &AppleU3::handleChipFaultStateFor<v> }
+
 #define super IOService
 OSDefineMetaClassAndStructors(AppleU3,ApplePlatformExpert)
 
@@ -61,6 +272,7 @@ bool AppleU3::start ( IOService * nub )
 	IOPlatformFunction		*func;
 	const OSSymbol			*functionSymbol = OSSymbol::withCString(kInstantiatePlatformFunctions);
 	SInt32					retval;
+	UInt32					i, variant;
 	
 		
 	// If our PE isn't MacRISC4PE, we shouldn't be here
@@ -68,6 +280,9 @@ bool AppleU3::start ( IOService * nub )
 	
 	provider = nub;
 
+	// Before the first register access - the safe accessors classify registers through it
+	buildRegAccessIndex();
+
 	// Get our memory mapping
 	uniNMemory = provider->mapDeviceMemoryWithIndex( 0 );
 	if (!uniNMemory) {
@@ -76,27 +291,60 @@ bool AppleU3::start ( IOService * nub )
 	}
 	
 	uniNBaseAddress = (UInt32 *)uniNMemory->getVirtualAddress();
+
+#ifdef U3_MMIO_TRACE
+	// Allocate the trace rings up front so that tracing never allocates
+	traceMemory = IOBufferMemoryDescriptor::withOptions(kIOMemoryKernelUserShared,
+		sizeof(u3_trace_buffer_t), page_size);
+	if (traceMemory) {
+		u3_trace_buffer_t *buffer = (u3_trace_buffer_t *)traceMemory->getBytesNoCopy();
+
+		bzero (buffer, sizeof(u3_trace_buffer_t));
+		buffer->version = kU3TraceVersion;
+		buffer->cpuCount = kU3TraceMaxCPUs;
+		buffer->ringEntries = kU3TraceRingEntries;
+		traceBuffer = buffer;
+	}
+#endif
 	
-	// sets up the mutex lock:
-	mutex = IOSimpleLockAlloc();
+	// Statistics page for AppleU3UserClient - allocated before the register locks are first used
+	statsMemory = IOBufferMemoryDescriptor::withOptions(kIOMemoryKernelUserShared,
+		sizeof(u3_stats_page_t), page_size);
+	if (statsMemory) {
+		u3_stats_page_t *page = (u3_stats_page_t *)statsMemory->getBytesNoCopy();
+
+		bzero (page, sizeof(u3_stats_page_t));
+		page->version = kU3StatsVersion;
+		page->cpuCount = kU3StatsMaxCPUs;
+		statsPage = page;
+	}
 
-	if (mutex != NULL)
-		IOSimpleLockInit( mutex );
+	// Read-only register window for AppleU3UserClient, described in the statistics page
+	if (statsPage)
+		createRegWindow(provider);
+
+	// sets up the register locks:
+	for (i = 0; i < kU3NumLockDomains; i++)
+		if ((regLocks[i] = IOSimpleLockAlloc()) != NULL)
+			IOSimpleLockInit( regLocks[i] );
 
     // Set a lock for tuning UniN (currently nothing to tune)
-	if ( mutex  != NULL )
-		intState = IOSimpleLockLockDisableInterrupt(mutex);
+	intState = lockUniN(kU3AllLockDomains);
 		
 				
     uniNVersion = readUniNReg(kUniNVersion);
 
-    if (uniNVersion < kUniNVersion3) {
+	// Everything that differs between the chips is looked up through chipMap from here on
+	if ((variant = U3ChipVariantFor<U3UniNRegs>(uniNVersion)) == kU3NumVariants) {
 		kprintf ("AppleU3::start - UniN version 0x%lx not supported\n", uniNVersion);
 		return false;
-    }
+	}
+	chipMap = getChipMap(variant);
+
+	// Load the shadows of the driver-owned registers that exist on this chip
+	initRegShadows();
 	
-	if ( mutex  != NULL )
-		IOSimpleLockUnlockEnableInterrupt(mutex, intState);
+	unlockUniN(kU3AllLockDomains, intState);
   
 	// Figure out if we're on a notebook
 	if (callPlatformFunction ("PlatformIsPortable", true, (void *) &hostIsMobile, (void *)0,
@@ -107,6 +355,7 @@ bool AppleU3::start ( IOService * nub )
 	symreadUniNReg = OSSymbol::withCString("readUniNReg");
         symsafeReadRegUInt32 = OSSymbol::withCString("safeReadRegUInt32");
 	symsafeWriteRegUInt32 = OSSymbol::withCString("safeWriteRegUInt32");
+	symsafeRegTransactionUInt32 = OSSymbol::withCString(kU3SafeRegTransactionFuncName);
 	symUniNSetPowerState = OSSymbol::withCString("UniNSetPowerState");
     symUniNPrepareForSleep = OSSymbol::withCString("UniNPrepareForSleep");
     symGetHTLinkFrequency = OSSymbol::withCString("getHTLinkFrequency");
@@ -116,13 +365,50 @@ bool AppleU3::start ( IOService * nub )
     symSetSPUSleep = OSSymbol::withCString("setSPUsleep");
     symSetPMUSleep = OSSymbol::withCString("sleepNow");
 	symU3APIPhyDisableProcessor1 = OSSymbol::withCString("u3APIPhyDisableProcessor1");
+	symPerformFunctionAsync = OSSymbol::withCString(kU3PerformFunctionAsyncFuncName);
+
+	if ((pfLock = IOLockAlloc()) == NULL) {
+		kprintf ("AppleU3::start - cannot allocate platform function lock\n");
+		return false;
+	}
+
+	if ((powerGateCallout = thread_call_allocate ((thread_call_func_t) AppleU3::sReleasePowerGates,
+			(thread_call_param_t) this)) == NULL) {
+		kprintf ("AppleU3::start - cannot allocate power gate callout\n");
+		return false;
+	}
+
+	// Index the PCI nubs by phandle for the config commands.  The publish notification is
+	// also delivered for every nub that is already registered, which builds the initial index.
+	if ((pHandleLock = IOLockAlloc()) != NULL) {
+		pciPublishNotifier = addNotification (gIOPublishNotification, serviceMatching ("IOPCIDevice"),
+			(IOServiceNotificationHandler) AppleU3::sPCINubPublished, this, 0);
+		pciTerminateNotifier = addNotification (gIOTerminatedNotification, serviceMatching ("IOPCIDevice"),
+			(IOServiceNotificationHandler) AppleU3::sPCINubTerminated, this, 0);
+	}
 
 	// Identify any platform-do-functions
 	retval = callPlatformFunction (functionSymbol, true, (void *)provider, 
 		(void *)&platformFuncArray, (void *)0, (void *)0);
-	if (retval == kIOReturnSuccess && (platformFuncArray != NULL)) {
-		unsigned int i;
-		
+	if (retval != kIOReturnSuccess)
+		platformFuncArray = NULL;
+
+	// The functions' nubs get their config gates before anything is compiled to use them
+	buildConfigGates ();
+
+	// Everything callPlatformFunction answers for goes into the dispatch table.  This has to
+	// happen before the on-demand functions are published - a caller that finds one must not
+	// get a miss here and be passed on to our superclass.
+	buildPlatformFunctionTable ();
+	seedInternCache ();
+
+	// Compile the functions that run when Uni-N saves its state for sleep and when it wakes
+	buildPowerPhase (kU3PowerPhaseSleep, kIOPFFlagOnSleep);
+	buildPowerPhase (kU3PowerPhaseWake, kIOPFFlagOnWake);
+	buildPowerPhase (kU3PowerPhaseHighSpeed, kIOPFFlagHighSpeed);
+	buildPowerPhase (kU3PowerPhaseLowSpeed, kIOPFFlagLowSpeed);
+
+	if (platformFuncArray != NULL) {
 		// Examine the functions and for any that are demand, publish the function so callers can find us
 		for (i = 0; i < platformFuncArray->getCount(); i++)
 			if (func = OSDynamicCast (IOPlatformFunction, platformFuncArray->getObject(i)))
@@ -139,6 +425,9 @@ bool AppleU3::start ( IOService * nub )
 
 	// Create our friends
 	createNubs(this, provider->getChildIterator( gIODTPlane ));
+
+	// Let privileged clients at our trace and statistics memory
+	setProperty ("IOUserClientClass", kAppleU3UserClientClassName);
   	
 	// Come and get it...
 	registerService();
@@ -155,19 +444,56 @@ bool AppleU3::start ( IOService * nub )
 		setupECC();
 	}
 
+#ifdef U3_SHADOW_VERIFY
+	if (shadowVerifyCallout = thread_call_allocate((thread_call_func_t) AppleU3::sVerifyRegShadows,
+													(thread_call_param_t) this))
+	{
+		AbsoluteTime deadline;
+
+		clock_interval_to_deadline( kU3ShadowVerifyIntervalMS, kMillisecondScale, &deadline );
+		thread_call_enter_delayed( shadowVerifyCallout, deadline );
+	}
+#endif
+
 	return super::start(provider);
 }
 
 void AppleU3::free ()
 {
+	UInt32 i;
+
+	// Before platformFuncArray goes, the phase arrays are sized from it
+	for (i = 0; i < kU3NumPowerPhases; i++)
+		freePowerPhase (&powerPhases[i]);
 
 	if (platformFuncArray) {
 		platformFuncArray->flushCollection();
 		platformFuncArray->release();
 	}
 
-	if (mutex != NULL)
-		IOSimpleLockFree( mutex );
+#ifdef U3_SHADOW_VERIFY
+	if (shadowVerifyCallout) {
+		thread_call_cancel( shadowVerifyCallout );
+		thread_call_free( shadowVerifyCallout );
+	}
+#endif
+
+	for (i = 0; i < kU3NumLockDomains; i++)
+		if (regLocks[i] != NULL)
+			IOSimpleLockFree( regLocks[i] );
+
+	if (regWindowMemory)
+		regWindowMemory->release();
+
+	statsPage = NULL;
+	if (statsMemory)
+		statsMemory->release();
+
+#ifdef U3_MMIO_TRACE
+	traceBuffer = NULL;
+	if (traceMemory)
+		traceMemory->release();
+#endif
 
 	if (dimmErrors)
 		IOFree( dimmErrors, sizeof(u3_parity_error_record_t) * dimmCount );
@@ -178,6 +504,57 @@ void AppleU3::free ()
 	if (dimmErrorCountsTotal)
 		IOFree( dimmErrorCountsTotal, dimmCount * sizeof(UInt32) );
 
+	if (pfStats)
+		pfStats->release();
+
+	if (pciPublishNotifier)
+		pciPublishNotifier->remove();
+
+	if (pciTerminateNotifier)
+		pciTerminateNotifier->remove();
+
+	for (i = 0; i < kU3PHandleBuckets; i++) {
+		u3_phandle_entry_t *entry;
+
+		while ((entry = pHandleIndex[i]) != NULL) {
+			pHandleIndex[i] = entry->next;
+			entry->nub->release();
+			IOFree (entry, sizeof(u3_phandle_entry_t));
+		}
+	}
+
+	if (pHandleLock)
+		IOLockFree (pHandleLock);
+
+	if (pfLock)
+		IOLockFree (pfLock);
+
+	if (powerGateCallout) {
+		thread_call_cancel (powerGateCallout);
+		thread_call_free (powerGateCallout);
+	}
+
+	if (pfDispatchTable) {
+		for (i = 0; i <= pfDispatchMask; i++)
+			if (pfDispatchTable[i].program)
+				freePlatformProgram (pfDispatchTable[i].program);
+
+		IOFree( pfDispatchTable, (pfDispatchMask + 1) * sizeof(u3_pf_dispatch_entry_t) );
+	}
+
+	if (configGates) {
+		releasePowerGates ();
+
+		for (i = 0; i < configGateCount; i++)
+			IOLockFree (configGates[i].lock);
+
+		IOFree( configGates, configGateSlots * sizeof(u3_pf_config_gate_t) );
+	}
+
+	for (i = 0; i < kU3InternCacheSlots; i++)
+		if (internCache[i])
+			internCache[i]->release();
+
 	super::free();
 	
 	return;
@@ -190,223 +567,780 @@ void AppleU3::free ()
 IOReturn AppleU3::callPlatformFunction(const OSSymbol *functionName, bool waitForFunction, 
 		void *param1, void *param2, void *param3, void *param4)
 {
-    if (functionName == symsafeReadRegUInt32)
-    {
-        UInt32 *returnval = (UInt32 *)param2;
-        *returnval = safeReadRegUInt32((UInt32)param1);
-        return kIOReturnSuccess;
-    }
-	
-    if (functionName == symsafeWriteRegUInt32)
-    {
-        safeWriteRegUInt32((UInt32)param1, (UInt32)param2, (UInt32)param3);
-        return kIOReturnSuccess;
-    }
-
-    if (functionName == symUniNSetPowerState)
-    {
-        uniNSetPowerState((UInt32)param1);
-        return kIOReturnSuccess;
-    }
-	
-    if (functionName == symUniNPrepareForSleep)
-    {
-        prepareForSleep();
-        return kIOReturnSuccess;
-    }
-	
-    if (functionName == symGetHTLinkFrequency) {
-		if (getHTLinkFrequency ((UInt32 *)param1))
+	const u3_pf_dispatch_entry_t	*entry;
+	IOReturn						result;
+	UInt64							startTime;
+
+	startTime = mach_absolute_time();
+
+	if ((entry = lookupPlatformFunction (functionName)) != NULL)
+		result = dispatchPlatformFunction (entry, param1, param2, param3, param4);
+	else
+		result = super::callPlatformFunction(functionName, waitForFunction, param1, param2, param3, param4);
+
+	// Selector statistics are kept per dispatch table slot, with one extra for the fall-through
+	if (pfStats)
+		pfStats->record (entry ? (entry - pfDispatchTable) : (pfDispatchMask + 1),
+			mach_absolute_time() - startTime, result != kIOReturnSuccess);
+
+	return result;
+}
+
+// **********************************************************************************
+// dispatchPlatformFunction
+//
+// **********************************************************************************
+IOReturn AppleU3::dispatchPlatformFunction(const u3_pf_dispatch_entry_t *entry,
+		void *param1, void *param2, void *param3, void *param4)
+{
+	switch (entry->selector)
+	{
+		case kU3PFSafeReadRegUInt32:
+		{
+			UInt32 *returnval = (UInt32 *)param2;
+			*returnval = safeReadRegUInt32((UInt32)param1);
 			return kIOReturnSuccess;
-		return kIOReturnError;
-	}
-	
-    if (functionName == symSetHTLinkFrequency) {
-		if (setHTLinkFrequency ((UInt32)param1))
+		}
+
+		case kU3PFSafeWriteRegUInt32:
+			safeWriteRegUInt32((UInt32)param1, (UInt32)param2, (UInt32)param3);
 			return kIOReturnSuccess;
-		return kIOReturnError;
-	}
-	
-    if (functionName == symGetHTLinkWidth) {
-		if (getHTLinkWidth ((UInt32 *)param1, (UInt32 *)param2))
+
+		case kU3PFSafeRegTransaction:
+			return safeRegTransaction((u3_reg_transaction_t *)param1, (UInt32)param2);
+
+		case kU3PFUniNSetPowerState:
+			uniNSetPowerState((UInt32)param1);
 			return kIOReturnSuccess;
-		return kIOReturnError;
-	}
-	
-    if (functionName == symSetHTLinkWidth) {
-		if (setHTLinkWidth ((UInt32)param1, (UInt32)param2))
+
+		case kU3PFUniNPrepareForSleep:
+			prepareForSleep();
 			return kIOReturnSuccess;
-		return kIOReturnError;
-	}
 
-    if (functionName == symU3APIPhyDisableProcessor1) {
-		u3APIPhyDisableProcessor1 ();
-		return kIOReturnSuccess;
-	}
-        
-    if (functionName == symreadUniNReg) {
-                UInt32 *returnval = (UInt32 *)param2;
-                *returnval = readUniNReg((UInt32)param1);
-                return kIOReturnSuccess;
-    }
-    
-	if (platformFuncArray) {
-		UInt32 i;
-		IOPlatformFunction *pfFunc;
-		
-		for (i = 0; i < platformFuncArray->getCount(); i++)
-			if (pfFunc = OSDynamicCast (IOPlatformFunction, platformFuncArray->getObject(i)))
-				// Check for on-demand case
-				if (pfFunc->platformFunctionMatch (functionName, kIOPFFlagOnDemand, NULL))
-					return (performFunction (pfFunc, param1, param2, param3, param4)  ? kIOReturnSuccess : kIOReturnBadArgument);
+		case kU3PFGetHTLinkFrequency:
+			if (getHTLinkFrequency ((UInt32 *)param1))
+				return kIOReturnSuccess;
+			return kIOReturnError;
+
+		case kU3PFSetHTLinkFrequency:
+			if (setHTLinkFrequency ((UInt32)param1))
+				return kIOReturnSuccess;
+			return kIOReturnError;
+
+		case kU3PFGetHTLinkWidth:
+			if (getHTLinkWidth ((UInt32 *)param1, (UInt32 *)param2))
+				return kIOReturnSuccess;
+			return kIOReturnError;
+
+		case kU3PFSetHTLinkWidth:
+			if (setHTLinkWidth ((UInt32)param1, (UInt32)param2))
+				return kIOReturnSuccess;
+			return kIOReturnError;
+
+		case kU3PFAPIPhyDisableProcessor1:
+			u3APIPhyDisableProcessor1 ();
+			return kIOReturnSuccess;
+
+		case kU3PFReadUniNReg:
+		{
+			UInt32 *returnval = (UInt32 *)param2;
+			*returnval = readUniNReg((UInt32)param1);
+			return kIOReturnSuccess;
+		}
+
+		case kU3PFPerformFunctionAsync:
+			return performFunctionAsync ((const OSSymbol *)param1, param2, (u3_pf_completion_t)param3, param4);
+
+		case kU3PFOnDemand:
+			// Functions that did not compile still go through the command interpreter, which logs why
+			if (entry->program && entry->program->exec)
+				return (runPlatformProgramAndWait (entry->program, param1) ? kIOReturnSuccess : kIOReturnBadArgument);
+
+			if (entry->program)
+				return (runPlatformProgram (entry->program, param1) ? kIOReturnSuccess : kIOReturnBadArgument);
+
+			return (performFunction (entry->func, param1, param2, param3, param4)  ? kIOReturnSuccess : kIOReturnBadArgument);
+
+		default:
+			break;
 	}
 
-    return super::callPlatformFunction(functionName, waitForFunction, param1, param2, param3, param4);
+	return kIOReturnUnsupported;
 }
 
-
 IOReturn AppleU3::callPlatformFunction(const char *functionName, bool waitForFunction, 
 		void *param1, void *param2, void *param3, void *param4)
 {
-	IOReturn result = kIOReturnNoMemory;
-	
-	const OSSymbol *functionSymbol = OSSymbol::withCString(functionName);
-  
-	if (functionSymbol != 0) {
-		result = callPlatformFunction(functionSymbol, waitForFunction,
-			param1, param2, param3, param4);
-		functionSymbol->release();
+	IOReturn		result;
+	const OSSymbol	*functionSymbol;
+	const char		*cachedName;
+	UInt32			hash;
+
+	hash = internCacheSlot (functionName);
+
+	// A caller passing the symbol's own string gets a hit without comparing the characters
+	if ((functionSymbol = internCache[hash]) != NULL) {
+		cachedName = functionSymbol->getCStringNoCopy();
+		if (cachedName == functionName || !strcmp (cachedName, functionName))
+			return callPlatformFunction(functionSymbol, waitForFunction, param1, param2, param3, param4);
 	}
+
+	if ((functionSymbol = OSSymbol::withCString(functionName)) == NULL)
+		return kIOReturnNoMemory;
+
+	result = callPlatformFunction(functionSymbol, waitForFunction,
+		param1, param2, param3, param4);
+
+	// Hand our reference to the cache if the name is one we answer for and the slot is still
+	// free, otherwise drop it
+	if ((result == kIOReturnUnsupported) ||
+		!OSCompareAndSwap ((UInt32) NULL, (UInt32) functionSymbol, (volatile UInt32 *) &internCache[hash]))
+		functionSymbol->release();
   
 	return result;
 }
 
 // **********************************************************************************
-// readUniNReg
+// internCacheSlot
 //
+// FNV-1a hash of the name picks the intern cache slot
 // **********************************************************************************
-UInt32 AppleU3::readUniNReg(UInt32 offset)
+UInt32 AppleU3::internCacheSlot( const char *name )
 {
-    return uniNBaseAddress[offset >> 2];
+	UInt32 hash;
+
+	for (hash = 2166136261U; *name; name++)
+		hash = (hash ^ (UInt8) *name) * 16777619U;
+
+	return (hash & (kU3InternCacheSlots - 1));
 }
 
 // **********************************************************************************
-// writeUniNReg
+// seedInternCache
 //
+// Called once from start, after buildPlatformFunctionTable and before anything is published,
+// so the names we answer for hit the cache on their first call.  Where two names share a
+// cache slot the one in the lower dispatch slot keeps it.
 // **********************************************************************************
-void AppleU3::writeUniNReg(UInt32 offset, UInt32 data)
+void AppleU3::seedInternCache( void )
 {
-    uniNBaseAddress[offset >> 2] = data;
+	const OSSymbol	*key;
+	UInt32			i, hash;
+
+	if (!pfDispatchTable)
+		return;
 
+	for (i = 0; i <= pfDispatchMask; i++) {
+		if ((key = pfDispatchTable[i].key) == NULL)
+			continue;
 
-    OSSynchronizeIO();
+		hash = internCacheSlot (key->getCStringNoCopy());
+		if (internCache[hash] == NULL) {
+			key->retain();
+			internCache[hash] = key;
+		}
+	}
 
 	return;
 }
 
 // **********************************************************************************
-// safeReadRegUInt32
+// setProperties
 //
 // **********************************************************************************
-UInt32 AppleU3::safeReadRegUInt32(UInt32 offset)
+IOReturn AppleU3::setProperties( OSObject *properties )
 {
-	IOInterruptState intState = 0;
+	IOReturn result;
 
-	if ( mutex  != NULL )
-		intState = IOSimpleLockLockDisableInterrupt(mutex);
-  
-	UInt32 currentReg = readUniNReg(offset);
-  
-	if ( mutex  != NULL )
-		IOSimpleLockUnlockEnableInterrupt(mutex, intState);
+	// Resetting the counters and taking snapshots is for administrators only
+	if (IOUserClient::clientHasPrivilege (current_task(), kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+		return kIOReturnNotPrivileged;
+
+	if (pfStats && ((result = pfStats->handleSetProperties (this, properties)) != kIOReturnUnsupported))
+		return result;
 
-	return (currentReg);  
+#ifdef U3_PF_TRACE
+	OSDictionary *dict, *trace;
+
+	if ((dict = OSDynamicCast (OSDictionary, properties)) && dict->getObject (kU3PFTraceSnapshotKey)) {
+		if ((trace = copyPlatformFunctionTrace ()) == NULL)
+			return kIOReturnNoMemory;
+
+		setProperty (kU3PFTraceKey, trace);
+		trace->release();
+		return kIOReturnSuccess;
+	}
+#endif
+
+	return super::setProperties (properties);
 }
 
 // **********************************************************************************
-// safeWriteRegUInt32
+// buildPlatformFunctionTable
 //
+// Called once from start, after the built-in symbols are created and platformFuncArray is
+// known.  The table is never changed afterwards, so lookups need no lock.
 // **********************************************************************************
-void AppleU3::safeWriteRegUInt32(UInt32 offset, UInt32 mask, UInt32 data)
+void AppleU3::buildPlatformFunctionTable( void )
 {
-	IOInterruptState	intState = 0;
-	UInt32 				currentReg;
+	IOPlatformFunction	*func;
+	UInt32				i, count, size;
 
-	if ( mutex  != NULL )
-		intState = IOSimpleLockLockDisableInterrupt(mutex);
+	count = kU3NumBuiltinPF;
+	if (platformFuncArray)
+		count += platformFuncArray->getCount();
 
-	if (mask == ~0UL)	// Just write out the data
-		currentReg = data;
-	else {
-		// read, modify then write the data
-		currentReg = readUniNReg(offset);
-		currentReg = (currentReg & ~mask) | (data & mask);
+	// Keep the table at most half full so probe sequences stay short
+	size = U3PFDispatchSlots (count);
+
+	pfDispatchTable = (u3_pf_dispatch_entry_t *) IOMalloc( size * sizeof(u3_pf_dispatch_entry_t) );
+	if (!pfDispatchTable)
+		return;
+
+	bzero (pfDispatchTable, size * sizeof(u3_pf_dispatch_entry_t));
+	pfDispatchMask = size - 1;
+
+	// One statistics selector per table slot, plus one for calls passed on to our superclass
+	if ((pfStats = MacRISC4PFStats::withSelectorCount (size + 1)) != NULL)
+	{
+		const OSSymbol *fallThrough = OSSymbol::withCString ("IOService");
+
+		pfStats->setSelectorName (size, fallThrough);
+		if (fallThrough)
+			fallThrough->release();
 	}
-		
-	writeUniNReg (offset, currentReg);
-  
-	if ( mutex  != NULL )
-		IOSimpleLockUnlockEnableInterrupt(mutex, intState);
-	
+
+	addPlatformFunctionEntry (symsafeReadRegUInt32, kU3PFSafeReadRegUInt32, NULL);
+	addPlatformFunctionEntry (symsafeWriteRegUInt32, kU3PFSafeWriteRegUInt32, NULL);
+	addPlatformFunctionEntry (symsafeRegTransactionUInt32, kU3PFSafeRegTransaction, NULL);
+	addPlatformFunctionEntry (symUniNSetPowerState, kU3PFUniNSetPowerState, NULL);
+	addPlatformFunctionEntry (symUniNPrepareForSleep, kU3PFUniNPrepareForSleep, NULL);
+	addPlatformFunctionEntry (symGetHTLinkFrequency, kU3PFGetHTLinkFrequency, NULL);
+	addPlatformFunctionEntry (symSetHTLinkFrequency, kU3PFSetHTLinkFrequency, NULL);
+	addPlatformFunctionEntry (symGetHTLinkWidth, kU3PFGetHTLinkWidth, NULL);
+	addPlatformFunctionEntry (symSetHTLinkWidth, kU3PFSetHTLinkWidth, NULL);
+	addPlatformFunctionEntry (symU3APIPhyDisableProcessor1, kU3PFAPIPhyDisableProcessor1, NULL);
+	addPlatformFunctionEntry (symreadUniNReg, kU3PFReadUniNReg, NULL);
+	addPlatformFunctionEntry (symPerformFunctionAsync, kU3PFPerformFunctionAsync, NULL);
+
+	// On-demand functions, in array order - the first one with a given name wins, as it did
+	// when the array was searched on every call
+	if (platformFuncArray)
+		for (i = 0; i < platformFuncArray->getCount(); i++)
+			if (func = OSDynamicCast (IOPlatformFunction, platformFuncArray->getObject(i)))
+				if (func->getCommandFlags() & kIOPFFlagOnDemand)
+					addPlatformFunctionEntry (func->getPlatformFunctionName(), kU3PFOnDemand, func);
+
 	return;
 }
 
 // **********************************************************************************
-// uniNSetPowerState
+// addPlatformFunctionEntry
 //
+// Returns false if key is already in the table
 // **********************************************************************************
-void AppleU3::uniNSetPowerState (UInt32 state)
+bool AppleU3::addPlatformFunctionEntry( const OSSymbol *key, UInt32 selector, IOPlatformFunction *func )
 {
-	UInt32 data;
+	UInt32 slot;
 
-	if (state == kUniNNormal)		// start and wake
-	{		
-		// Set MPIC interrupt enable bits in U3 toggle register, but only if MPIC is present
-		if (mpicRegEntry)
-			//safeWriteRegUInt32(kU3ToggleRegister, kU3MPICEnableOutputs | kU3MPICReset, 
-				//kU3MPICEnableOutputs | kU3MPICReset);
-			safeWriteRegUInt32(kU3ToggleRegister, kU3MPICEnableOutputs, 
-				kU3MPICEnableOutputs);
+	if (!key)
+		return false;
 
-		// Set the running state for HWInit.
-		safeWriteRegUInt32(kUniNHWInitState, ~0UL, kUniNHWInitStateRunning);
+	slot = U3PFDispatchProbe (pfDispatchTable, pfDispatchMask, key);
+	if (pfDispatchTable[slot].key)
+		return false;
 
-		safeWriteRegUInt32(kU3DARTCntlRegister, ~0UL, saveDARTCntl);
+	pfDispatchTable[slot].key = key;
+	pfDispatchTable[slot].selector = selector;
+	pfDispatchTable[slot].func = func;
+	if (func)
+		pfDispatchTable[slot].program = compilePlatformFunction (func);
 
-		// ClockControl moved (and is saved by the SPU), and VSPSoftReset no longer exists, so
-		// don't touch them on Kodiak machines.
+	if (pfStats)
+		pfStats->setSelectorName (slot, key);
 
-		if (!IS_U4(uniNVersion))
-		{
-			safeWriteRegUInt32(kU3PMClockControl, ~0UL, saveClockCntl);
-			safeWriteRegUInt32(kUniNVSPSoftReset, ~0UL, saveVSPSoftReset);
-		}
-	}
-	else if (state == kUniNIdle2)
-	{
-		IOLog ("AppleU3: Idle 2 state not supported\n");
+	return true;
+}
+
+// **********************************************************************************
+// lookupPlatformFunction
+//
+// The table holds every symbol we answer for, so a miss is also our negative cache:
+// an unknown selector costs one hash and a short probe before it goes to our superclass.
+// **********************************************************************************
+const u3_pf_dispatch_entry_t *AppleU3::lookupPlatformFunction( const OSSymbol *key ) const
+{
+	UInt32 slot;
+
+	if (!pfDispatchTable)
+		return NULL;
+
+	// The table always has empty slots, so a miss ends at the first one
+	slot = U3PFDispatchProbe (pfDispatchTable, pfDispatchMask, key);
+
+	return pfDispatchTable[slot].key ? &pfDispatchTable[slot] : NULL;
+}
+
+// **********************************************************************************
+// buildRegAccessIndex
+//
+// Entries go in in table order and a repeated offset is skipped, so the first match in
+// gU3RegAccessTable still wins.  Only the first AppleU3 to start builds the index.
+// **********************************************************************************
+void AppleU3::buildRegAccessIndex( void )
+{
+	if (gU3RegAccessIndexBuilt)
+		return;
+
+	U3BuildRegAccessIndex( gU3RegAccessTable, sizeof(gU3RegAccessTable) / sizeof(gU3RegAccessTable[0]),
+		gU3RegAccessIndex );
+
+	gU3RegAccessIndexBuilt = true;
+
+	return;
+}
+
+// **********************************************************************************
+// findRegAccess
+//
+// Returns offset's gU3RegAccessTable entry, or NULL for a plain register in kU3LockDomainMisc
+// **********************************************************************************
+const u3_reg_access_t *AppleU3::findRegAccess(UInt32 offset)
+{
+	return U3FindRegAccess( gU3RegAccessIndex, offset );
+}
+
+// **********************************************************************************
+// getRegAccessFlags
+//
+// **********************************************************************************
+UInt32 AppleU3::getRegAccessFlags(UInt32 offset)
+{
+	const u3_reg_access_t *access = findRegAccess(offset);
+
+	return access ? access->flags : kU3RegAccessPlain;
+}
+
+// **********************************************************************************
+// getRegLockDomain
+//
+// **********************************************************************************
+UInt32 AppleU3::getRegLockDomain(UInt32 offset)
+{
+	const u3_reg_access_t *access = findRegAccess(offset);
+
+	return access ? access->domain : kU3LockDomainMisc;
+}
+
+// **********************************************************************************
+// lockUniN / unlockUniN
+//
+// Acquire and release a set of register domain locks (a mask of (1 << kU3LockDomainXXX))
+// with interrupts disabled.  Locks are taken in ascending domain order and released in
+// reverse.  The wait and hold times of each call are recorded in the current CPU's log2
+// histograms - those are only touched with interrupts disabled, so no atomics are needed.
+// **********************************************************************************
+static inline UInt32 lockHistBucket( UInt64 ticks )
+{
+	UInt32 bucket = 0;
+
+	while (ticks && bucket < kU3LockHistBuckets - 1) {
+		ticks >>= 1;
+		bucket++;
 	}
-	else if (state == kUniNSave)		// save state
+
+	return bucket;
+}
+
+IOInterruptState AppleU3::lockUniN( UInt32 domainMask )
+{
+	IOInterruptState	intState = 0;
+	UInt64				startTime, acquireTime;
+	UInt32				domain, first, cpu;
+	bool				interruptsOff = false;
+
+	startTime = mach_absolute_time();
+
+	for (domain = 0, first = kU3NumLockDomains; domain < kU3NumLockDomains; domain++)
 	{
-		saveDARTCntl = safeReadRegUInt32(kU3DARTCntlRegister);
+		if (!(domainMask & (1 << domain)) || regLocks[domain] == NULL)
+			continue;
 
-		if (!IS_U4(uniNVersion))
-		{
-			saveClockCntl = safeReadRegUInt32(kU3PMClockControl);
-			saveVSPSoftReset = safeReadRegUInt32(kUniNVSPSoftReset);
-		}
+		if (!interruptsOff) {
+			intState = IOSimpleLockLockDisableInterrupt(regLocks[domain]);
+			interruptsOff = true;
+			first = domain;
+		} else
+			IOSimpleLockLock(regLocks[domain]);
 	}
-	else if (state == kUniNSleep)		// sleep
-	{
+
+	if (!interruptsOff)
+		return 0;
+
+	acquireTime = mach_absolute_time();
+	regLockAcquireTime[first] = acquireTime;
+
+	if ( statsPage && (cpu = cpu_number()) < kU3StatsMaxCPUs )
+		statsPage->lockHist[cpu].wait[lockHistBucket(acquireTime - startTime)]++;
+
+	return intState;
+}
+
+void AppleU3::unlockUniN( UInt32 domainMask, IOInterruptState intState )
+{
+	SInt32	domain;
+	UInt32	cpu, first;
+
+	// the hold time was stamped against the lowest domain actually taken
+	for (first = 0; first < kU3NumLockDomains; first++)
+		if ((domainMask & (1 << first)) && regLocks[first] != NULL)
+			break;
+
+	if (first == kU3NumLockDomains)
+		return;
+
+	if ( statsPage && (cpu = cpu_number()) < kU3StatsMaxCPUs )
+		statsPage->lockHist[cpu].hold[lockHistBucket(mach_absolute_time() - regLockAcquireTime[first])]++;
+
+	for (domain = kU3NumLockDomains - 1; domain > (SInt32) first; domain--)
+		if ((domainMask & (1 << domain)) && regLocks[domain] != NULL)
+			IOSimpleLockUnlock(regLocks[domain]);
+
+	IOSimpleLockUnlockEnableInterrupt(regLocks[first], intState);
+
+	return;
+}
+
+// **********************************************************************************
+// resetLockStats
+//
+// **********************************************************************************
+void AppleU3::resetLockStats( void )
+{
+	IOInterruptState intState;
+
+	if ( statsPage == NULL )
+		return;
+
+	// zero under the locks so no histogram update is lost halfway through
+	intState = lockUniN(kU3AllLockDomains);
+	bzero (statsPage->lockHist, sizeof(statsPage->lockHist));
+	unlockUniN(kU3AllLockDomains, intState);
+
+	return;
+}
+
+#ifdef U3_MMIO_TRACE
+// **********************************************************************************
+// traceUniNAccess
+//
+// Appends a record to the current CPU's trace ring.  Called from any context, including
+// with register locks held - must not take locks or allocate.
+// **********************************************************************************
+void AppleU3::traceUniNAccess(UInt32 op, UInt32 offset, UInt32 value, void *caller)
+{
+	u3_trace_ring_t		*ring;
+	u3_trace_record_t	*record;
+	UInt32				cpu, position;
+
+	if (traceBuffer == NULL)
+		return;
+
+	if ((cpu = cpu_number()) >= kU3TraceMaxCPUs)
+		return;
+
+	// The slot is claimed atomically because an interrupt on this CPU (or preemption, for the
+	// unlocked read path) may trace an access while we're in here
+	ring = &traceBuffer->rings[cpu];
+	position = (UInt32) OSIncrementAtomic((SInt32 *) &ring->head);
+	record = &ring->records[position & (kU3TraceRingEntries - 1)];
+
+	record->sequence = 0;
+	record->timestamp = mach_absolute_time();
+	record->cpu = cpu;
+	record->op = op;
+	record->offset = offset;
+	record->value = value;
+	record->caller = (UInt32) caller;
+
+	// the record must be visible before it is marked complete
+	OSSynchronizeIO();
+	record->sequence = position + 1;
+
+	return;
+}
+#endif
+
+// **********************************************************************************
+// U3RegPort
+//
+// AppleU3's registers, locks and shadows as a port for the engines in U3RegTransaction.h
+// and U3RegAccess.h
+// **********************************************************************************
+class U3RegPort
+{
+public:
+	typedef IOInterruptState	LockState;
+
+	U3RegPort( AppleU3 *uniN ) : u3(uniN) {}
+
+	LockState lock(UInt32 domainMask)						{ return u3->lockUniN(domainMask); }
+	void unlock(UInt32 domainMask, LockState intState)		{ u3->unlockUniN(domainMask, intState); }
+	UInt32 lockDomain(UInt32 offset)						{ return AppleU3::getRegLockDomain(offset); }
+	SInt32 shadowIndex(UInt32 offset)						{ return u3->getShadowIndex(offset); }
+	UInt32 shadow(SInt32 index)								{ return u3->regShadow[index]; }
+	void updateShadow(SInt32 index, UInt32 data)			{ u3->updateRegShadow(index, data); }
+	UInt32 load(UInt32 offset)								{ return u3->readUniNReg(offset); }
+	void store(UInt32 offset, UInt32 data)					{ u3->storeUniNReg(offset, data); }
+	void fence(void)										{ OSSynchronizeIO(); }
+
+private:
+	AppleU3		*u3;
+};
+
+// **********************************************************************************
+// safeReadRegUInt32
+//
+// **********************************************************************************
+UInt32 AppleU3::safeReadRegUInt32(UInt32 offset)
+{
+	U3RegPort port(this);
+
+	return U3ReadRegClassified( port, gU3RegAccessIndex, offset );
+}
+
+// **********************************************************************************
+// safeWriteRegUInt32
+//
+// **********************************************************************************
+void AppleU3::safeWriteRegUInt32(UInt32 offset, UInt32 mask, UInt32 data)
+{
+	IOInterruptState	intState = 0;
+	UInt32 				currentReg;
+	SInt32				shadowIndex = getShadowIndex(offset);
+	UInt32				domainMask = 1 << getRegLockDomain(offset);
+
+	intState = lockUniN(domainMask);
+
+	if (mask == ~0UL)	// Just write out the data
+		currentReg = data;
+	else {
+		// read (or take the shadow of a driver-owned register), modify then write the data
+		if (shadowIndex >= 0)
+			currentReg = regShadow[shadowIndex];
+		else
+			currentReg = readUniNReg(offset);
+		currentReg = (currentReg & ~mask) | (data & mask);
+	}
+		
+	writeUniNReg (offset, currentReg);
+	updateRegShadow (shadowIndex, currentReg);
+  
+	unlockUniN(domainMask, intState);
+	
+	return;
+}
+
+// **********************************************************************************
+// writeRegKeepingBits
+//
+// The platform-do register write, reg = (reg & keepMask) | value.  The kept bits of a
+// driver-owned register come from its shadow, and the shadow follows the write, the same as
+// safeWriteRegUInt32.  Must be called with the register's domain lock held.
+// **********************************************************************************
+UInt32 AppleU3::writeRegKeepingBits(UInt32 offset, UInt32 keepMask, UInt32 value)
+{
+	U3RegPort	port(this);
+
+	return U3WriteRegKeepingBits (port, offset, keepMask, value);
+}
+
+// **********************************************************************************
+// safeRegTransaction
+//
+// Executes a list of register reads and (masked) writes under a single acquisition of the
+// register locks it spans.  Stores are not individually fenced - a fence is issued before any load that
+// follows a store, and once at the end of the list.
+// **********************************************************************************
+IOReturn AppleU3::safeRegTransaction(u3_reg_transaction_t *list, UInt32 count)
+{
+	U3RegPort	port(this);
+
+	return U3RunRegTransaction (port, list, count) ? kIOReturnSuccess : kIOReturnBadArgument;
+}
+
+// **********************************************************************************
+// initRegShadows
+//
+// Called with all register locks held - from start, once uniNVersion is known, and from
+// uniNSetPowerState on wake
+// **********************************************************************************
+void AppleU3::initRegShadows( void )
+{
+	UInt32 i, chip;
+
+	chip = chipMap->shadowChip;
+	regShadowActive = 0;
+
+	for (i = 0; i < kU3NumShadowRegs; i++)
+	{
+		if (!(gU3RegShadowTable[i].chips & chip))
+			continue;
+
+		regShadow[i] = readUniNReg(gU3RegShadowTable[i].offset) & ~gU3RegShadowTable[i].volatileBits;
+		regShadowActive |= (1 << i);
+	}
+
+	return;
+}
+
+// **********************************************************************************
+// getShadowIndex
+//
+// Returns the regShadow[] index for a driver-owned register, or -1 if not shadowed
+// **********************************************************************************
+SInt32 AppleU3::getShadowIndex(UInt32 offset)
+{
+	SInt32 i;
+
+	for (i = 0; i < kU3NumShadowRegs; i++)
+		if ((regShadowActive & (1 << i)) && gU3RegShadowTable[i].offset == offset)
+			return i;
+
+	return -1;
+}
+
+// **********************************************************************************
+// updateRegShadow
+//
+// Must be called with the register's domain lock held
+// **********************************************************************************
+void AppleU3::updateRegShadow(SInt32 shadowIndex, UInt32 data)
+{
+	if (shadowIndex >= 0)
+		regShadow[shadowIndex] = data & ~gU3RegShadowTable[shadowIndex].volatileBits;
+
+	return;
+}
+
+#ifdef U3_SHADOW_VERIFY
+// **********************************************************************************
+// sVerifyRegShadows / verifyRegShadows
+//
+// Debug only - periodically compare the register shadows against the hardware.  A
+// mismatch means the register isn't really driver-owned; log it and resync the shadow.
+// **********************************************************************************
+
+/* static */
+void AppleU3::sVerifyRegShadows( void *self, void *refcon )
+{
+	AppleU3 * me = OSDynamicCast( AppleU3, (OSMetaClassBase *) self );
+
+	if (me) me->verifyRegShadows();
+}
+
+void AppleU3::verifyRegShadows( void )
+{
+	IOInterruptState	intState = 0;
+	AbsoluteTime		deadline;
+	UInt32				i, hwReg, mismatch[kU3NumShadowRegs], shadow[kU3NumShadowRegs], mismatchMask = 0;
+
+	intState = lockUniN(kU3AllLockDomains);
+
+	for (i = 0; i < kU3NumShadowRegs; i++)
+	{
+		if (!(regShadowActive & (1 << i)))
+			continue;
+
+		hwReg = readUniNReg(gU3RegShadowTable[i].offset) & ~gU3RegShadowTable[i].volatileBits;
+		if (hwReg != regShadow[i])
+		{
+			mismatch[i] = hwReg;
+			shadow[i] = regShadow[i];
+			mismatchMask |= (1 << i);
+			regShadow[i] = hwReg;
+		}
+	}
+
+	unlockUniN(kU3AllLockDomains, intState);
+
+	// log outside the lock
+	for (i = 0; i < kU3NumShadowRegs; i++)
+		if (mismatchMask & (1 << i))
+			kprintf ("AppleU3::verifyRegShadows - register 0x%lx shadow 0x%08lx hardware 0x%08lx\n",
+				gU3RegShadowTable[i].offset, shadow[i], mismatch[i]);
+
+	clock_interval_to_deadline( kU3ShadowVerifyIntervalMS, kMillisecondScale, &deadline );
+	thread_call_enter_delayed( shadowVerifyCallout, deadline );
+
+	return;
+}
+#endif
+
+// **********************************************************************************
+// uniNSetPowerState
+//
+// **********************************************************************************
+void AppleU3::uniNSetPowerState (UInt32 state)
+{
+	u3_reg_transaction_t	regList[kU3UniNRestoreEntries];
+	UInt32					regCount;
+	IOInterruptState		intState;
+	U3RegPort				port(this);
+
+	if (state == kUniNNormal)		// start and wake
+	{		
+		// The chip lost its state across sleep - reload the shadows from what it has now,
+		// before the restore below or anything else does a masked write from them
+		intState = lockUniN(kU3AllLockDomains);
+		initRegShadows();
+		unlockUniN(kU3AllLockDomains, intState);
+
+		// MPIC outputs, HWInit running and what kUniNSave saved, in one transaction
+		regCount = U3BuildUniNRestore<U3UniNRegs>( &uniNSaved, mpicRegEntry != NULL,
+			chipMap->hasPMClockControl, regList );
+		safeRegTransaction (regList, regCount);
+
+		// Then the platform's own wake register writes.  Its functions with config cycles wait
+		// for uniNWakeComplete - the PCI bridges they go through aren't restored yet.
+		if (!speedChangeInProgress) {
+			runPowerPhase (kU3PowerPhaseWake, kU3PowerPhaseRegs);
+			wakeProgramsPending = true;
+		} else {
+			// Now that the processor is running at full speed, Uni-N can be set for it
+			if (highSpeedPending) {
+				highSpeedPending = false;
+				runPowerPhase (kU3PowerPhaseHighSpeed, kU3PowerPhaseAll);
+			}
+
+			if (powerGatesOwned)
+				thread_call_enter (powerGateCallout);
+		}
+		speedChangeInProgress = false;
+	}
+	else if (state == kUniNIdle2)
+	{
+		IOLog ("AppleU3: Idle 2 state not supported\n");
+	}
+	else if (state == kUniNSave)		// save state
+	{
+		// These are read from hardware.  Firmware and the DART code write them too, so they are
+		// deliberately not shadowed (see gU3RegShadowTable).
+		U3SaveUniNState<U3UniNRegs>( port, gU3RegAccessIndex, chipMap->hasPMClockControl, &uniNSaved );
+
+		// With our state saved, run the platform's sleep sequences - unless we're only changing speed
+		if (!speedChangeInProgress)
+			runPowerPhase (kU3PowerPhaseSleep, kU3PowerPhaseAll);
+	}
+	else if (state == kUniNSleep)		// sleep
+	{
 		if (spu)	// Only call spu if present [3448210]
 			spu->callPlatformFunction (symSetSPUSleep, false, (void *)false, (void *)0, (void *)0, (void *)0);
 			
-		// Set the sleeping state for HWInit.  This tells OF we were sleeping
-		safeWriteRegUInt32(kUniNHWInitState, ~0UL, kUniNHWInitStateSleeping);
-	
-		// Clear MPIC interrupt output enable bit in U3 toggle register, but only if MPIC is present
-		if (mpicRegEntry)
-			safeWriteRegUInt32(kU3ToggleRegister, kU3MPICEnableOutputs, 0);
+		// Set the sleeping state for HWInit, which tells OF we were sleeping, and clear the MPIC
+		// interrupt output enable bit in the toggle register if MPIC is present
+		regCount = U3BuildUniNSleep<U3UniNRegs>( mpicRegEntry != NULL, regList );
+		safeRegTransaction (regList, regCount);
 		
 		// Set HyperTransport back to default state
 		setHTLinkFrequency (0);		// Set U3 end link frequency to 200 MHz
@@ -422,186 +1356,1255 @@ void AppleU3::uniNSetPowerState (UInt32 state)
 		// if (k2) k2->callPlatformFunction (symSetHTLinkWidth, false, (void *)0, (void *)0, (void *)0, (void *)0);
 
 
-	}
-	
+	}
+	
+	return;
+}
+
+// **********************************************************************************
+// buildConfigGates
+//
+// One gate for each distinct pHandle among the platform functions, whatever their flags -
+// compiled, interpreted and power phase functions all find their nub's gate here.  Called
+// once from start; the gates are not added to or moved afterwards, so lookups need no lock.
+// **********************************************************************************
+void AppleU3::buildConfigGates( void )
+{
+	IOPlatformFunction	*func;
+	UInt32				i, pHandle, count;
+
+	if (!platformFuncArray || !(count = platformFuncArray->getCount()))
+		return;
+
+	// Sized for the worst case of every function having its own pHandle
+	if (!(configGates = (u3_pf_config_gate_t *) IOMalloc (count * sizeof(u3_pf_config_gate_t))))
+		return;
+
+	bzero (configGates, count * sizeof(u3_pf_config_gate_t));
+	configGateSlots = count;
+
+	for (i = 0; i < count; i++) {
+		if (!(func = OSDynamicCast (IOPlatformFunction, platformFuncArray->getObject(i))))
+			continue;
+
+		if (!(pHandle = func->getCommandPHandle()) || findConfigGate (pHandle))
+			continue;
+
+		if (!(configGates[configGateCount].lock = IOLockAlloc()))
+			break;
+
+		configGates[configGateCount].pHandle = pHandle;
+		configGateCount++;
+	}
+
+	return;
+}
+
+// **********************************************************************************
+// findConfigGate
+//
+// Returns NULL for a zero pHandle, or if start couldn't build a gate for it
+// **********************************************************************************
+u3_pf_config_gate_t *AppleU3::findConfigGate( UInt32 pHandle )
+{
+	UInt32 i;
+
+	if (pHandle)
+		for (i = 0; i < configGateCount; i++)
+			if (configGates[i].pHandle == pHandle)
+				return &configGates[i];
+
+	return NULL;
+}
+
+// **********************************************************************************
+// lockConfigGate, tryLockConfigGate, unlockConfigGate
+//
+// A gate is owned rather than held, so a program may take it on one thread and give it up on
+// another, after any number of parks.  Owners sleep on the gate's lock while it is taken.
+// **********************************************************************************
+static void lockConfigGate( u3_pf_config_gate_t *gate )
+{
+	IOLockLock (gate->lock);
+	while (gate->owned)
+		IOLockSleep (gate->lock, gate, THREAD_UNINT);
+	gate->owned = true;
+	IOLockUnlock (gate->lock);
+}
+
+static bool tryLockConfigGate( u3_pf_config_gate_t *gate )
+{
+	bool taken;
+
+	IOLockLock (gate->lock);
+	if ((taken = !gate->owned))
+		gate->owned = true;
+	IOLockUnlock (gate->lock);
+
+	return taken;
+}
+
+static void unlockConfigGate( u3_pf_config_gate_t *gate )
+{
+	IOLockLock (gate->lock);
+	gate->owned = false;
+	IOLockWakeup (gate->lock, gate, true);
+	IOLockUnlock (gate->lock);
+}
+
+// **********************************************************************************
+// U3PFRunPort
+//
+// A program's nub, config gate and ops on top of U3RegPort, for the runner in U3PFCompile.h
+// **********************************************************************************
+class U3PFRunPort : public U3RegPort
+{
+public:
+	U3PFRunPort( AppleU3 *uniN, u3_pf_program_t *program, IOPCIDevice *nub, void *param1 )
+		: U3RegPort(uniN), u3(uniN), program(program), nub(nub), param1(param1) {}
+
+	void lockGate(void)										{ lockConfigGate(program->configGate); }
+	void unlockGate(void)									{ unlockConfigGate(program->configGate); }
+	UInt32 configRead(UInt32 offset)						{ return nub->configRead32(offset); }
+	void configWrite(UInt32 offset, UInt32 data)			{ nub->configWrite32(offset, data); }
+	void execOp(const u3_pf_op_t *op, UInt32 *data, UInt32 lockDomains)
+		{ u3->execPlatformOp(program, op, nub, data, param1, lockDomains); }
+
+private:
+	AppleU3				*u3;
+	u3_pf_program_t		*program;
+	IOPCIDevice			*nub;
+	void				*param1;
+};
+
+// **********************************************************************************
+// performFunction
+//
+// Interprets a function that compilePlatformFunction rejected.  It takes the same locks as a
+// compiled program: its nub's config gate for the whole function, and the register's lock
+// domain around each register write.
+// **********************************************************************************
+bool AppleU3::performFunction(const IOPlatformFunction *func, void *cpfParam1,
+			void *cpfParam2, void *cpfParam3, void *cpfParam4)
+{
+	u3_pf_config_gate_t			*gate;
+	IOInterruptState			intState;
+	bool						ret;
+	IOPFCommandView				cmd;
+	UInt32 						offset, value, valueLen, mask, maskLen, data = 0, writeLen, 
+									pHandle, domain, lastCmd = 0;
+
+	IOPCIDevice					*nub = NULL;
+	
+	if (func == 0) return(false);
+	
+	// The cursor walks func's data in place - nothing to allocate, nothing to fail
+	IOPlatformFunctionCursor	cursor = func->getCommandCursor();
+
+	pHandle = func->getCommandPHandle();
+
+	// No gate only before start has built them, when nothing else can be running
+	if ((gate = findConfigGate (pHandle)) != NULL)
+		lockConfigGate (gate);
+	
+	ret = true;
+	while (ret && cursor.next (&cmd)) {
+		// Examine the command - not all commands are supported
+		switch (cmd.cmd) {
+			case kCommandWriteReg32:
+				offset = cmd.params[0];
+				value = cmd.params[1];
+				mask  = cmd.params[2];
+	// XXX This code is wrong  - it should just call safeWriteRegUInt32(offset, mask, value)
+	// XXX see also kCommandRMWConfig
+				domain = 1 << getRegLockDomain (offset);
+				intState = lockUniN (domain);
+
+				// If mask isn't all ones, keep the masked bits, then write the result to the Uni-N register
+				data = writeRegKeepingBits (offset, (mask != 0xFFFFFFFF) ? mask : 0, value);
+				
+				unlockUniN (domain, intState);
+				break;
+	
+			// Currently only handle config reads of 4 bytes or less
+			case kCommandReadConfig:
+				offset = cmd.params[0];
+				valueLen = cmd.params[1];
+				
+				if (valueLen != 4) {
+					IOLog ("AppleU3::performFunction config reads cannot handle anything other than 4 bytes, found length %ld\n", valueLen);
+					ret = false;
+					break;
+				}
+	
+				if (!nub) {
+					if (!pHandle) {
+						IOLog ("AppleU3::performFunction config read requires pHandle to locate nub\n");
+						ret = false;
+						break;
+					}
+					nub = findNubForPHandle (pHandle);
+					if (!nub) {
+						IOLog ("AppleU3::performFunction config read cannot find nub for pHandle 0x%08lx\n", pHandle);
+						ret = false;
+						break;
+					}
+				}
+				
+				// NOTE - code below assumes read of 4 bytes, i.e., valueLen == 4!!
+				data = nub->configRead32 (offset);
+				if (cpfParam1)
+					*(UInt32 *)cpfParam1 = data;
+				
+				lastCmd = kCommandReadConfig;
+				break;
+				
+			// Currently only handle config reads/writes of 4 bytes
+			case kCommandRMWConfig:
+				// data must have been read above
+				if (lastCmd != kCommandReadConfig) {
+					IOLog ("AppleU3::performFunction - config modify/write requires prior read\n");
+					ret = false;
+					break;
+				}
+				
+				offset = cmd.params[0];
+				maskLen = cmd.params[1];
+				valueLen = cmd.params[2];
+				writeLen = cmd.params[3];
+
+				if ((writeLen != 4) || (maskLen != 4) || (valueLen != 4)) {
+					IOLog ("AppleU3::performFunction config read/modify/write cannot handle anything other than 4 bytes, found length %ld\n", writeLen);
+					ret = false;
+					break;
+				}
+				
+				// The mask array is followed directly by the value array
+				mask = *(const UInt32 *)cmd.bytes;
+				value = *(const UInt32 *)(cmd.bytes + maskLen);
+	
+				// nub was found by the read, which must come first
+				
+				// data must have been previously read (i.e., using kCommandReadConfig with result in data)
+				data &= mask;
+				data |= value;
+				
+				nub->configWrite32 (offset, data);
+	
+				break;
+	
+			default:
+				IOLog("AppleU3::performFunction got unsupported command %08lx\n", cmd.cmd);
+				ret = false;
+				break;
+		}
+	}
+	
+	// A command the cursor couldn't walk fails the function, as a bad command did before
+	if (cursor.getError() != kIOPFNoError) {
+		IOLog("AppleU3::performFunction got malformed command, error %ld\n", cursor.getError());
+		ret = false;
+	}
+
+	if (gate)
+		unlockConfigGate (gate);
+
+	if (nub)
+		nub->release();
+
+	return(ret);
+}
+
+// **********************************************************************************
+// compilePlatformFunction
+//
+// Parses func's commands once and returns an equivalent program, or NULL if any command is
+// one performFunction would reject.  The nub is not looked up here - the PCI nubs for the
+// config commands are usually published after we start, and may come and go.
+// **********************************************************************************
+u3_pf_program_t *AppleU3::compilePlatformFunction( const IOPlatformFunction *func )
+{
+	IOPlatformFunctionCursor	cursor = func->getCommandCursor();
+	IOPFCommandView				cmd;
+	u3_pf_program_t				*program;
+	U3RegPort					port(this);
+	UInt32 						count, flags;
+	bool						haveParks;
+
+	// First pass counts the commands so the program is a single allocation
+	count = 0;
+	while (cursor.next (&cmd))
+		count++;
+
+	if ((count == 0) || (cursor.getError() != kIOPFNoError))
+		return NULL;
+
+	if (!(program = (u3_pf_program_t *) IOMalloc( U3_PF_PROGRAM_SIZE(count) )))
+		return NULL;
+
+	bzero (program, U3_PF_PROGRAM_SIZE(count));
+
+	if (U3CompilePFCommands (func->getCommandCursor(), func->getCommandPHandle(), program->ops, count, &flags) != count) {
+		IOFree (program, U3_PF_PROGRAM_SIZE(count));
+		return NULL;
+	}
+
+	program->opCount = count;
+	program->pHandle = (flags & kU3PFCompileConfig) ? func->getCommandPHandle() : 0;
+	haveParks = (flags & kU3PFCompileParks) != 0;
+
+	// Register writes and waits lock the domains of the registers they touch
+	program->regDomains = U3PFRegDomains (port, program->ops, count);
+
+	if (haveParks) {
+		if ((program->exec = (u3_pf_exec_t *) IOMalloc (sizeof(u3_pf_exec_t))) != NULL) {
+			bzero (program->exec, sizeof(u3_pf_exec_t));
+			program->exec->callout = thread_call_allocate ((thread_call_func_t) AppleU3::sResumePlatformProgram,
+				(thread_call_param_t) this);
+		}
+
+		if (!program->exec || !program->exec->callout) {
+			freePlatformProgram (program);
+			return NULL;
+		}
+	}
+
+	// Everything that talks to the same nub shares its config gate
+	if (program->pHandle && !(program->configGate = findConfigGate (program->pHandle))) {
+		freePlatformProgram (program);
+		return NULL;
+	}
+
+	return program;
+}
+
+// **********************************************************************************
+// freePlatformProgram
+//
+// **********************************************************************************
+void AppleU3::freePlatformProgram( u3_pf_program_t *program )
+{
+	if (program->exec) {
+		if (program->exec->callout) {
+			thread_call_cancel (program->exec->callout);
+			thread_call_free (program->exec->callout);
+		}
+		IOFree (program->exec, sizeof(u3_pf_exec_t));
+	}
+
+	IOFree (program, U3_PF_PROGRAM_SIZE(program->opCount));
+
+	return;
+}
+
+// **********************************************************************************
+// runPlatformProgram
+//
+// Runs a program built by compilePlatformFunction.  Every op was validated when it was
+// compiled, so the only thing that can fail here is finding the nub.
+//
+// A register-only program holds its register lock domains for the whole run, so it is atomic
+// against other programs and against safeWriteRegUInt32 on the same registers.  A program
+// with config ops holds its nub's config gate instead, and takes the register domains around
+// each register write - config cycles must not run with interrupts disabled.
+// **********************************************************************************
+bool AppleU3::runPlatformProgram( u3_pf_program_t *program, void *param1 )
+{
+	IOPCIDevice			*nub = NULL;
+	UInt32				data = 0;
+
+	// Looked up on every run - it's a hash probe, and it means a terminated nub is never used.
+	// The lookup retains the nub, so it stays valid across the config cycles.
+	if (program->pHandle && !(nub = findNubForPHandle (program->pHandle))) {
+		IOLog ("AppleU3::runPlatformProgram cannot find nub for pHandle 0x%08lx\n", program->pHandle);
+		return false;
+	}
+
+	U3PFRunPort port(this, program, nub, param1);
+
+	U3RunPFOps (port, program->ops, program->opCount, program->regDomains, program->configGate != NULL, &data);
+
+	if (nub)
+		nub->release();
+
+	return true;
+}
+
+// **********************************************************************************
+// execPlatformOp
+//
+// Runs one register or config op.  lockDomains is taken around a register write when the
+// caller doesn't already hold it, and is 0 when it does.
+// **********************************************************************************
+void AppleU3::execPlatformOp( u3_pf_program_t *program, const u3_pf_op_t *op, IOPCIDevice *nub, UInt32 *data,
+		void *param1, UInt32 lockDomains )
+{
+	U3PFRunPort			port(this, program, nub, param1);
+#ifdef U3_PF_TRACE
+	UInt64				startTime = mach_absolute_time();
+#endif
+
+	U3ExecPFOp (port, op, data, lockDomains);
+
+	if ((op->opcode == kU3PFOpReadConfig) && param1)
+		*(UInt32 *)param1 = *data;
+
+#ifdef U3_PF_TRACE
+	tracePlatformOp (program, op, mach_absolute_time() - startTime);
+#endif
+
+	return;
+}
+
+// **********************************************************************************
+// startPlatformProgram
+//
+// Starts a program that has Delay or WaitReg32 ops.  It runs on the caller's thread up to
+// its first park, and completion is called from whichever thread finishes it.
+// **********************************************************************************
+IOReturn AppleU3::startPlatformProgram( u3_pf_program_t *program, void *param1,
+		u3_pf_completion_t completion, void *refcon )
+{
+	if (!OSCompareAndSwap (0, 1, &program->exec->busy))
+		return kIOReturnBusy;
+
+	return beginPlatformProgram (program, param1, completion, refcon);
+}
+
+// **********************************************************************************
+// releasePlatformExec
+//
+// Marks exec idle and hands it to a synchronous caller waiting in runPlatformProgramAndWait
+// **********************************************************************************
+void AppleU3::releasePlatformExec( u3_pf_exec_t *exec )
+{
+	IOLockLock (pfLock);
+	exec->busy = 0;
+	IOLockWakeup (pfLock, exec, false);
+	IOLockUnlock (pfLock);
+}
+
+// **********************************************************************************
+// beginPlatformProgram
+//
+// The caller has already claimed program->exec
+// **********************************************************************************
+IOReturn AppleU3::beginPlatformProgram( u3_pf_program_t *program, void *param1,
+		u3_pf_completion_t completion, void *refcon )
+{
+	u3_pf_exec_t	*exec = program->exec;
+
+	exec->nub = NULL;
+	if (program->pHandle) {
+		if (!(exec->nub = findNubForPHandle (program->pHandle))) {
+			IOLog ("AppleU3::beginPlatformProgram cannot find nub for pHandle 0x%08lx\n", program->pHandle);
+			releasePlatformExec (exec);
+			return kIOReturnNoDevice;
+		}
+	}
+
+	exec->pc = 0;
+	exec->data = 0;
+	exec->param1 = param1;
+	exec->completion = completion;
+	exec->refcon = refcon;
+
+	stepPlatformProgram (program);
+
+	return kIOReturnSuccess;
+}
+
+// **********************************************************************************
+// sResumePlatformProgram
+//
+// **********************************************************************************
+void AppleU3::sResumePlatformProgram( thread_call_param_t self, thread_call_param_t program )
+{
+	((AppleU3 *) self)->stepPlatformProgram ((u3_pf_program_t *) program);
+}
+
+// **********************************************************************************
+// stepPlatformProgram
+//
+// Runs ops from exec->pc until the program parks or ends.  The nub's config gate is owned from
+// the first op to the last, parks included, so a config read, a delay and the write that
+// depends on the read are still atomic with respect to the nub.  Register lock domains can't
+// be held across a park; they are taken around each register access, so register ops in a
+// parked program are atomic one at a time only.
+// **********************************************************************************
+void AppleU3::stepPlatformProgram( u3_pf_program_t *program )
+{
+	u3_pf_exec_t		*exec = program->exec;
+	const u3_pf_op_t	*op;
+	u3_pf_completion_t	completion;
+	void				*refcon;
+	IOInterruptState	intState;
+	AbsoluteTime		deadline;
+	UInt32				regDomains, parkUS = 0;
+	IOReturn			result = kIOReturnSuccess;
+
+	// Take the domains even without a config gate - nothing is held across the park
+	regDomains = program->regDomains;
+
+	// Rather than block whatever thread we're on, wait for a busy gate by parking
+	if (program->configGate && !exec->ownsGate) {
+		if (!tryLockConfigGate (program->configGate)) {
+			clock_interval_to_deadline (kU3PFWaitPollMS * 1000, kMicrosecondScale, &deadline);
+			thread_call_enter1_delayed (exec->callout, (thread_call_param_t) program, deadline);
+			return;
+		}
+		exec->ownsGate = true;
+	}
+
+#ifdef U3_PF_TRACE
+	// Resuming after a delay completes it
+	if (exec->opStart && !exec->polls && exec->pc && (program->ops[exec->pc - 1].opcode == kU3PFOpDelay)) {
+		tracePlatformOp (program, &program->ops[exec->pc - 1], mach_absolute_time() - exec->opStart);
+		exec->opStart = 0;
+	}
+#endif
+
+	for ( ; !parkUS && (exec->pc < program->opCount); exec->pc++) {
+		op = &program->ops[exec->pc];
+
+		if (op->opcode == kU3PFOpDelay) {
+			// Skip the park for a zero delay, otherwise resume at the next op
+			parkUS = op->value;
+#ifdef U3_PF_TRACE
+			if (parkUS)
+				exec->opStart = mach_absolute_time();
+			else
+				tracePlatformOp (program, op, 0);
+#endif
+			continue;
+		}
+
+		if (op->opcode == kU3PFOpWaitReg) {
+			bool done;
+
+			intState = lockUniN (regDomains);
+			done = ((readUniNReg (op->offset) & op->keepMask) == op->value);
+			unlockUniN (regDomains, intState);
+
+			if (done) {
+#ifdef U3_PF_TRACE
+				tracePlatformOp (program, op, exec->polls ? (mach_absolute_time() - exec->opStart) : 0);
+				exec->opStart = 0;
+#endif
+				exec->polls = 0;
+				continue;
+			}
+
+			// First poll of this op arms the timeout
+			if (exec->polls == 0) {
+				exec->polls = kU3PFWaitTimeoutMS / kU3PFWaitPollMS;
+#ifdef U3_PF_TRACE
+				exec->opStart = mach_absolute_time();
+#endif
+			}
+			else if (--exec->polls == 0) {
+				IOLog ("AppleU3::stepPlatformProgram timed out waiting on register 0x%08lx\n", op->offset);
+				result = kIOReturnTimeout;
+				break;
+			}
+
+			// Resume at this op
+			parkUS = kU3PFWaitPollMS * 1000;
+			exec->pc--;
+			continue;
+		}
+
+		execPlatformOp (program, op, exec->nub, &exec->data, exec->param1, regDomains);
+	}
+
+	if (parkUS && (result == kIOReturnSuccess)) {
+		clock_interval_to_deadline (parkUS, kMicrosecondScale, &deadline);
+		thread_call_enter1_delayed (exec->callout, (thread_call_param_t) program, deadline);
+		return;
+	}
+
+	// Finished - free the executor before completing, so the completion may start us again.
+	// Once it is free another run may overwrite completion and refcon.
+	if (exec->ownsGate) {
+		unlockConfigGate (program->configGate);
+		exec->ownsGate = false;
+	}
+
+	if (exec->nub)
+		exec->nub->release();
+
+	completion = exec->completion;
+	refcon = exec->refcon;
+	exec->polls = 0;
+	releasePlatformExec (exec);
+
+	if (completion)
+		(*completion) (refcon, result);
+
+	return;
+}
+
+// **********************************************************************************
+// runPlatformProgramAndWait
+//
+// Synchronous calls to a program with Delay or WaitReg32 ops block here, not in the program,
+// so nothing else is held up while they sleep.  A call that finds the program's executor busy
+// waits for it, as callers of the same function always queued before the executor existed.
+// **********************************************************************************
+typedef struct _u3_pf_waiter_t
+{
+	IOLock		*lock;		// AppleU3's pfLock
+	bool		done;
+	IOReturn	result;
+} u3_pf_waiter_t;
+
+static void u3PFWaiterComplete( void *refcon, IOReturn result )
+{
+	u3_pf_waiter_t *waiter = (u3_pf_waiter_t *) refcon;
+
+	IOLockLock (waiter->lock);
+	waiter->result = result;
+	waiter->done = true;
+	IOLockWakeup (waiter->lock, waiter, false);
+	IOLockUnlock (waiter->lock);
+}
+
+bool AppleU3::runPlatformProgramAndWait( u3_pf_program_t *program, void *param1 )
+{
+	u3_pf_waiter_t	waiter;
+
+	waiter.lock = pfLock;
+	waiter.done = false;
+	waiter.result = kIOReturnSuccess;
+
+	IOLockLock (pfLock);
+	while (!OSCompareAndSwap (0, 1, &program->exec->busy))
+		IOLockSleep (pfLock, program->exec, THREAD_UNINT);
+	IOLockUnlock (pfLock);
+
+	if (beginPlatformProgram (program, param1, u3PFWaiterComplete, &waiter) != kIOReturnSuccess)
+		return false;
+
+	IOLockLock (pfLock);
+	while (!waiter.done)
+		IOLockSleep (pfLock, &waiter, THREAD_UNINT);
+	IOLockUnlock (pfLock);
+
+	return (waiter.result == kIOReturnSuccess);
+}
+
+// **********************************************************************************
+// performFunctionAsync
+//
+// **********************************************************************************
+IOReturn AppleU3::performFunctionAsync( const OSSymbol *functionName, void *param1,
+		u3_pf_completion_t completion, void *refcon )
+{
+	const u3_pf_dispatch_entry_t	*entry;
+	bool							ok;
+
+	if (!functionName || !(entry = lookupPlatformFunction (functionName)) || (entry->selector != kU3PFOnDemand))
+		return kIOReturnUnsupported;
+
+	if (entry->program && entry->program->exec)
+		return startPlatformProgram (entry->program, param1, completion, refcon);
+
+	// Nothing to park on - run it here and complete inline
+	if (entry->program)
+		ok = runPlatformProgram (entry->program, param1);
+	else
+		ok = performFunction (entry->func, param1);
+
+	if (completion)
+		(*completion) (refcon, ok ? kIOReturnSuccess : kIOReturnBadArgument);
+
+	return kIOReturnSuccess;
+}
+
+// **********************************************************************************
+// buildPowerPhase
+//
+// Compiles the platform functions carrying flag into powerPhases[phase].  Called once
+// from start, before anything can put us to sleep.
+// **********************************************************************************
+void AppleU3::buildPowerPhase( UInt32 phase, UInt32 flag )
+{
+	u3_power_phase_t	*powerPhase = &powerPhases[phase];
+	IOPlatformFunction	*func;
+	u3_pf_program_t		**programs, *program;
+	UInt32				i, j, count, funcCount, regCount;
+
+	if (!platformFuncArray || !(funcCount = platformFuncArray->getCount()))
+		return;
+
+	if (!(programs = (u3_pf_program_t **) IOMalloc (funcCount * sizeof(u3_pf_program_t *))))
+		return;
+
+	// Compile everything for this phase, in array order, and count the register-only writes
+	for (i = count = regCount = 0; i < funcCount; i++) {
+		if (!(func = OSDynamicCast (IOPlatformFunction, platformFuncArray->getObject(i))) ||
+			!(func->getCommandFlags() & flag))
+			continue;
+
+		if (!(program = compilePlatformFunction (func))) {
+			IOLog ("AppleU3::buildPowerPhase cannot run platform function %s\n",
+				func->getPlatformFunctionName() ? func->getPlatformFunctionName()->getCStringNoCopy() : "?");
+			continue;
+		}
+
+		if (!program->pHandle && !program->exec)
+			regCount += program->opCount;
+
+		programs[count++] = program;
+	}
+
+	if (regCount && (powerPhase->regBatch = (u3_reg_transaction_t *) IOMalloc (regCount * sizeof(u3_reg_transaction_t)))) {
+		// Merge the register-only programs, in array order
+		for (i = j = 0; i < count; i++) {
+			if ((program = programs[i])->pHandle || program->exec)
+				programs[j++] = program;
+			else {
+				u3_pf_op_t *op;
+
+				for (op = program->ops; op < &program->ops[program->opCount]; op++)
+					U3PFOpToRegWrite (op, &powerPhase->regBatch[powerPhase->regCount++]);
+
+				freePlatformProgram (program);
+			}
+		}
+		count = j;
+	}
+
+	// Stable insertion sort by pHandle, so each nub's programs run together and in array order
+	for (i = 1; i < count; i++) {
+		program = programs[i];
+		for (j = i; (j > 0) && (programs[j - 1]->pHandle > program->pHandle); j--)
+			programs[j] = programs[j - 1];
+		programs[j] = program;
+	}
+
+	if (count && (powerPhase->nubs = (IOPCIDevice **) IOMalloc (funcCount * sizeof(IOPCIDevice *)))) {
+		bzero (powerPhase->nubs, funcCount * sizeof(IOPCIDevice *));
+		powerPhase->programs = programs;
+		powerPhase->programCount = count;
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+		freePlatformProgram (programs[i]);
+
+	IOFree (programs, funcCount * sizeof(u3_pf_program_t *));
+
+	return;
+}
+
+// **********************************************************************************
+// freePowerPhase
+//
+// **********************************************************************************
+void AppleU3::freePowerPhase( u3_power_phase_t *powerPhase )
+{
+	UInt32	i, size;
+
+	// programs and nubs were sized from platformFuncArray, which we still hold
+	size = platformFuncArray ? platformFuncArray->getCount() : 0;
+
+	if (powerPhase->regBatch)
+		IOFree (powerPhase->regBatch, powerPhase->regCount * sizeof(u3_reg_transaction_t));
+
+	for (i = 0; i < powerPhase->programCount; i++) {
+		if (powerPhase->nubs[i])
+			powerPhase->nubs[i]->release();
+		freePlatformProgram (powerPhase->programs[i]);
+	}
+
+	if (powerPhase->programs) {
+		IOFree (powerPhase->programs, size * sizeof(u3_pf_program_t *));
+		IOFree (powerPhase->nubs, size * sizeof(IOPCIDevice *));
+	}
+
+	bzero (powerPhase, sizeof(u3_power_phase_t));
+
+	return;
+}
+
+// **********************************************************************************
+// resolvePowerPhaseNubs
+//
+// Called from prepareForSleep, on a thread, ahead of both phases
+// **********************************************************************************
+void AppleU3::resolvePowerPhaseNubs( u3_power_phase_t *powerPhase )
+{
+	IOPCIDevice	*nub;
+	UInt32		i;
+
+	for (i = 0; i < powerPhase->programCount; i++) {
+		if (!powerPhase->programs[i]->pHandle)
+			continue;
+
+		nub = findNubForPHandle (powerPhase->programs[i]->pHandle);
+
+		if (powerPhase->nubs[i])
+			powerPhase->nubs[i]->release();
+
+		powerPhase->nubs[i] = nub;
+	}
+
+	return;
+}
+
+// **********************************************************************************
+// runPowerPhase
+//
+// Called from uniNSetPowerState, uniNWakeComplete and uniNSetBusSpeed, which may be at
+// interrupt context and must not block.  parts says which of the phase to run.
+// **********************************************************************************
+void AppleU3::runPowerPhase( UInt32 phase, UInt32 parts )
+{
+	u3_power_phase_t	*powerPhase = &powerPhases[phase];
+	UInt64				startTime, elapsed;
+	UInt32				i, failures = 0;
+
+	if (!powerPhase->regCount && !powerPhase->programCount)
+		return;
+
+	startTime = mach_absolute_time();
+
+	if ((parts & kU3PowerPhaseRegs) && powerPhase->regCount)
+		safeRegTransaction (powerPhase->regBatch, powerPhase->regCount);
+
+	if (parts & kU3PowerPhasePrograms)
+		for (i = 0; i < powerPhase->programCount; i++)
+			if ((powerPhase->programs[i]->pHandle && !powerPhase->nubs[i]) ||
+				!runPowerProgram (powerPhase->programs[i], powerPhase->nubs[i]))
+				failures++;
+
+	elapsed = mach_absolute_time() - startTime;
+
+	if (statsPage) {
+		u3_power_phase_stats_t *stats = &statsPage->powerPhase[phase];
+
+		// A phase run in parts counts once, and its time is the sum of the parts
+		if (parts & kU3PowerPhaseRegs) {
+			stats->runs++;
+			stats->lastTime = elapsed;
+		} else
+			stats->lastTime += elapsed;
+
+		stats->regCount = powerPhase->regCount;
+		stats->programCount = powerPhase->programCount;
+		stats->failures += failures;
+		if (stats->lastTime > stats->maxTime)
+			stats->maxTime = stats->lastTime;
+	}
+
+	return;
+}
+
+// **********************************************************************************
+// runPowerProgram
+//
+// Nothing can park here, so Delay and WaitReg32 spin.  A WaitReg32 spins for at most
+// kU3PowerWaitTimeoutUS, not the kU3PFWaitTimeoutMS a parked program gets, and a timeout fails
+// the program, which runPowerPhase counts against the phase.  The config gates were taken for the
+// whole transition by prepareForSleep; if they weren't, the gate can't be waited for here,
+// so a program with config ops fails instead.
+// **********************************************************************************
+bool AppleU3::runPowerProgram( u3_pf_program_t *program, IOPCIDevice *nub )
+{
+	const u3_pf_op_t	*op;
+	IOInterruptState	intState;
+	UInt32				data = 0, polls;
+	bool				done;
+#ifdef U3_PF_TRACE
+	UInt64				startTime;
+#endif
+
+	if (program->configGate && !powerGatesOwned)
+		return false;
+
+	for (op = program->ops; op < &program->ops[program->opCount]; op++)
+		switch (op->opcode) {
+			case kU3PFOpDelay:
+#ifdef U3_PF_TRACE
+				startTime = mach_absolute_time();
+#endif
+				IODelay (op->value);
+#ifdef U3_PF_TRACE
+				tracePlatformOp (program, op, mach_absolute_time() - startTime);
+#endif
+				break;
+
+			case kU3PFOpWaitReg:
+#ifdef U3_PF_TRACE
+				startTime = mach_absolute_time();
+#endif
+				for (polls = kU3PowerWaitTimeoutUS / kU3PowerPollUS; ; polls--) {
+					intState = lockUniN (program->regDomains);
+					done = ((readUniNReg (op->offset) & op->keepMask) == op->value);
+					unlockUniN (program->regDomains, intState);
+
+					if (done)
+						break;
+
+					if (polls == 0) {
+#ifdef U3_PF_TRACE
+						tracePlatformOp (program, op, mach_absolute_time() - startTime);
+#endif
+						return false;
+					}
+
+					IODelay (kU3PowerPollUS);
+				}
+#ifdef U3_PF_TRACE
+				tracePlatformOp (program, op, mach_absolute_time() - startTime);
+#endif
+				break;
+
+			default:
+				execPlatformOp (program, op, nub, &data, NULL, program->regDomains);
+				break;
+		}
+
+	return true;
+}
+
+#ifdef U3_PF_TRACE
+// **********************************************************************************
+// tracePlatformOp
+//
+// The caller holds whatever serializes runs of program, so the ring needs no lock of its own
+// **********************************************************************************
+void AppleU3::tracePlatformOp( u3_pf_program_t *program, const u3_pf_op_t *op, UInt64 elapsed )
+{
+	u3_pf_trace_record_t *record;
+
+	record = &program->trace.records[program->trace.head++ & (kU3PFTraceEntries - 1)];
+	record->opcode = op->opcode;
+	record->offset = (op->opcode == kU3PFOpDelay) ? op->value : op->offset;
+	record->elapsed = (elapsed > 0xFFFFFFFFULL) ? 0xFFFFFFFF : (UInt32) elapsed;
+
+	return;
+}
+
+// **********************************************************************************
+// addPlatformFunctionTrace
+//
+// A run in progress may tear the record being written; this is a debugging aid only.
+// **********************************************************************************
+void AppleU3::addPlatformFunctionTrace( OSDictionary *dict, const OSSymbol *name, const u3_pf_program_t *program )
+{
+	OSArray					*records;
+	OSDictionary			*entry;
+	OSNumber				*number;
+	const u3_pf_trace_record_t	*record;
+	UInt32					head, i, first;
+
+	if (!name || !(head = program->trace.head))
+		return;
+
+	first = (head > kU3PFTraceEntries) ? (head - kU3PFTraceEntries) : 0;
+	if ((records = OSArray::withCapacity (head - first)) == NULL)
+		return;
+
+	for (i = first; i < head; i++) {
+		record = &program->trace.records[i & (kU3PFTraceEntries - 1)];
+
+		if ((entry = OSDictionary::withCapacity (3)) == NULL)
+			continue;
+
+		if (number = OSNumber::withNumber (record->opcode, 32)) {
+			entry->setObject (kU3PFTraceOpKey, number);
+			number->release();
+		}
+		if (number = OSNumber::withNumber (record->offset, 32)) {
+			entry->setObject (kU3PFTraceOffsetKey, number);
+			number->release();
+		}
+		if (number = OSNumber::withNumber (record->elapsed, 32)) {
+			entry->setObject (kU3PFTraceTimeKey, number);
+			number->release();
+		}
+
+		records->setObject (entry);
+		entry->release();
+	}
+
+	dict->setObject (name, records);
+	records->release();
+
+	return;
+}
+
+// **********************************************************************************
+// copyPlatformFunctionTrace
+//
+// On-demand functions appear under their own names.  The power phase functions may not
+// have one, so they appear as OnSleep-n, OnWake-n and so on, n being their position in the phase.
+// **********************************************************************************
+OSDictionary *AppleU3::copyPlatformFunctionTrace( void )
+{
+	static const char * const	phaseNames[kU3NumPowerPhases] = { "OnSleep", "OnWake", "HighSpeed", "LowSpeed" };
+	OSDictionary				*dict;
+	const OSSymbol				*name;
+	char						nameBuf[32];
+	UInt32						i, phase;
+
+	if ((dict = OSDictionary::withCapacity (8)) == NULL)
+		return NULL;
+
+	for (i = 0; pfDispatchTable && (i <= pfDispatchMask); i++)
+		if (pfDispatchTable[i].program)
+			addPlatformFunctionTrace (dict, pfDispatchTable[i].key, pfDispatchTable[i].program);
+
+	for (phase = 0; phase < kU3NumPowerPhases; phase++)
+		for (i = 0; i < powerPhases[phase].programCount; i++) {
+			snprintf (nameBuf, sizeof(nameBuf), "%s-%ld", phaseNames[phase], i);
+			if ((name = OSSymbol::withCString (nameBuf)) != NULL) {
+				addPlatformFunctionTrace (dict, name, powerPhases[phase].programs[i]);
+				name->release();
+			}
+		}
+
+	return dict;
+}
+#endif
+
+// **********************************************************************************
+// findNubForPHandle
+//
+// Answered from the phandle index when we have one.  The device tree walk is only used if
+// the notifications could not be installed, or for a nub that is attached to the device
+// tree but not yet registered.  The nub is returned retained, the caller releases it.
+// **********************************************************************************
+IOPCIDevice* AppleU3::findNubForPHandle( UInt32 pHandleValue )
+{
+	IORegistryIterator*								iterator;
+	IORegistryEntry*								matchingEntry = NULL;
+	IOPCIDevice*									nub;
+
+	if ((nub = lookupPHandle (pHandleValue)) != NULL)
+		return nub;
+
+	iterator = IORegistryIterator::iterateOver( gIODTPlane, kIORegistryIterateRecursively );
+
+	if ( iterator == NULL )
+		return( NULL );
+
+	while ( ( matchingEntry = iterator->getNextObject() ) != NULL ) {
+		OSData*						property;
+
+		if ( ( property = OSDynamicCast( OSData, matchingEntry->getProperty( "AAPL,phandle" ) ) ) != NULL )
+			if ( pHandleValue == *( ( UInt32 * ) property->getBytesNoCopy() ) )
+				break;
+	}
+	
+	// Retain before the iterator lets go of the entry
+	if ( ( nub = OSDynamicCast (IOPCIDevice, matchingEntry) ) != NULL )
+		nub->retain();
+
+	iterator->release();
+	
+	return( nub );
+}
+
+// **********************************************************************************
+// sPCINubPublished, sPCINubTerminated
+//
+// IOPCIDevice notification handlers - keep the phandle index in step with the registry
+// **********************************************************************************
+bool AppleU3::sPCINubPublished( void *target, void *refCon, IOService *newService )
+{
+	IOPCIDevice *nub;
+
+	if ((nub = OSDynamicCast (IOPCIDevice, newService)) != NULL)
+		((AppleU3 *) target)->addPHandleEntry (nub);
+
+	return true;
+}
+
+bool AppleU3::sPCINubTerminated( void *target, void *refCon, IOService *newService )
+{
+	IOPCIDevice *nub;
+
+	if ((nub = OSDynamicCast (IOPCIDevice, newService)) != NULL)
+		((AppleU3 *) target)->removePHandleEntry (nub);
+
+	return true;
+}
+
+// **********************************************************************************
+// addPHandleEntry
+//
+// **********************************************************************************
+void AppleU3::addPHandleEntry( IOPCIDevice *nub )
+{
+	OSData				*property;
+	u3_phandle_entry_t	*entry, **bucket;
+	UInt32				pHandleValue;
+
+	if ((property = OSDynamicCast( OSData, nub->getProperty( "AAPL,phandle" ) )) == NULL)
+		return;
+
+	pHandleValue = *( ( UInt32 * ) property->getBytesNoCopy() );
+
+	// Allocate outside the lock; it's rare for the nub to be in the index already
+	if ((entry = (u3_phandle_entry_t *) IOMalloc (sizeof(u3_phandle_entry_t))) == NULL)
+		return;
+
+	entry->pHandle = pHandleValue;
+	entry->nub = nub;
+	nub->retain();
+
+	bucket = &pHandleIndex[U3_PHANDLE_HASH(pHandleValue) & (kU3PHandleBuckets - 1)];
+
+	IOLockLock (pHandleLock);
+	entry->next = *bucket;
+	*bucket = entry;
+	IOLockUnlock (pHandleLock);
+
+	return;
+}
+
+// **********************************************************************************
+// removePHandleEntry
+//
+// **********************************************************************************
+void AppleU3::removePHandleEntry( IOPCIDevice *nub )
+{
+	u3_phandle_entry_t	*entry = NULL, **link;
+	UInt32				i;
+
+	// The phandle property may be gone by now, so search every bucket for the nub
+	IOLockLock (pHandleLock);
+	for (i = 0; (i < kU3PHandleBuckets) && !entry; i++)
+		for (link = &pHandleIndex[i]; *link; link = &(*link)->next)
+			if ((*link)->nub == nub) {
+				entry = *link;
+				*link = entry->next;
+				break;
+			}
+	IOLockUnlock (pHandleLock);
+
+	if (entry) {
+		entry->nub->release();
+		IOFree (entry, sizeof(u3_phandle_entry_t));
+	}
+
+	return;
+}
+
+// **********************************************************************************
+// lookupPHandle
+//
+// Returns NULL if the index doesn't have pHandleValue.  The nub is retained while the
+// index lock is held, so a terminate that drops the entry can't free it under the caller.
+// **********************************************************************************
+IOPCIDevice *AppleU3::lookupPHandle( UInt32 pHandleValue )
+{
+	u3_phandle_entry_t	*entry;
+	IOPCIDevice			*nub = NULL;
+
+	if (!pHandleLock)
+		return NULL;
+
+	IOLockLock (pHandleLock);
+	for (entry = pHandleIndex[U3_PHANDLE_HASH(pHandleValue) & (kU3PHandleBuckets - 1)]; entry; entry = entry->next)
+		if (entry->pHandle == pHandleValue) {
+			nub = entry->nub;
+			nub->retain();
+			break;
+		}
+	IOLockUnlock (pHandleLock);
+
+	return nub;
+}
+
+// **********************************************************************************
+// uniNSetBusSpeed
+//
+// Called from MacRISC4CPU::quiesceCPU just before it asks the PMU to change processor speed,
+// so like the sleep phase this runs where we can't block.  The nubs for any config cycles were
+// found by prepareForSleep on the way down.
+//
+// Uni-N has to suit the slower speed for the length of the change: the low speed functions
+// run before slowing down, the high speed functions from kUniNNormal, after speeding up.
+// **********************************************************************************
+void AppleU3::uniNSetBusSpeed ( UInt32 speed )
+{
+	if (speed == 0)
+		highSpeedPending = true;
+	else
+		runPowerPhase (kU3PowerPhaseLowSpeed, kU3PowerPhaseAll);
+
 	return;
 }
 
 // **********************************************************************************
-// performFunction
+// uniNBeginSpeedChange
 //
+// Called from MacRISC4CPU::quiesceCPU ahead of kUniNSave.  A speed change doesn't cycle the
+// PCI bridges or power anything down, so the sleep and wake functions have nothing to do;
+// the high and low speed functions run instead, see uniNSetBusSpeed.  The kUniNNormal that
+// ends the change clears this.
 // **********************************************************************************
-bool AppleU3::performFunction(const IOPlatformFunction *func, void *cpfParam1,
-			void *cpfParam2, void *cpfParam3, void *cpfParam4)
+void AppleU3::uniNBeginSpeedChange ( void )
 {
-	static IOLock				*pfLock;
-	bool						ret;
-	IOPlatformFunctionIterator 	*iter;
-	UInt32 						offset, value, valueLen, mask, maskLen, data = 0, writeLen, 
-									cmd, cmdLen, result, pHandle, lastCmd = 0,
-									param1, param2, param3, param4, param5, 
-									param6, param7, param8, param9, param10;
-
-	IOPCIDevice					*nub = NULL;
-	
-	if (func == 0) return(false);
-	
-	if (!pfLock)
-		// Use a static lock here as there is only ever one instance of U3
-		pfLock = IOLockAlloc();
-	
-	if (pfLock)
-		IOLockLock (pfLock);
+	speedChangeInProgress = true;
 
-	if (!(iter = ((IOPlatformFunction *)func)->getCommandIterator())) {
-		if (pfLock)
-			IOLockUnlock (pfLock);
-
-		return false;
-	}
+	return;
+}
 
-	pHandle = func->getCommandPHandle();
-	
-	ret = true;
-	while (iter->getNextCommand (&cmd, &cmdLen, &param1, &param2, &param3, &param4, 
-		&param5, &param6, &param7, &param8, &param9, &param10, &result)  && ret) {
-		if (result != kIOPFNoError)
-			ret = false;
-		else
-			// Examine the command - not all commands are supported
-			switch (cmd) {
-				case kCommandWriteReg32:
-					offset = param1;
-					value = param2;
-					mask  = param3;
-		// XXX This code is wrong  - it should just call safeWriteRegUInt32(offset, mask, value)
-		// XXX see also kCommandRMWConfig
-					// If mask isn't all ones, read data and mask it
-					if (mask != 0xFFFFFFFF) {
-						data = readUniNReg (offset);
-						data &= mask;
-						data |= value;
-					} else	// just write the data
-						data = value;
-					
-					// write the result to the Uni-N register
-					writeUniNReg(offset, data);
-					
-					break;
-		
-				// Currently only handle config reads of 4 bytes or less
-				case kCommandReadConfig:
-					offset = param1;
-					valueLen = param2;
-					
-					if (valueLen != 4) {
-						IOLog ("AppleU3::performFunction config reads cannot handle anything other than 4 bytes, found length %ld\n", valueLen);
-						ret = false;
-					}
-		
-					if (!nub) {
-						if (!pHandle) {
-							IOLog ("AppleU3::performFunction config read requires pHandle to locate nub\n");
-							ret = false;
-						}
-						nub = findNubForPHandle (pHandle);
-						if (!nub) {
-							IOLog ("AppleU3::performFunction config read cannot find nub for pHandle 0x%08lx\n", pHandle);
-							ret = false;
-						}
-					}
-					
-					// NOTE - code below assumes read of 4 bytes, i.e., valueLen == 4!!
-					data = nub->configRead32 (offset);
-					if (cpfParam1)
-						*(UInt32 *)cpfParam1 = data;
-					
-					lastCmd = kCommandReadConfig;
-					break;
-					
-				// Currently only handle config reads/writes of 4 bytes
-				case kCommandRMWConfig:
-					// data must have been read above
-					if (lastCmd != kCommandReadConfig) {
-						IOLog ("AppleU3::performFunction - config modify/write requires prior read\n");
-						ret = false;
-					}
-					
-					offset = param1;
-					maskLen = param2;
-					valueLen = param3;
-					writeLen = param4;
-	
-					if (writeLen != 4) {
-						IOLog ("AppleU3::performFunction config read/modify/write cannot handle anything other than 4 bytes, found length %ld\n", writeLen);
-						ret = false;
-					}
-					
-					// NOTE - code below makes implicit assumption that mask and value are each 4 bytes!!
-					mask = *(UInt32 *)param5;
-					value = *(UInt32 *)param6;
-		
-					if (!nub) {
-						if (!pHandle) {
-							IOLog ("AppleU3::performFunction config read/modify/write requires pHandle to locate nub\n");
-							ret = false;
-						}
-						nub = findNubForPHandle (pHandle);
-						if (!nub) {
-							IOLog ("AppleU3::performFunction config read/modify/write cannot find nub for pHandle 0x%08lx\n", pHandle);
-							ret = false;
-						}
-					}
-					
-					// data must have been previously read (i.e., using kCommandReadConfig with result in data)
-					data &= mask;
-					data |= value;
-					
-					nub->configWrite32 (offset, data);
-		
-					break;
-		
-				default:
-					IOLog("AppleU3::performFunction got unsupported command %08lx\n", cmd);
-					ret = false;
-					break;
-		}
+// **********************************************************************************
+// uniNWakeComplete
+//
+// Called from MacRISC4CPU::initCPU once it has restored the top-level PCI bridges and KeyLargo.
+// Runs the wake functions that kUniNNormal held back, which may do config cycles through those
+// bridges.  Like the rest of initCPU, this must not block.
+// **********************************************************************************
+void AppleU3::uniNWakeComplete ( void )
+{
+	if (wakeProgramsPending) {
+		wakeProgramsPending = false;
+		runPowerPhase (kU3PowerPhaseWake, kU3PowerPhasePrograms);
 	}
-	
-	iter->release();
 
-	if (pfLock)
-		IOLockUnlock (pfLock);
+	// That was the last of the transition, so the config gates can go back
+	if (powerGatesOwned)
+		thread_call_enter (powerGateCallout);
 
-	return(ret);
+	return;
 }
 
-IOPCIDevice* AppleU3::findNubForPHandle( UInt32 pHandleValue )
+// **********************************************************************************
+// releasePowerGates
+//
+// Gives back the config gates prepareForSleep took.  Run from powerGateCallout, since the
+// transition ends where we can't take the gates' locks.
+// **********************************************************************************
+void AppleU3::sReleasePowerGates( thread_call_param_t self, thread_call_param_t )
 {
-	IORegistryIterator*								iterator;
-	IORegistryEntry*								matchingEntry = NULL;
+	((AppleU3 *) self)->releasePowerGates ();
+}
 
-	iterator = IORegistryIterator::iterateOver( gIODTPlane, kIORegistryIterateRecursively );
+void AppleU3::releasePowerGates( void )
+{
+	UInt32 i;
 
-	if ( iterator == NULL )
-		return( NULL );
+	if (!powerGatesOwned)
+		return;
 
-	while ( ( matchingEntry = iterator->getNextObject() ) != NULL ) {
-		OSData*						property;
+	powerGatesOwned = false;
+	for (i = 0; i < configGateCount; i++)
+		unlockConfigGate (&configGates[i]);
 
-		if ( ( property = OSDynamicCast( OSData, matchingEntry->getProperty( "AAPL,phandle" ) ) ) != NULL )
-			if ( pHandleValue == *( ( UInt32 * ) property->getBytesNoCopy() ) )
-				break;
-	}
-	
-	iterator->release();
-	
-	return( OSDynamicCast (IOPCIDevice, matchingEntry));
+	return;
 }
 
 void AppleU3::prepareForSleep ( void )
 {
 	IOService *service;
+	UInt32 i;
 	static bool noGolem, noSPU;
 	
 	// Find the K2 driver
@@ -637,17 +2640,28 @@ void AppleU3::prepareForSleep ( void )
 			noGolem = true;			// Set noGolem true so we don't keep looking for it
 	}
 
+	// The power phases run where we can't look nubs up, so find them now
+	for (i = 0; i < kU3NumPowerPhases; i++)
+		resolvePowerPhaseNubs (&powerPhases[i]);
+
+	// Nor can they wait for a config gate.  Take them all now, which lets any program parked
+	// on one finish first, and keep them until the transition ends.  Everything else that does
+	// config cycles through our nubs waits or parks until then.
+	if (!powerGatesOwned) {
+		for (i = 0; i < configGateCount; i++)
+			lockConfigGate (&configGates[i]);
+		powerGatesOwned = true;
+	}
+
 	return;
 }
 
 
 bool AppleU3::getHTLinkFrequency (UInt32 *freqResult)
 {
-	UInt32			freq;
+	U3RegPort		port(this);
 
-	freq = safeReadRegUInt32 (kU3HTLinkFreqRegister);
-	freq = (freq >> 8) & 0xF;
-	*freqResult = freq;
+	*freqResult = U3GetHTLinkFrequency<U3UniNRegs>( port, gU3RegAccessIndex );
 	
 	return true;
 }
@@ -655,12 +2669,9 @@ bool AppleU3::getHTLinkFrequency (UInt32 *freqResult)
 // See getHTLinkFrequency for interpretation of newFreq
 bool AppleU3::setHTLinkFrequency (UInt32 newFreq)
 {
-	UInt32			freq;
+	U3RegPort		port(this);
 
-	// Read current 32-bit value
-	freq = safeReadRegUInt32 (kU3HTLinkFreqRegister);
-	freq = (freq & 0xFFFFF0FF) | (newFreq << 8);
-	safeWriteRegUInt32 (kU3HTLinkFreqRegister, ~0UL, freq);
+	U3SetHTLinkFrequency<U3UniNRegs>( port, newFreq );
 	
 	return true;
 }
@@ -668,11 +2679,9 @@ bool AppleU3::setHTLinkFrequency (UInt32 newFreq)
 
 bool AppleU3::getHTLinkWidth (UInt32 *linkOutWidthResult, UInt32 *linkInWidthResult)
 {
-	UInt32			width;
+	U3RegPort		port(this);
 
-	width = safeReadRegUInt32 (kU3HTLinkConfigRegister);
-	*linkOutWidthResult = (width >> 28) & 0x7;
-	*linkInWidthResult = (width >> 24) & 0x7;
+	U3GetHTLinkWidth<U3UniNRegs>( port, gU3RegAccessIndex, linkOutWidthResult, linkInWidthResult );
 	
 	return true;
 }
@@ -680,11 +2689,10 @@ bool AppleU3::getHTLinkWidth (UInt32 *linkOutWidthResult, UInt32 *linkInWidthRes
 // See getHTLinkWidth for interpretation of newFreq
 bool AppleU3::setHTLinkWidth (UInt32 newLinkOutWidth, UInt32 newLinkInWidth)
 {
-	UInt32			width;
+	U3RegPort		port(this);
 
-	width = safeReadRegUInt32 (kU3HTLinkConfigRegister);
-	width = (width & 0x88FFFFFF) | (newLinkOutWidth << 28) | (newLinkInWidth << 24);
-	safeWriteRegUInt32 (kU3HTLinkConfigRegister, ~0UL, width);
+	// Both widths go out in one masked write
+	U3SetHTLinkWidth<U3UniNRegs>( port, newLinkOutWidth, newLinkInWidth );
 	
 	return true;
 }	
@@ -727,7 +2735,7 @@ IOReturn AppleU3::installChipFaultHandler ( IOService * provider )
 	// We should have a chip fault signal on U3-Lite, U3-Heavy and U4
 	if (provider->getProperty(kChipFaultFuncName) == NULL)
 	{
-		if ( IS_U3_HEAVY(uniNVersion) || IS_U4(uniNVersion) )
+		if ( chipMap->expectChipFault )
 			kprintf("AppleU3: WARNING: %s property expected, but not found\n", kChipFaultFuncName );
 	
 		return kIOReturnUnsupported;
@@ -749,10 +2757,7 @@ IOReturn AppleU3::installChipFaultHandler ( IOService * provider )
 	symChipFaultFunc = OSSymbol::withCString(stringBuf); 
 
 	// Mask all chip fault sources.  Bits that we want unmasked will be handled separately.
-	if ( IS_U4(uniNVersion) )
-		safeWriteRegUInt32 ( kU4APIMask1Register, ~0UL, 0 );
-	else
-		safeWriteRegUInt32 ( kU3ChipFaultMaskRegister, ~0UL, 0 );
+	safeWriteRegUInt32 ( chipMap->faultMaskReg, ~0UL, 0 );
 
 	// register for notifications
 	return callPlatformFunction(symChipFaultFunc, TRUE,
@@ -766,297 +2771,347 @@ IOReturn AppleU3::installChipFaultHandler ( IOService * provider )
 //
 // **********************************************************************************
 
-// Use this Syndrome Table to match against the MESR to determine exactly
-// which bit was corrected [0:127].  Note: this only works for correctable 1-bit
-// errors -- with uncorrectable errors, we can only know the rank.
-#define kECCAllBits 144
-UInt32 SyndromeTable[kECCAllBits] =
-{
-        0x0849 , 0x0428 , 0x0214 , 0x01C2 , 0x9084 , 0x8042 , 0x4021 , 0x201C , 0x4908 ,
-        0x2804 , 0x1402 , 0xC201 , 0x8490 , 0x4280 , 0x2140 , 0x1C20 , 0x0894 , 0x0482 ,
-        0x0241 , 0x012C , 0x4089 , 0x2048 , 0x1024 , 0xC012 , 0x9408 , 0x8204 , 0x4102 ,
-        0x2C01 , 0x8940 , 0x4820 , 0x2410 , 0x12C0 , 0x0881 , 0x044C , 0x0226 , 0x0113 ,
-        0x1088 , 0xC044 , 0x6022 , 0x3011 , 0x8108 , 0x4C04 , 0x2602 , 0x1301 , 0x8810 ,
-        0x44C0 , 0x2260 , 0x1130 , 0x0288 , 0x0144 , 0x0C22 , 0x0611 , 0x8028 , 0x4014 ,
-        0x20C2 , 0x1061 , 0x8802 , 0x4401 , 0x220C , 0x1106 , 0x2880 , 0x1440 , 0xC220 ,
-        0x6110 , 0x0B48 , 0x0924 , 0x0812 , 0x04C1 , 0x80B4 , 0x4092 , 0x2081 , 0x104C ,
-        0x480B , 0x2409 , 0x1208 , 0xC104 , 0xB480 , 0x9240 , 0x8120 , 0x4C10 , 0x0198 ,
-        0x0C84 , 0x0642 , 0x0321 , 0x8019 , 0x40C8 , 0x2064 , 0x1032 , 0x9801 , 0x840C ,
-        0x4206 , 0x2103 , 0x1980 , 0xC840 , 0x6420 , 0x3210 , 0x0868 , 0x0434 , 0x02D2 ,
-        0x01A1 , 0x8086 , 0x4043 , 0x202D , 0x101A , 0x6808 , 0x3404 , 0xD202 , 0xA101 ,
-        0x8680 , 0x4340 , 0x2D20 , 0x1A10 , 0x8884 , 0x4442 , 0x2221 , 0x111C , 0x4888 ,
-        0x2444 , 0x1222 , 0xC111 , 0x8488 , 0x4244 , 0x2122 , 0x1C11 , 0x8848 , 0x4424 ,
-        0x2212 , 0x11C1 , 0x8000 , 0x4000 , 0x2000 , 0x1000 , 0x0800 , 0x0400 , 0x0200 ,
-        0x0100 , 0x0080 , 0x0040 , 0x0020 , 0x0010 , 0x0008 , 0x0004 , 0x0002 , 0x0001
-};
-
-
-
-
-
 /* static */	/* executing on system workloop */
 void AppleU3::sHandleChipFault( void * vSelf, void * vRefCon, void * /* NULL */, void * /* unused */ )
 {
-UInt32	apiexcp, mear, mear1, mesr, rank, dimmloc, savedMaskRegister;
-char	errstr[128];
-
 	AppleU3 * me = OSDynamicCast( AppleU3, (OSMetaClassBase *) vSelf );
 
 	// don't use 'me' before we check to make sure it's okay
 	if (!me) return;
 
-	// Mask all chip fault sources.
-	if ( IS_U4(me->uniNVersion) )
-	{
-		savedMaskRegister = me->safeReadRegUInt32( kU4APIMask1Register );
-		me->safeWriteRegUInt32 ( kU4APIMask1Register, ~0UL, 0 );
-	}
-	else
-	{
-		savedMaskRegister = me->safeReadRegUInt32( kU3ChipFaultMaskRegister );
-		me->safeWriteRegUInt32 ( kU3ChipFaultMaskRegister, ~0UL, 0 );
-	}
+	(me->*me->chipMap->chipFault)( vRefCon );
+}
+
+// **********************************************************************************
+// chipFaultFor
+//
+// Per-variant chip fault handler, reached through chipMap.  Register offsets and bits
+// come from U3ChipTraits so the handler is straight-line for each chip.
+//
+// **********************************************************************************
+template <UInt32 Variant> void AppleU3::chipFaultFor( void *refcon )
+{
+U3RegPort				port(this);
+UInt32					savedMaskRegister;
+u3_chip_fault_state_t	state;
 
-	// read the APIEXCP register to find out the source of this event. 
+	// Mask all chip fault sources and read the APIEXCP register to find out the source of
+	// this event, in one locked transaction, then capture the rest of the error state.
 	// **************************i*********************************
 	// NOTE - the read operation causes the faults to be cleared.
 	// **************************i*********************************
-	if ( IS_U4(me->uniNVersion) )
-		apiexcp = me->safeReadRegUInt32( kU4APIExceptionRegister );
-	else
-		apiexcp = me->safeReadRegUInt32( kU3APIExceptionRegister );
+	savedMaskRegister = U3CaptureChipFault< U3ChipTraits<Variant> >( port, gU3RegAccessIndex, &state );
 
-	// Catch DART exceptions
-	if ( (apiexcp & kU3API_DARTExcp) || (apiexcp & kU4API_DARTExcp) )
-	{
-		UInt32 dartexcp = 0;
+	handleChipFaultStateFor<Variant>( &state, refcon );
 
-		if( IS_U4(me->uniNVersion) )
-		{
-			dartexcp = me->safeReadRegUInt32( kU4DARTExceptionRegister );
-			if ( dartexcp & kU4DARTExcpRQOPMask ) {
-				char	xcdString[40];
-				switch((dartexcp & kU4DARTExcpXCDMask))			 //          1         2         3         4
-				{												 // 1234567890123456789012345678901234567890
-					case 0:
-						snprintf(xcdString, sizeof( xcdString )-1, "XBE DART out of bounds Exception: ");
-						break;
-					case 1:
-						snprintf(xcdString, sizeof( xcdString)-1,  "XBE DART Entry Exception: ");
-						break;
-					case 2:
-						snprintf(xcdString, sizeof( xcdString)-1, "XBE DART Read Protection Exception: ");
-						break;
-					case 3:
-						snprintf(xcdString, sizeof( xcdString)-1, "XBE DART Write Protection Exception: ");
-						break;
-					case 4:
-						snprintf(xcdString, sizeof( xcdString)-1, "XBE DART Addressing Exception: ");
-						break;
-					case 5:
-						snprintf(xcdString, sizeof( xcdString)-1, "XBE DART TLB Parity Error: ");
-						break;
-				}
+	// Restore mask register.
+	U3RestoreChipFaultMask< U3ChipTraits<Variant> >( port, savedMaskRegister );
+}
+
+// **********************************************************************************
+// readChipFaultState
+//
+// Given state->apiexcp, reads the DART and memory controller error registers that the
+// exception calls for.  This is the only place the chip fault path reads hardware, so
+// the decode in handleChipFaultState can be driven from a captured or synthesized state.
+//
+// **********************************************************************************
+void AppleU3::readChipFaultState( u3_chip_fault_state_t *state )
+{
+	(this->*chipMap->readFaultState)( state );
+}
+
+template <UInt32 Variant> void AppleU3::readChipFaultStateFor( u3_chip_fault_state_t *state )
+{
+	U3RegPort port(this);
+
+	//
+	//	*** NOTE ***	reading the MESR causes the ECC state to be cleared
+	//
+	U3ReadChipFaultState< U3ChipTraits<Variant> >( port, gU3RegAccessIndex, state );
+}
+
+// **********************************************************************************
+// handleChipFaultState
+//
+// Acts on a captured chip fault: logs DART write exceptions, panics on uncorrectable ECC
+// errors and counts correctable ones against the DIMM slots.  Which of these a fault calls
+// for is worked out by U3DecodeChipFault.
+//
+// **********************************************************************************
+void AppleU3::handleChipFaultState( const u3_chip_fault_state_t *state, void *refcon )
+{
+	(this->*chipMap->handleFaultState)( state, refcon );
+}
+
+template <> void AppleU3::handleChipFaultStateFor<kU3VariantLite>( const u3_chip_fault_state_t *state, void * /* refcon */ )
+{
+	u3_chip_fault_decode_t decode;
+
+	U3DecodeChipFault< U3ChipTraits<kU3VariantLite> >( state, &decode );
+
+	if ( decode.actions & kU3FaultDARTWrite )
+		decodeU3DARTExcp( state->dartexcp );
+}
+
+template <> void AppleU3::handleChipFaultStateFor<kU3VariantHeavy>( const u3_chip_fault_state_t *state, void *refcon )
+{
+	u3_chip_fault_decode_t decode;
+
+	U3DecodeChipFault< U3ChipTraits<kU3VariantHeavy> >( state, &decode );
+
+	if ( decode.actions & kU3FaultDARTWrite )
+		decodeU3DARTExcp( state->dartexcp );
+
+	if ( decode.actions & (kU3FaultECCUncorrectable | kU3FaultECCCorrectable) )
+		decodeU3HeavyECC( state, &decode, refcon );
+}
+
+template <> void AppleU3::handleChipFaultStateFor<kU3VariantU4>( const u3_chip_fault_state_t *state, void *refcon )
+{
+	u3_chip_fault_decode_t decode;
+
+	U3DecodeChipFault< U3ChipTraits<kU3VariantU4> >( state, &decode );
+
+	if ( decode.actions & kU3FaultDARTWrite )
+		decodeU4DARTExcp( state->dartexcp );
+
+	if ( decode.actions & (kU3FaultECCUncorrectable | kU3FaultECCCorrectable) )
+		decodeU4ECC( state, &decode, refcon );
+}
+
+// **********************************************************************************
+// decodeU3DARTExcp
+//
+// **********************************************************************************
+void AppleU3::decodeU3DARTExcp( UInt32 dartexcp )
+{
+char	errstr[128];
+
+	// rdar://4137750 -- ONLY panic on DART WRITE errors.  Ignore DART READs.
+	// they are often caused by PCI speculative reads, which are typically bogus.
+	if ( dartexcp & kU3DARTExcpRQOPMask )	// writes ONLY
+	{
 #if 0	// no more panics on DART exceptions -- this wouldn't happen on a non-DART system.  Just log it.
-				snprintf( errstr, sizeof( errstr)-1, "DART %s%s %s logical page 0x%05lX\n",
-					xcdString,
-					( dartexcp & kU4DARTExcpRQSRCMask )? "HyperTransport" :
-														 "PCI0",
-					( dartexcp & kU4DARTExcpRQOPMask ) ? "write" :
-														 "read",
-					( dartexcp & kU4DARTExcpLogAdrsMask ) >> kU4DARTExcpLogAdrsShift );
-				// kaboom!
-				panic( "%s", errstr );
+		snprintf( errstr, sizeof( errstr )-1,    "DART %s%s%s %s logical page 0x%05lX\n",
+			( dartexcp & kU3DARTExcpXBEMask )?   "out-of-bounds exception: " : "",
+			( dartexcp & kU3DARTExcpXEEMask )?   "entry exception: " : "",
+			( dartexcp & kU3DARTExcpRQSRCMask )? "HyperTransport" : "PCI0",
+			( dartexcp & kU3DARTExcpRQOPMask )?  "write" : "read",
+			getRegField<U3DARTExcpLogAdrsField>(dartexcp) );
+
+		// kaboom!
+		panic( "%s", errstr );
 #endif
-				snprintf( errstr, sizeof( errstr)-1, "DMA %s%s %s logical page 0x%05lX\n",
-					xcdString,
-					( dartexcp & kU4DARTExcpRQSRCMask )? "HyperTransport" :
-														 "PCI0",
-					( dartexcp & kU4DARTExcpRQOPMask ) ? "write" :
-														 "read",
-					( dartexcp & kU4DARTExcpLogAdrsMask ) >> kU4DARTExcpLogAdrsShift );
-				kprintf( "%s", errstr );
-				IOLog( "%s", errstr );
-			}
+		snprintf( errstr, sizeof( errstr )-1,    "DMA %s%s%s write logical page 0x%05lX\n",
+			( dartexcp & kU3DARTExcpXBEMask )?   "out-of-bounds exception: " : "",
+			( dartexcp & kU3DARTExcpXEEMask )?   "entry exception: " : "",
+			( dartexcp & kU3DARTExcpRQSRCMask )? "HyperTransport" : "PCI0",
+			getRegField<U3DARTExcpLogAdrsField>(dartexcp) );
+		kprintf( "%s", errstr );
+		IOLog( "%s", errstr );
+	}
+}
 
+// **********************************************************************************
+// decodeU4DARTExcp
+//
+// **********************************************************************************
+void AppleU3::decodeU4DARTExcp( UInt32 dartexcp )
+{
+char	errstr[128];
+
+	if ( dartexcp & kU4DARTExcpRQOPMask ) {
+		char	xcdString[40];
+		switch((dartexcp & kU4DARTExcpXCDMask))			 //          1         2         3         4
+		{												 // 1234567890123456789012345678901234567890
+			case 0:
+				snprintf(xcdString, sizeof( xcdString )-1, "XBE DART out of bounds Exception: ");
+				break;
+			case 1:
+				snprintf(xcdString, sizeof( xcdString)-1,  "XBE DART Entry Exception: ");
+				break;
+			case 2:
+				snprintf(xcdString, sizeof( xcdString)-1, "XBE DART Read Protection Exception: ");
+				break;
+			case 3:
+				snprintf(xcdString, sizeof( xcdString)-1, "XBE DART Write Protection Exception: ");
+				break;
+			case 4:
+				snprintf(xcdString, sizeof( xcdString)-1, "XBE DART Addressing Exception: ");
+				break;
+			case 5:
+				snprintf(xcdString, sizeof( xcdString)-1, "XBE DART TLB Parity Error: ");
+				break;
 		}
-		else		// U3H
-		{
-			dartexcp = me->safeReadRegUInt32( kU3DARTExceptionRegister );
-			// rdar://4137750 -- ONLY panic on DART WRITE errors.  Ignore DART READs.
-			// they are often caused by PCI speculative reads, which are typically bogus.
-			if ( dartexcp & kU3DARTExcpRQOPMask )	// writes ONLY
-			{
 #if 0	// no more panics on DART exceptions -- this wouldn't happen on a non-DART system.  Just log it.
-				snprintf( errstr, sizeof( errstr )-1,    "DART %s%s%s %s logical page 0x%05lX\n",
-					( dartexcp & kU3DARTExcpXBEMask )?   "out-of-bounds exception: " : "",
-					( dartexcp & kU3DARTExcpXEEMask )?   "entry exception: " : "",
-					( dartexcp & kU3DARTExcpRQSRCMask )? "HyperTransport" : "PCI0",
-					( dartexcp & kU3DARTExcpRQOPMask )?  "write" : "read",
-					( dartexcp & kU3DARTExcpLogAdrsMask ) >> kU3DARTExcpLogAdrsShift );
-
-				// kaboom!
-				panic( "%s", errstr );
+		snprintf( errstr, sizeof( errstr)-1, "DART %s%s %s logical page 0x%05lX\n",
+			xcdString,
+			( dartexcp & kU4DARTExcpRQSRCMask )? "HyperTransport" :
+												 "PCI0",
+			( dartexcp & kU4DARTExcpRQOPMask ) ? "write" :
+												 "read",
+			getRegField<U4DARTExcpLogAdrsField>(dartexcp) );
+		// kaboom!
+		panic( "%s", errstr );
 #endif
-				snprintf( errstr, sizeof( errstr )-1,    "DMA %s%s%s write logical page 0x%05lX\n",
-					( dartexcp & kU3DARTExcpXBEMask )?   "out-of-bounds exception: " : "",
-					( dartexcp & kU3DARTExcpXEEMask )?   "entry exception: " : "",
-					( dartexcp & kU3DARTExcpRQSRCMask )? "HyperTransport" : "PCI0",
-					( dartexcp & kU3DARTExcpLogAdrsMask ) >> kU3DARTExcpLogAdrsShift );
-				kprintf( "%s", errstr );
-				IOLog( "%s", errstr );
-			}
-			
-		}
-
+		snprintf( errstr, sizeof( errstr)-1, "DMA %s%s %s logical page 0x%05lX\n",
+			xcdString,
+			( dartexcp & kU4DARTExcpRQSRCMask )? "HyperTransport" :
+												 "PCI0",
+			( dartexcp & kU4DARTExcpRQOPMask ) ? "write" :
+												 "read",
+			getRegField<U4DARTExcpLogAdrsField>(dartexcp) );
+		kprintf( "%s", errstr );
+		IOLog( "%s", errstr );
 	}
+}
 
-	// if this is U3 Heavy, Check for ECC errors
-	if ( IS_U3_HEAVY(me->uniNVersion) && (apiexcp & (kU3API_ECC_UE_H | kU3API_ECC_UE_L | kU3API_ECC_CE_H | kU3API_ECC_CE_L)) )
-	{
-	UInt32	activeUEbits, activeCEbits, CEbitsToCheck = 0;
+// **********************************************************************************
+// decodeU3HeavyECC
+//
+// **********************************************************************************
+void AppleU3::decodeU3HeavyECC( const u3_chip_fault_state_t *state, const u3_chip_fault_decode_t *decode, void *refcon )
+{
+char	errstr[128];
 
-		// interrogate U3 ECC registers
-		//
-		//	*** NOTE ***	reading the MESR causes the ECC state to be cleared
-		//
+	// Check for uncorrectable errors
+	if ( decode->actions & kU3FaultECCUncorrectable )
+	{
+		// according to Sally F, if the ECC_xE_H bit(s) are set, you need to choose the HIGHER of the dimm-pair
+		// and if BOTH UE_H and UE_L are set, we _should_ be reporting BOTH DIMMs as having errors.
+		if ( decode->dimmCount == 2 )
+			snprintf( errstr, sizeof( errstr )-1, "DIMMs %s & %s",
+						dimmErrors[decode->dimm].slotName, dimmErrors[decode->dimm+1].slotName );
+		else
+			snprintf( errstr, sizeof( errstr )-1, "%s", dimmErrors[decode->dimm].slotName );
 
-		mear = me->safeReadRegUInt32( kU3MemErrorAddressRegister );
-		mesr = me->safeReadRegUInt32( kU3MemErrorSyndromeRegister );
-		
-		// get the dimm slot index
-		rank = (mear & kU3MEAR_RNK_A_mask) >> kU3MEAR_RNK_A_shift;
-
-		// grab the uncorrectable and correctable ECC bit settings
-		activeUEbits  = apiexcp & (kU3API_ECC_UE_H | kU3API_ECC_UE_L);
-		activeCEbits  = apiexcp & (kU3API_ECC_CE_H | kU3API_ECC_CE_L);
-		// retrieve the upper/lower syndrome values
-		syndromes     = mesr &  kU3MESR_ECC_SYNDROMES_mask;
-		upperSyndrome = ( syndromes >> 8 ) & kU3MESR_ECC_SYNDROME_mask;
-		lowerSyndrome =   syndromes        & kU3MESR_ECC_SYNDROME_mask;
-
-		// Check for uncorrectable errors
-		if ( activeUEbits & ( kU3API_ECC_UE_H | kU3API_ECC_UE_L ) )		// if EITHER the upper or lower uncorrectable error is indicated
-		{
+		/*  ***** DEATH BY UNCORRECTABLE ERROR HAPPENS HERE *****  */
 
+		panic("Uncorrectable parity error detected in %s (APIEXCP=0x%08lX, MEAR=0x%08lX MESR=0x%08lX)\n",
+			/* slot name(s) */ errstr, state->apiexcp, state->mear, state->mesr);
+	}
 
-			{
-				// according to Sally F, if the ECC_xE_H bit(s) are set, you need to choose the HIGHER of the dimm-pair
-				// and if BOTH UE_H and UE_L are set, we _should_ be reporting BOTH DIMMs as having errors.
-				dimmloc = rank - (rank % 2);	// gives dimm number of dimm where UE_L occurred.  add 1 for UE_H.
-				if ( activeUEbits == ( kU3API_ECC_UE_H | kU3API_ECC_UE_L ) )
-				{
-					snprintf( errstr, sizeof( errstr )-1, "DIMMs %s & %s",
-								me->dimmErrors[dimmloc].slotName, me->dimmErrors[dimmloc+1].slotName );
-				}
-				else
-				{
-					if (apiexcp & kU3API_ECC_UE_H)	// check if error was in upper or lower DIMM
-						dimmloc ++;					// if upper, add 1 to *dimmloc*
-					snprintf( errstr, sizeof( errstr )-1, "%s", me->dimmErrors[dimmloc].slotName );
-				}
+	countECCError( decode, refcon );
+}
 
-				/*  ***** DEATH BY UNCORRECTABLE ERROR HAPPENS HERE *****  */
+// **********************************************************************************
+// decodeU4ECC
+//
+// **********************************************************************************
+void AppleU3::decodeU4ECC( const u3_chip_fault_state_t *state, const u3_chip_fault_decode_t *decode, void *refcon )
+{
+	// Check for an uncorrectable error.  For these we can only know the rank (pair of DIMMs);
+	// for correctable ones the syndrome gives the exact bit, and so the DIMM.
+	if ( decode->actions & kU3FaultECCUncorrectable )
+	{
+		panic("Uncorrectable parity error detected in rank %ld [%s, %s] (MEAR0=0x%08lX MEAR1=0x%08lX MESR=0x%08lX)\n",
+			decode->rank, dimmErrors[decode->dimm].slotName, dimmErrors[decode->dimm+1].slotName,
+			state->mear, state->mear1, state->mesr);
+	}
 
-				panic("Uncorrectable parity error detected in %s (APIEXCP=0x%08lX, MEAR=0x%08lX MESR=0x%08lX)\n",
-					/* slot name(s) */ errstr, apiexcp, mear, mesr);
-			}
-		}
+	countECCError( decode, refcon );
+}
 
+// **********************************************************************************
+// countECCError
+//
+// Counts a correctable error against the DIMMs it was decoded to and schedules a notification
+// **********************************************************************************
+void AppleU3::countECCError( const u3_chip_fault_decode_t *decode, void *refcon )
+{
+UInt32	i;
 
-		if ( activeCEbits )	// from APIEXCP
-		{
-			// according to Sally F, if the ECC_xE_H bit(s) are set, you need to choose the HIGHER of the dimm-pair
-			// and if BOTH ECC_CE_H and CE_L are set, we ought to be setting updates for both DIMMs, not just one.
-
-			dimmloc = rank - (rank % 2 );	// gives location of lower DIMM of the DIMM-pair
-			IOSimpleLockLock( me->dimmLock );
-
-			// if BOTH bits are set, update the counts for both lower and upper DIMM location
-			if ( activeCEbits == ( kU3API_ECC_CE_H | kU3API_ECC_CE_L ) )
-			{
-				//kprintf("AppleU3 got correctable error in dimms %u and %u\n", dimmloc, dimmloc+1);
-				me->dimmErrors[dimmloc].count++;
-				me->dimmErrors[dimmloc+1].count++;
-			}
-			else	// either one or the other - figure out if we we need to further refine *dimmloc*
-			{
-				if ( activeCEbits & kU3API_ECC_CE_H )	// if CE_H is set, CE_L isn't, and we need to increment *dimmloc*
-					dimmloc ++;
-				//kprintf("AppleU3 got correctable error dimm %u\n", dimmloc);
-				me->dimmErrors[dimmloc].count++;
-			}
+	IOSimpleLockLock( dimmLock );
+	for ( i = 0; i < decode->dimmCount; i++ )
+		dimmErrors[decode->dimm + i].count++;
+	IOSimpleLockUnlock( dimmLock );
 
-			IOSimpleLockUnlock( me->dimmLock );
+	// schedule a notification thread callout (if not already scheduled)
+	if (thread_call_is_delayed( eccErrorCallout, NULL ) == FALSE)
+	{
+		AbsoluteTime deadline;
 
-			// schedule a notification thread callout (if not already scheduled)
-			if (thread_call_is_delayed( me->eccErrorCallout, NULL ) == FALSE)
-			{
-			AbsoluteTime deadline;
-			
-				clock_interval_to_deadline( kU3ECCNotificationIntervalMS, kMillisecondScale, &deadline );
-				thread_call_enter1_delayed( me->eccErrorCallout, vRefCon, deadline);
-			}
-		}
+		clock_interval_to_deadline( kU3ECCNotificationIntervalMS, kMillisecondScale, &deadline );
+		thread_call_enter1_delayed( eccErrorCallout, refcon, deadline);
 	}
+}
 
-	// if this is U4, Check for ECC error
-	if ( IS_U4(me->uniNVersion) && (apiexcp & (kU4API_ECC_UEExcp | kU4API_ECC_CEExcp)) )
-	{
-		// interrogate U4 ECC registers
-		mear = me->safeReadRegUInt32( kU4MemErrorAddressRegister1 );
-		mear1 = me->safeReadRegUInt32( kU4MemErrorAddressRegister2 );
-		mesr = me->safeReadRegUInt32( kU4MemErrorSyndromeRegister );
+// **********************************************************************************
+// createRegWindow
+//
+// Builds regWindowMemory from the whitelisted Uni-N pages and records its layout in
+// statsPage->regWindow.
+// **********************************************************************************
+void AppleU3::createRegWindow( IOService *provider )
+{
+	IODeviceMemory		*deviceMemory;
+	IOMemoryDescriptor	*pages[kU3RegWindowMaxPages];
+	u3_reg_window_t		*window = &statsPage->regWindow;
+	UInt32				i, j, page, count;
 
-		// get the dimm slot index
-		dimmloc = rank = (mear & kU4MEAR_RK_mask) >> kU4MEAR_RK_shift;
+	window->pageCount = 0;
+	window->pageSize = PAGE_SIZE;
 
-		// Check for an uncorrectable error
-		if (apiexcp & kU4API_ECC_UEExcp)
-		{
-			panic("Uncorrectable parity error detected in rank %ld [%s, %s] (MEAR0=0x%08lX MEAR1=0x%08lX MESR=0x%08lX)\n",
-				rank, me->dimmErrors[dimmloc].slotName, me->dimmErrors[dimmloc+1].slotName, mear, mear1, mesr);
-		}
-		else
-		{
-			int i; 
-
-			// Search Syndrome Table to find exact bit which caused CE.  Use bit to determine if the error occurred
-			// on the lower/upper DIMM in the rank.  In general, using the rank and syndrome we can determine which
-			// DIMM caused the correctable error.  For uncorrectable errors, we can only know the rank (pair of DIMMs).
-			for ( i = 0; i <= 127; i++ )
-			{
-				if ( SyndromeTable[i] == (mesr & 0xFFFF) )
-				{
-					if( i > 63 ) // if low bit, then pick then next dimm in the rank.
-						dimmloc++;
+	if ((deviceMemory = provider->getDeviceMemoryWithIndex( 0 )) == NULL)
+		return;
 
-					break;
+	count = 0;
+	for (i = 0; (i < sizeof(gU3RegWindowCandidates) / sizeof(gU3RegWindowCandidates[0])) && (count < kU3RegWindowMaxPages); i++)
+	{
+		page = gU3RegWindowCandidates[i] & ~PAGE_MASK;
+		if (page + PAGE_SIZE > deviceMemory->getLength())
+			continue;
 
-				}
-			}
-		}
+		// Several candidates may share a page
+		for (j = 0; j < count; j++)
+			if (window->pageOffset[j] == page)
+				break;
+		if (j < count)
+			continue;
+
+		// Never expose a register whose read changes hardware state
+		for (j = 0; j < sizeof(gU3RegAccessTable) / sizeof(gU3RegAccessTable[0]); j++)
+			if ((gU3RegAccessTable[j].flags & kU3RegAccessReadSideEffects) &&
+				((gU3RegAccessTable[j].offset & ~PAGE_MASK) == page))
+				break;
+		if (j < sizeof(gU3RegAccessTable) / sizeof(gU3RegAccessTable[0]))
+			continue;
 
-		IOSimpleLockLock( me->dimmLock );
-		me->dimmErrors[dimmloc].count++;
-		IOSimpleLockUnlock( me->dimmLock );
+		if ((pages[count] = IOMemoryDescriptor::withSubRange( deviceMemory, page, PAGE_SIZE, kIODirectionIn )) == NULL)
+			break;
 
-		// schedule a notification thread callout (if not already scheduled)
-		if (thread_call_is_delayed( me->eccErrorCallout, NULL ) == FALSE)
-		{
-			AbsoluteTime deadline;
-			clock_interval_to_deadline( kU3ECCNotificationIntervalMS, kMillisecondScale, &deadline );
-			thread_call_enter1_delayed( me->eccErrorCallout, vRefCon, deadline);
-		}
+		window->pageOffset[count++] = page;
 	}
 
-DART_CASCADE_SKIP:
+	if (count)
+		regWindowMemory = IOMultiMemoryDescriptor::withDescriptors( pages, count, kIODirectionIn, false );
 
-	// Restore mask register.
-	if ( IS_U4(me->uniNVersion) )
-		me->safeWriteRegUInt32 ( kU4APIMask1Register, savedMaskRegister, savedMaskRegister );
-	else
-		me->safeWriteRegUInt32 ( kU3ChipFaultMaskRegister, savedMaskRegister, savedMaskRegister );
+	// The multi descriptor holds its own references
+	for (i = 0; i < count; i++)
+		pages[i]->release();
+
+	if (regWindowMemory)
+		window->pageCount = count;
+
+	return;
+}
+
+// **********************************************************************************
+// getChipMap
+//
+// **********************************************************************************
+/* static */
+const u3_chip_map_t *AppleU3::getChipMap( UInt32 variant )
+{
+	static const u3_chip_map_t chipMaps[kU3NumVariants] =
+	{
+		U3_CHIP_MAP(kU3VariantLite),
+		U3_CHIP_MAP(kU3VariantHeavy),
+		U3_CHIP_MAP(kU3VariantU4)
+	};
+
+	return (variant < kU3NumVariants) ? &chipMaps[variant] : NULL;
 }
 
 // **********************************************************************************
@@ -1160,12 +3215,13 @@ void AppleU3::setupECC( void )
 	const OSData * slotNamesData;
 	const char * slotNames;
 	UInt32 bits, i, slotBitField;
+	u3_reg_transaction_t eccList[2];
 
 	// If it's not U3 Heavy or U4, we don't have ECC
-	if ( !IS_U3_HEAVY(uniNVersion) && !IS_U4(uniNVersion) ) return;
+	if ( !chipMap->eccExcpBits ) return;
 
 	// ECC is initialized and enabled by HWInit if possible.  Check if it is turned on.
-	if ( ! ( kU3MCCR_ECC_EN & safeReadRegUInt32( kU3MemCheckCtrlRegister ) )) return;
+	if ( ! readRegField<U3MCCREccEnableField>() ) return;
 
 	// grab the DIMM slot names from the device tree, they are in the /memory node under the
 	// slot-names property.  The first word of the property is a bit field with one bit set
@@ -1230,26 +3286,21 @@ void AppleU3::setupECC( void )
 	// flag that this is an ecc supported memory controller
 	setProperty("ecc-supported", "true" );
 
-	if ( IS_U4(uniNVersion) )
-	{
-		// Clear the mask bits in the MCCR to enable error propogation
-		bits = kU4MCCR_ECC_UE_MASK | kU4MCCR_ECC_CE_MASK;
-		safeWriteRegUInt32( kU4MemCheckCtrlRegister, bits, ~bits );
+	eccList[0].op = eccList[1].op = kU3RegOpWrite;
 
-		// Set the mask bits in the CFMR to enable chip fault generation
-		bits = kU4API_ECC_UEExcp | kU4API_ECC_CEExcp;
-		safeWriteRegUInt32( kU4APIMask1Register, bits, bits );
-	}
-	else
-	{
-		// Clear the mask bits in the MCCR to enable error propogation
-		bits = kU3MCCR_ECC_UE_MASK_H | kU3MCCR_ECC_CE_MASK_H | kU3MCCR_ECC_UE_MASK_L | kU3MCCR_ECC_CE_MASK_L;
-		safeWriteRegUInt32( kU3MemCheckCtrlRegister, bits, ~bits );
+	// Clear the mask bits in the MCCR to enable error propogation
+	bits = chipMap->memCheckMaskBits;
+	eccList[0].offset = chipMap->memCheckCtrlReg;
+	eccList[0].mask = bits;
+	eccList[0].value = ~bits;
 
-		// Set the mask bits in the CFMR to enable chip fault generation
-		bits = kU3API_ECC_UE_H | kU3API_ECC_CE_H | kU3API_ECC_UE_L | kU3API_ECC_CE_L;
-		safeWriteRegUInt32( kU3ChipFaultMaskRegister, bits, bits );
-	}
+	// Set the mask bits in the CFMR to enable chip fault generation
+	bits = chipMap->eccExcpBits;
+	eccList[1].offset = chipMap->faultMaskReg;
+	eccList[1].mask = bits;
+	eccList[1].value = bits;
+
+	safeRegTransaction( eccList, 2 );
 }
 
 // **********************************************************************************
@@ -1262,9 +3313,6 @@ void AppleU3::setupECC( void )
 void AppleU3::setupDARTExcp( void )
 {
 	// Set the mask bit in the CFMR to enable chip fault generation
-	if ( IS_U4(uniNVersion) )
-		safeWriteRegUInt32( kU4APIMask1Register, kU3API_DARTExcp, kU3API_DARTExcp );
-	else
-		safeWriteRegUInt32( kU3ChipFaultMaskRegister, kU3API_DARTExcp, kU3API_DARTExcp );
+	safeWriteRegUInt32( chipMap->faultMaskReg, chipMap->dartExcpBit, chipMap->dartExcpBit );
 }
 
@@ -34,8 +34,18 @@
 #include <IOKit/platform/ApplePlatformExpert.h>
 #include <IOKit/IODeviceTreeSupport.h>
 #include <IOKit/pci/IOPCIDevice.h>
+#include <IOKit/IOBufferMemoryDescriptor.h>
 
 #include "IOPlatformFunction.h"
+#include "U3RegAccess.h"
+#include "U3RegTransaction.h"
+#include "U3RegField.h"
+#include "U3PFDispatch.h"
+#include "U3PFCompile.h"
+#include "U3ECCSyndrome.h"
+#include "U3ChipState.h"
+#include "AppleU3UserClient.h"
+#include "MacRISC4PFStats.h"
 
 
 #define kIOPCICacheLineSize 	"IOPCICacheLineSize"
@@ -56,6 +66,18 @@ typedef struct _u3_parity_error_record_t
 
 #define kU3ECCNotificationIntervalMS	500	// notify clients of outstanding ECC errors at this interval
 
+// For Uni-N register access tracing, uncomment to record every access in per-CPU trace rings
+// that AppleU3UserClient maps into user space
+//#define U3_MMIO_TRACE 1
+
+// For platform function debugging, uncomment to time every op of the compiled platform-do
+// functions into a small ring per function, published in the registry on request
+//#define U3_PF_TRACE 1
+
+// For shadow register debugging, uncomment to periodically verify the shadows against hardware
+//#define U3_SHADOW_VERIFY 1
+#define kU3ShadowVerifyIntervalMS		1000
+
 // memory parity error message type
 #ifndef sub_iokit_platform
 #define sub_iokit_platform				err_sub(0x2A)	// chosen randomly...
@@ -74,11 +96,210 @@ typedef struct _u3_parity_error_msg_t
 	UInt32	count;	// the number of errors encountered since the last notification was sent
 } u3_parity_error_msg_t;
 
+// Driver-owned registers.  Nothing but this driver changes their contents, so masked writes are
+// computed from a shadow copy instead of an uncached read of the register.
+enum
+{
+	kU3ShadowOnU3		= (1 << 0),		// register exists on U3 Lite/Heavy
+	kU3ShadowOnU4		= (1 << 1),		// register exists on U4
+	kU3NumShadowRegs	= 4
+};
+
+typedef struct _u3_reg_shadow_t
+{
+	UInt32	offset;
+	UInt32	chips;			// kU3ShadowOnU3 and/or kU3ShadowOnU4
+	UInt32	volatileBits;	// bits the hardware may change on its own, never carried forward from the shadow
+} u3_reg_shadow_t;
+
+// Compile-time register map for each variant, the Chip of U3ChipState.h; specialized in U3.cpp
+template <UInt32 Variant> struct U3ChipTraits;
+
+class AppleU3;
+
+typedef struct _u3_chip_map_t
+{
+	UInt32	variant;
+	UInt32	shadowChip;			// kU3ShadowOnU3 or kU3ShadowOnU4
+	UInt32	faultMaskReg;		// CFMR on U3, APIMask1 on U4
+	UInt32	dartExcpBit;		// chip fault mask bit setupDARTExcp enables for DART exceptions
+	UInt32	eccExcpBits;		// chip fault mask/exception bits for ECC errors, zero without ECC
+	UInt32	memCheckCtrlReg;
+	UInt32	memCheckMaskBits;	// MCCR bits that mask ECC error propagation
+	bool	expectChipFault;	// the device tree should describe a chip fault signal
+	bool	hasPMClockControl;	// PM clock control and VSP soft reset are in Uni-N (not on U4)
+	void	(AppleU3::*chipFault)( void *refcon );
+	void	(AppleU3::*readFaultState)( u3_chip_fault_state_t *state );
+	void	(AppleU3::*handleFaultState)( const u3_chip_fault_state_t *state, void *refcon );
+} u3_chip_map_t;
+
+// callPlatformFunction dispatch.  Every symbol AppleU3 answers for - the built-in functions and
+// the on-demand platform-do functions - is entered once in start() into an open-addressed
+// table keyed by OSSymbol pointer, so a call costs one hash and usually one probe.
+enum
+{
+	kU3PFSafeReadRegUInt32 = 0,
+	kU3PFSafeWriteRegUInt32,
+	kU3PFSafeRegTransaction,
+	kU3PFUniNSetPowerState,
+	kU3PFUniNPrepareForSleep,
+	kU3PFGetHTLinkFrequency,
+	kU3PFSetHTLinkFrequency,
+	kU3PFGetHTLinkWidth,
+	kU3PFSetHTLinkWidth,
+	kU3PFAPIPhyDisableProcessor1,
+	kU3PFReadUniNReg,
+	kU3PFPerformFunctionAsync,
+	kU3NumBuiltinPF,
+	kU3PFOnDemand = kU3NumBuiltinPF		// IOPlatformFunction from platform-do-*
+};
+
+// Delay and WaitReg32 steps never block the caller's thread.  A program that has them is run by
+// a small executor: it parks at the step and is resumed from a thread call, then reports through
+// a completion.  Each such program has one executor, so it has at most one run in flight: a
+// synchronous call waits for the executor, performFunctionAsync returns kIOReturnBusy.
+#define kU3PerformFunctionAsyncFuncName	"performFunctionAsync"	// param1 = function name (const OSSymbol *),
+																// param2 = function's param1, param3 = completion,
+																// param4 = refcon
+#define kU3PFWaitPollMS			1		// WaitReg32 re-reads the register this often
+#define kU3PFWaitTimeoutMS		1000	// and gives up with kIOReturnTimeout after this long
+
+typedef void (*u3_pf_completion_t)( void *refcon, IOReturn result );
+
+// Per-function trace ring, see U3_PF_TRACE.  Setting kU3PFTraceSnapshotKey with setProperties
+// publishes every ring under kU3PFTraceKey, as { function name = ( { Op, Offset, Time }, ... ) }
+// oldest record first, Time in mach absolute time units.
+#define kU3PFTraceKey			"PlatformFunctionTrace"
+#define kU3PFTraceSnapshotKey	"PlatformFunctionTraceSnapshot"
+#define kU3PFTraceOpKey			"Op"
+#define kU3PFTraceOffsetKey		"Offset"
+#define kU3PFTraceTimeKey		"Time"
+#define kU3PFTraceEntries		16		// must be a power of 2
+
+typedef struct _u3_pf_trace_record_t
+{
+	UInt32					opcode;		// kU3PFOp*
+	UInt32					offset;		// register or config offset, microseconds for a delay
+	UInt32					elapsed;
+} u3_pf_trace_record_t;
+
+typedef struct _u3_pf_trace_ring_t
+{
+	UInt32					head;		// records ever written, the newest is head - 1
+	u3_pf_trace_record_t	records[kU3PFTraceEntries];
+} u3_pf_trace_ring_t;
+
+typedef struct _u3_pf_exec_t
+{
+	volatile UInt32			busy;		// non-zero while a run is in flight
+	UInt32					pc;			// next op
+	UInt32					data;		// config data carried between ops, and across parks
+	UInt32					polls;		// WaitReg32 polls left before timing out
+	void					*param1;
+	IOPCIDevice				*nub;		// retained for the length of the run
+	u3_pf_completion_t		completion;
+	void					*refcon;
+	thread_call_t			callout;	// resumes the program after a park
+	bool					ownsGate;	// the program's config gate is ours until the run ends
+#ifdef U3_PF_TRACE
+	UInt64					opStart;	// when the parked op was first reached
+#endif
+} u3_pf_exec_t;
+
+// Config cycles to a nub are serialized by that nub's gate, one per pHandle, built in start().
+// A gate is owned rather than locked, so a program that parks between a config read and its
+// write keeps the nub across the park and gives it up from whichever thread finishes it.
+typedef struct _u3_pf_config_gate_t
+{
+	UInt32					pHandle;
+	IOLock					*lock;		// protects owned, owners sleep on it
+	bool					owned;
+} u3_pf_config_gate_t;
+
+// Programs only exclude the ones they can conflict with.  Register writes take the lock
+// domains of the registers they touch; programs with config ops also own their nub's gate,
+// so an RMW config sequence is atomic with respect to its nub.  Interpreted functions take
+// the same locks, see performFunction.
+typedef struct _u3_pf_program_t
+{
+	UInt32					opCount;
+	UInt32					pHandle;	// nub for the config ops, 0 if there are none
+	UInt32					regDomains;	// kU3LockDomain* mask of the registers written
+	u3_pf_config_gate_t		*configGate;	// shared per pHandle, NULL if pHandle is 0
+	u3_pf_exec_t			*exec;		// only for programs with Delay or WaitReg32 ops
+#ifdef U3_PF_TRACE
+	u3_pf_trace_ring_t		trace;		// written by whoever holds the program's locks
+#endif
+	u3_pf_op_t				ops[1];		// opCount entries
+} u3_pf_program_t;
+
+#define U3_PF_PROGRAM_SIZE(n)	(sizeof(u3_pf_program_t) + ((n) - 1) * sizeof(u3_pf_op_t))
+
+typedef struct _u3_pf_dispatch_entry_t
+{
+	const OSSymbol			*key;		// NULL if the slot is empty
+	UInt32					selector;	// kU3PF* selector
+	IOPlatformFunction		*func;		// kU3PFOnDemand only
+	u3_pf_program_t			*program;	// kU3PFOnDemand only, NULL if func could not be compiled
+} u3_pf_dispatch_entry_t;
+
+// Platform functions run from uniNSetPowerState, one set per kU3PowerPhase*.  Built in start():
+// the functions that only write registers are merged into regBatch, the rest are kept as
+// programs, grouped by pHandle so each nub's config cycles go out back to back.  Their nubs
+// are looked up in prepareForSleep, since the phases themselves run where we can't block.
+// prepareForSleep also takes every config gate, waiting out any program parked on one, and
+// holds them until the transition ends, so the phases' config cycles never meet a program
+// that owns their nub.  The gates are given back from a thread call, see releasePowerGates.
+typedef struct _u3_power_phase_t
+{
+	u3_reg_transaction_t	*regBatch;
+	UInt32					regCount;
+	u3_pf_program_t			**programs;
+	IOPCIDevice				**nubs;		// parallel to programs, retained
+	UInt32					programCount;
+} u3_power_phase_t;
+
+// What runPowerPhase runs.  The wake phase is run in two parts: its register batch with the
+// rest of the Uni-N restore, its programs once the PCI bridges they talk through are restored.
+enum
+{
+	kU3PowerPhaseRegs		= (1 << 0),
+	kU3PowerPhasePrograms	= (1 << 1),
+	kU3PowerPhaseAll		= kU3PowerPhaseRegs | kU3PowerPhasePrograms
+};
+
+#define kU3PowerPollUS			10		// WaitReg32 poll interval while running a power phase
+#define kU3PowerWaitTimeoutUS	10000	// and how long it spins before the program fails - the
+										// sleep and speed phases share the PMU's 100 ms budget
+
+// Index from AAPL,phandle to the IOPCIDevice with that phandle, so the config commands in a
+// platform function don't walk the device tree.  Entries are added and removed by publish and
+// terminate notifications on IOPCIDevice, and each holds a retain on its nub.
+#define kU3PHandleBuckets		64		// must be a power of 2
+
+typedef struct _u3_phandle_entry_t
+{
+	struct _u3_phandle_entry_t	*next;
+	UInt32						pHandle;
+	IOPCIDevice					*nub;
+} u3_phandle_entry_t;
+
+// callPlatformFunction(const char *) keeps symbols in a small cache indexed by a hash of the
+// string.  start() seeds it with every name in the dispatch table, and after that only names
+// that dispatched are added, so unknown strings cannot crowd out the ones we answer for.  A
+// slot is filled at most once and holds its symbol until free(), so it is read without a lock
+// and a hit neither allocates nor takes the symbol table lock.
+#define kU3InternCacheSlots		32		// must be a power of 2
+
 class AppleU3: public ApplePlatformExpert
 {
 
     OSDeclareDefaultStructors(AppleU3)
 
+	friend class AppleU3UserClient;
+	friend class U3RegPort;
+	friend class U3PFRunPort;
+
 public:
 
     virtual  bool start( IOService * nub );
@@ -87,14 +308,43 @@ public:
 		void *param1, void *param2, void *param3, void *param4);
     virtual IOReturn callPlatformFunction(const char *functionName, bool waitForFunction, 
 		void *param1, void *param2, void *param3, void *param4);
+	virtual IOReturn setProperties( OSObject *properties );
 
 	static void sHandleChipFault( void*, void*, void*, void* );
 	static void sDispatchECCNotifier( void* self, void* refcon );
 
+	// Typed interface for MacRISC4CPU, which holds an AppleU3 and calls these directly on its
+	// init/quiesce/halt paths.  The UniNSetPowerState, UniNPrepareForSleep and
+	// u3APIPhyDisableProcessor1 platform functions are a shim over the same methods.
+	virtual void uniNSetPowerState (UInt32 state);
+	virtual void prepareForSleep ( void );
+	virtual void u3APIPhyDisableProcessor1 ( void );
+	// speed is MacRISC4CPU's currentProcessorSpeed - 0 for full speed, anything else reduced.
+	// Called just before the PMU changes speed.  Uni-N must be set for the slower of the two
+	// speeds while the change happens, so the low speed functions run here and the high speed
+	// ones wait for the kUniNNormal that ends the change.
+	virtual void uniNSetBusSpeed ( UInt32 speed );
+	// Called ahead of kUniNSave when the processor is only changing speed.  Nothing loses power,
+	// so the save and the kUniNNormal that ends the change skip the sleep and wake functions.
+	virtual void uniNBeginSpeedChange ( void );
+	// Called on wake once the top-level PCI bridges and KeyLargo are restored, to run the wake
+	// functions that need them
+	virtual void uniNWakeComplete ( void );
+
+	// Runs an on-demand platform function and calls completion when it finishes, which may be
+	// before this returns.  completion is only called if this returns kIOReturnSuccess.
+	virtual IOReturn performFunctionAsync ( const OSSymbol *functionName, void *param1,
+		u3_pf_completion_t completion, void *refcon );
+
 private:
 	IOMemoryMap				*uniNMemory;
     volatile UInt32			*uniNBaseAddress;
+#ifdef U3_MMIO_TRACE
+	IOBufferMemoryDescriptor	*traceMemory;
+	u3_trace_buffer_t			*traceBuffer;
+#endif
     UInt32					uniNVersion;
+	const u3_chip_map_t		*chipMap;		// selected in start() from uniNVersion
 	bool					uataBusWasReset;
     IOService				*provider;
 	IORegistryEntry			*mpicRegEntry;
@@ -102,15 +352,41 @@ private:
 	IOService				*spu;
 	IOService				*pmu;
 	IOPCIDevice				*golem;
-	// this is to ensure mutual exclusive access to the Uni-N registers:
-	IOSimpleLock 			*mutex;
+	// this is to ensure mutual exclusive access to the Uni-N registers, one lock per domain:
+	IOSimpleLock 			*regLocks[kU3NumLockDomains];
+	UInt64					regLockAcquireTime[kU3NumLockDomains];	// valid while the lock is held
+	IOBufferMemoryDescriptor	*statsMemory;
+	u3_stats_page_t			*statsPage;
+	IOMemoryDescriptor		*regWindowMemory;		// read-only register pages for AppleU3UserClient
 	OSArray 				*platformFuncArray;
+	u3_pf_dispatch_entry_t	*pfDispatchTable;		// built in start(), see buildPlatformFunctionTable
+	UInt32					pfDispatchMask;			// table size - 1, table size is a power of 2
+	MacRISC4PFStats			*pfStats;				// per-selector call statistics
+	const OSSymbol * volatile	internCache[kU3InternCacheSlots];
+	u3_power_phase_t		powerPhases[kU3NumPowerPhases];
+	u3_pf_config_gate_t		*configGates;			// built in start(), see buildConfigGates
+	UInt32					configGateCount;
+	UInt32					configGateSlots;
+	IOLock					*pHandleLock;			// protects pHandleIndex
+	IOLock					*pfLock;				// hands idle executors and results to synchronous callers
+	u3_phandle_entry_t		*pHandleIndex[kU3PHandleBuckets];
+	IONotifier				*pciPublishNotifier;
+	IONotifier				*pciTerminateNotifier;
     IOMemoryMap				*uATABaseAddressMap;
 	volatile UInt32			*uATABaseAddress;
-	UInt32					saveDARTCntl;
-	UInt32					saveClockCntl;
-	UInt32					saveVSPSoftReset;
+	u3_uni_n_saved_t		uniNSaved;				// see kUniNSave
+	// shadow copies of driver-owned registers, protected by their domain's lock
+	UInt32					regShadow[kU3NumShadowRegs];
+	UInt32					regShadowActive;	// bit n set if regShadow[n] is in use on this chip
+#ifdef U3_SHADOW_VERIFY
+	thread_call_t			shadowVerifyCallout;
+#endif
 	bool					hostIsMobile;
+	bool					speedChangeInProgress;	// see uniNBeginSpeedChange
+	bool					wakeProgramsPending;	// see uniNWakeComplete
+	bool					highSpeedPending;		// see uniNSetBusSpeed
+	bool					powerGatesOwned;		// see prepareForSleep
+	thread_call_t			powerGateCallout;		// runs releasePowerGates
     const OSSymbol			*symGetHTLinkFrequency;
     const OSSymbol			*symSetHTLinkFrequency;
     const OSSymbol			*symGetHTLinkWidth;
@@ -118,6 +394,7 @@ private:
     const OSSymbol			*symSetSPUSleep;
     const OSSymbol			*symSetPMUSleep;
 	const OSSymbol			*symU3APIPhyDisableProcessor1;
+	const OSSymbol			*symPerformFunctionAsync;
 
 	// chip fault interrupt symbols
 	const OSSymbol			*symChipFaultFunc;
@@ -137,27 +414,150 @@ private:
 	IOSimpleLock				*dimmLock;
 	UInt32						*dimmErrorCountsTotal;
 
-    virtual UInt32 readUniNReg(UInt32 offset);
-    virtual void writeUniNReg(UInt32 offset, UInt32 data);
-	virtual UInt32 safeReadRegUInt32(UInt32 offset);
-	virtual void safeWriteRegUInt32(UInt32 offset, UInt32 mask, UInt32 data);
-	virtual void uniNSetPowerState (UInt32 state);
+	static void buildRegAccessIndex( void );
+	static const u3_reg_access_t *findRegAccess(UInt32 offset);
+	static UInt32 getRegAccessFlags(UInt32 offset);
+	static UInt32 getRegLockDomain(UInt32 offset);
+	IOInterruptState lockUniN( UInt32 domainMask );
+	void unlockUniN( UInt32 domainMask, IOInterruptState intState );
+	void resetLockStats( void );
+	void createRegWindow( IOService *provider );
+	void buildPlatformFunctionTable( void );
+	bool addPlatformFunctionEntry( const OSSymbol *key, UInt32 selector, IOPlatformFunction *func );
+	const u3_pf_dispatch_entry_t *lookupPlatformFunction( const OSSymbol *key ) const;
+	static UInt32 internCacheSlot( const char *name );
+	void seedInternCache( void );
+	IOReturn dispatchPlatformFunction( const u3_pf_dispatch_entry_t *entry, void *param1, void *param2,
+		void *param3, void *param4 );
+    inline UInt32 readUniNReg(UInt32 offset);
+    inline void writeUniNReg(UInt32 offset, UInt32 data);
+	inline void storeUniNReg(UInt32 offset, UInt32 data);
+#ifdef U3_MMIO_TRACE
+	void traceUniNAccess(UInt32 op, UInt32 offset, UInt32 value, void *caller);
+#endif
+	UInt32 safeReadRegUInt32(UInt32 offset);
+	void safeWriteRegUInt32(UInt32 offset, UInt32 mask, UInt32 data);
 
+	// Typed field accessors - Field is a U3RegField
+	template <class Field> static UInt32 getRegField(UInt32 regValue)
+		{ return U3GetRegField<Field>(regValue); }
+	template <class Field> static UInt32 setRegField(UInt32 regValue, UInt32 fieldValue)
+		{ return U3SetRegField<Field>(regValue, fieldValue); }
+	template <class Field> UInt32 readRegField(void)
+		{ return getRegField<Field>(safeReadRegUInt32(Field::offset)); }
+	template <class Field> void writeRegField(UInt32 fieldValue)
+		{ safeWriteRegUInt32(Field::offset, Field::mask, setRegField<Field>(0, fieldValue)); }
+	virtual IOReturn safeRegTransaction(u3_reg_transaction_t *list, UInt32 count);
+	UInt32 writeRegKeepingBits(UInt32 offset, UInt32 keepMask, UInt32 value);
+	void initRegShadows( void );
+	SInt32 getShadowIndex(UInt32 offset);
+	void updateRegShadow(SInt32 shadowIndex, UInt32 data);
+#ifdef U3_SHADOW_VERIFY
+	static void sVerifyRegShadows( void* self, void* refcon );
+	void verifyRegShadows( void );
+#endif
 	virtual bool performFunction(const IOPlatformFunction *func, void *param1 = 0,
 			void *param2 = 0, void *param3 = 0, void *param4 = 0);
+	void buildConfigGates( void );
+	u3_pf_config_gate_t *findConfigGate( UInt32 pHandle );
+	u3_pf_program_t *compilePlatformFunction( const IOPlatformFunction *func );
+	void freePlatformProgram( u3_pf_program_t *program );
+	bool runPlatformProgram( u3_pf_program_t *program, void *param1 );
+	void execPlatformOp( u3_pf_program_t *program, const u3_pf_op_t *op, IOPCIDevice *nub, UInt32 *data,
+		void *param1, UInt32 lockDomains );
+#ifdef U3_PF_TRACE
+	static void tracePlatformOp( u3_pf_program_t *program, const u3_pf_op_t *op, UInt64 elapsed );
+	void addPlatformFunctionTrace( OSDictionary *dict, const OSSymbol *name, const u3_pf_program_t *program );
+	OSDictionary *copyPlatformFunctionTrace( void );
+#endif
+	IOReturn startPlatformProgram( u3_pf_program_t *program, void *param1, u3_pf_completion_t completion, void *refcon );
+	IOReturn beginPlatformProgram( u3_pf_program_t *program, void *param1, u3_pf_completion_t completion, void *refcon );
+	bool runPlatformProgramAndWait( u3_pf_program_t *program, void *param1 );
+	static void sResumePlatformProgram( thread_call_param_t self, thread_call_param_t program );
+	void stepPlatformProgram( u3_pf_program_t *program );
+	void releasePlatformExec( u3_pf_exec_t *exec );
+	void buildPowerPhase( UInt32 phase, UInt32 flag );
+	void freePowerPhase( u3_power_phase_t *powerPhase );
+	void resolvePowerPhaseNubs( u3_power_phase_t *powerPhase );
+	void runPowerPhase( UInt32 phase, UInt32 parts );
+	bool runPowerProgram( u3_pf_program_t *program, IOPCIDevice *nub );
+	static void sReleasePowerGates( thread_call_param_t self, thread_call_param_t );
+	void releasePowerGates( void );
 	virtual IOPCIDevice* findNubForPHandle( UInt32 pHandleValue );
+	static bool sPCINubPublished( void *target, void *refCon, IOService *newService );
+	static bool sPCINubTerminated( void *target, void *refCon, IOService *newService );
+	void addPHandleEntry( IOPCIDevice *nub );
+	void removePHandleEntry( IOPCIDevice *nub );
+	IOPCIDevice *lookupPHandle( UInt32 pHandleValue );
 
-	virtual void prepareForSleep ( void );
 	virtual bool getHTLinkFrequency (UInt32 *freqResult);
 	virtual bool setHTLinkFrequency (UInt32 newFreq);
 	virtual bool getHTLinkWidth (UInt32 *linkOutWidthResult, UInt32 *linkInWidthResult);
 	virtual bool setHTLinkWidth (UInt32 newLinkOutWidth, UInt32 newLinkInWidth);
-	virtual void u3APIPhyDisableProcessor1 ( void );
 
 	virtual IOReturn	installChipFaultHandler ( IOService * provider );
+	void				readChipFaultState ( u3_chip_fault_state_t *state );
+	void				handleChipFaultState ( const u3_chip_fault_state_t *state, void *refcon );
+	static const u3_chip_map_t *getChipMap ( UInt32 variant );
+	template <UInt32 Variant> void chipFaultFor ( void *refcon );
+	template <UInt32 Variant> void readChipFaultStateFor ( u3_chip_fault_state_t *state );
+	template <UInt32 Variant> void handleChipFaultStateFor ( const u3_chip_fault_state_t *state, void *refcon );
+	void				decodeU3DARTExcp ( UInt32 dartexcp );
+	void				decodeU4DARTExcp ( UInt32 dartexcp );
+	void				decodeU3HeavyECC ( const u3_chip_fault_state_t *state, const u3_chip_fault_decode_t *decode, void *refcon );
+	void				decodeU4ECC ( const u3_chip_fault_state_t *state, const u3_chip_fault_decode_t *decode, void *refcon );
+	void				countECCError ( const u3_chip_fault_decode_t *decode, void *refcon );
 	virtual void		eccNotifier( void * refcon );
 	virtual void		setupECC( void );
 	virtual void		setupDARTExcp( void );
 };
 
+#ifdef U3_MMIO_TRACE
+#define U3_TRACE_ACCESS(op, offset, value)	traceUniNAccess((op), (offset), (value), __builtin_return_address(0))
+#else
+#define U3_TRACE_ACCESS(op, offset, value)
+#endif
+
+// **********************************************************************************
+// readUniNReg
+//
+// **********************************************************************************
+inline UInt32 AppleU3::readUniNReg(UInt32 offset)
+{
+	UInt32 data = uniNBaseAddress[offset >> 2];
+
+	U3_TRACE_ACCESS(kU3TraceRead, offset, data);
+
+    return data;
+}
+
+// **********************************************************************************
+// writeUniNReg
+//
+// **********************************************************************************
+inline void AppleU3::writeUniNReg(UInt32 offset, UInt32 data)
+{
+    uniNBaseAddress[offset >> 2] = data;
+
+	U3_TRACE_ACCESS(kU3TraceWrite, offset, data);
+
+    OSSynchronizeIO();
+
+	return;
+}
+
+// **********************************************************************************
+// storeUniNReg
+//
+// Unfenced store - callers are responsible for issuing OSSynchronizeIO()
+// **********************************************************************************
+inline void AppleU3::storeUniNReg(UInt32 offset, UInt32 data)
+{
+    uniNBaseAddress[offset >> 2] = data;
+
+	U3_TRACE_ACCESS(kU3TraceWrite, offset, data);
+
+	return;
+}
+
 #endif /*  _IOKIT_APPLE_U3_H */
@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+#ifndef _IOKIT_U3_CHIP_STATE_H
+#define _IOKIT_U3_CHIP_STATE_H
+
+#include <libkern/OSTypes.h>
+
+#include "U3RegTransaction.h"
+#include "U3RegAccess.h"
+#include "U3RegField.h"
+#include "U3ECCSyndrome.h"
+
+// The register sequences of start, sleep and wake, the HT link and the chip fault handler.  Like
+// the register engine they are written against a U3RegTransaction.h port, so the HostTests run
+// them against a simulated Uni-N.  Register offsets and bits come from two classes, which the
+// driver defines from the Uni-N headers and the HostTests define with stand-in values:
+//
+//	Regs, registers every variant has - U3UniNRegs in the driver
+//		enums		versionReg, minVersion, dartCntlReg, pmClockControlReg, vspSoftResetReg,
+//					hwInitStateReg, hwInitRunning, hwInitSleeping, toggleReg, mpicEnableOutputs
+//		functions	static bool isU4(UInt32 version), static bool isU3Heavy(UInt32 version)
+//		typedefs	HTLinkFreqField, HTLinkOutWidthField, HTLinkInWidthField
+//
+//	Chip, a variant's chip fault registers - U3ChipTraits<Variant> in the driver
+//		enums		faultMaskReg, faultExcpReg, dartExcpReg, dartExcpBits, dartWriteMask,
+//					eccStyle, eccExcpBits, eccUEBits, eccCEBits, eccUpperBits,
+//					memErrAddrReg, memErrAddrReg1 (0 if none), memErrSyndromeReg
+//		typedefs	RankField, plus for kU3ECCU3Heavy SyndromeUpperField and SyndromeLowerField,
+//					for kU3ECCU4 SyndromeField
+
+// Chipset variants.  start() picks one from uniNVersion and everything that differs between
+// the chips - register offsets, interrupt bits, fault decode - is reached through its
+// u3_chip_map_t instead of testing IS_U4/IS_U3_HEAVY on every call.
+enum
+{
+	kU3VariantLite		= 0,
+	kU3VariantHeavy		= 1,
+	kU3VariantU4		= 2,
+	kU3NumVariants		= 3
+};
+
+// How a variant reports ECC errors, Chip::eccStyle
+enum
+{
+	kU3ECCNone			= 0,	// U3 Lite has no ECC
+	kU3ECCU3Heavy		= 1,	// UE and CE bits per DIMM of the rank, syndrome in two bytes
+	kU3ECCU4			= 2		// UE and CE bits per rank, syndrome whole
+};
+
+// Error state captured by the chip fault handler.  Registers that the exception didn't call
+// for are left zero.
+typedef struct _u3_chip_fault_state_t
+{
+	UInt32	apiexcp;
+	UInt32	dartexcp;
+	UInt32	mear;
+	UInt32	mear1;		// U4 only
+	UInt32	mesr;
+} u3_chip_fault_state_t;
+
+// What a captured chip fault calls for, from U3DecodeChipFault
+enum
+{
+	kU3FaultDARTWrite			= (1 << 0),	// log the DART exception
+	kU3FaultECCUncorrectable	= (1 << 1),	// panic naming dimmCount DIMMs from dimm
+	kU3FaultECCCorrectable		= (1 << 2)	// count an error against dimmCount DIMMs from dimm
+};
+
+typedef struct _u3_chip_fault_decode_t
+{
+	UInt32	actions;	// kU3Fault*
+	UInt32	rank;
+	UInt32	dimm;
+	UInt32	dimmCount;
+} u3_chip_fault_decode_t;
+
+// Uni-N registers that lose their contents across sleep and that nothing else restores
+typedef struct _u3_uni_n_saved_t
+{
+	UInt32	dartCntl;
+	UInt32	clockCntl;		// only with PM clock control
+	UInt32	vspSoftReset;	// only with PM clock control
+} u3_uni_n_saved_t;
+
+#define kU3UniNRestoreEntries	5	// most entries U3BuildUniNRestore fills in
+#define kU3UniNSleepEntries		2	// most entries U3BuildUniNSleep fills in
+
+// **********************************************************************************
+// U3ChipVariantFor
+//
+// The variant of a chip whose version register reads version, or kU3NumVariants if the
+// driver doesn't support it
+// **********************************************************************************
+template <class Regs> UInt32 U3ChipVariantFor( UInt32 version )
+{
+	if (version < (UInt32) Regs::minVersion)
+		return kU3NumVariants;
+
+	if (Regs::isU4(version))
+		return kU3VariantU4;
+
+	if (Regs::isU3Heavy(version))
+		return kU3VariantHeavy;
+
+	return kU3VariantLite;
+}
+
+// **********************************************************************************
+// U3SaveUniNState, U3BuildUniNRestore
+//
+// The save reads from hardware.  Firmware and the DART code write these registers too, so
+// they are deliberately not shadowed.  The restore is built as a transaction for the wake
+// path to run under one acquisition of the locks.
+// **********************************************************************************
+template <class Regs, class Port> void U3SaveUniNState( Port &port, const u3_reg_access_t *index,
+	bool hasPMClockControl, u3_uni_n_saved_t *saved )
+{
+	saved->dartCntl = U3ReadRegClassified( port, index, Regs::dartCntlReg );
+
+	if (hasPMClockControl)
+	{
+		saved->clockCntl = U3ReadRegClassified( port, index, Regs::pmClockControlReg );
+		saved->vspSoftReset = U3ReadRegClassified( port, index, Regs::vspSoftResetReg );
+	}
+}
+
+static inline void U3SetRegTransaction( u3_reg_transaction_t *entry, UInt32 offset, UInt32 mask, UInt32 value )
+{
+	entry->op = kU3RegOpWrite;
+	entry->offset = offset;
+	entry->mask = mask;
+	entry->value = value;
+}
+
+template <class Regs> UInt32 U3BuildUniNRestore( const u3_uni_n_saved_t *saved, bool hasMPIC,
+	bool hasPMClockControl, u3_reg_transaction_t *list )
+{
+	UInt32 count = 0;
+
+	// Set MPIC interrupt enable bits in the toggle register, but only if MPIC is present
+	if (hasMPIC)
+		U3SetRegTransaction( &list[count++], Regs::toggleReg, Regs::mpicEnableOutputs, Regs::mpicEnableOutputs );
+
+	// Set the running state for HWInit
+	U3SetRegTransaction( &list[count++], Regs::hwInitStateReg, 0xFFFFFFFF, Regs::hwInitRunning );
+
+	U3SetRegTransaction( &list[count++], Regs::dartCntlReg, 0xFFFFFFFF, saved->dartCntl );
+
+	// ClockControl moved (and is saved by the SPU), and VSPSoftReset no longer exists, on U4
+	if (hasPMClockControl)
+	{
+		U3SetRegTransaction( &list[count++], Regs::pmClockControlReg, 0xFFFFFFFF, saved->clockCntl );
+		U3SetRegTransaction( &list[count++], Regs::vspSoftResetReg, 0xFFFFFFFF, saved->vspSoftReset );
+	}
+
+	return count;
+}
+
+// **********************************************************************************
+// U3BuildUniNSleep
+//
+// The sleeping state tells OF we were sleeping; with MPIC present its outputs are turned off
+// **********************************************************************************
+template <class Regs> UInt32 U3BuildUniNSleep( bool hasMPIC, u3_reg_transaction_t *list )
+{
+	UInt32 count = 0;
+
+	U3SetRegTransaction( &list[count++], Regs::hwInitStateReg, 0xFFFFFFFF, Regs::hwInitSleeping );
+
+	if (hasMPIC)
+		U3SetRegTransaction( &list[count++], Regs::toggleReg, Regs::mpicEnableOutputs, 0 );
+
+	return count;
+}
+
+// **********************************************************************************
+// U3GetHTLinkFrequency, U3SetHTLinkFrequency, U3GetHTLinkWidth, U3SetHTLinkWidth
+//
+// Field values as the HT link registers hold them; setting both widths is one masked write
+// **********************************************************************************
+template <class Regs, class Port> UInt32 U3GetHTLinkFrequency( Port &port, const u3_reg_access_t *index )
+{
+	typedef typename Regs::HTLinkFreqField	FreqField;
+
+	return U3GetRegField<FreqField>( U3ReadRegClassified( port, index, FreqField::offset ) );
+}
+
+template <class Regs, class Port> void U3SetHTLinkFrequency( Port &port, UInt32 freq )
+{
+	typedef typename Regs::HTLinkFreqField	FreqField;
+	u3_reg_transaction_t					write;
+
+	U3SetRegTransaction( &write, FreqField::offset, FreqField::mask, U3SetRegField<FreqField>( 0, freq ) );
+	U3RunRegTransaction( port, &write, 1 );
+}
+
+template <class Regs, class Port> void U3GetHTLinkWidth( Port &port, const u3_reg_access_t *index,
+	UInt32 *outWidth, UInt32 *inWidth )
+{
+	typedef typename Regs::HTLinkOutWidthField	OutField;
+	typedef typename Regs::HTLinkInWidthField	InField;
+	UInt32										width;
+
+	width = U3ReadRegClassified( port, index, OutField::offset );
+	*outWidth = U3GetRegField<OutField>( width );
+	*inWidth = U3GetRegField<InField>( width );
+}
+
+template <class Regs, class Port> void U3SetHTLinkWidth( Port &port, UInt32 outWidth, UInt32 inWidth )
+{
+	typedef typename Regs::HTLinkOutWidthField	OutField;
+	typedef typename Regs::HTLinkInWidthField	InField;
+	typedef char widthsShareARegister[((UInt32) OutField::offset == (UInt32) InField::offset) ? 1 : -1];
+	u3_reg_transaction_t						write;
+
+	(void) sizeof( widthsShareARegister );
+	U3SetRegTransaction( &write, OutField::offset, OutField::mask | InField::mask,
+		U3SetRegField<InField>( U3SetRegField<OutField>( 0, outWidth ), inWidth ) );
+	U3RunRegTransaction( port, &write, 1 );
+}
+
+// **********************************************************************************
+// U3ReadChipFaultState
+//
+// Given state->apiexcp, reads the DART and memory controller error registers that the
+// exception calls for.  Reading the MESR clears the ECC state.
+// **********************************************************************************
+template <class Chip, class Port> void U3ReadChipFaultState( Port &port, const u3_reg_access_t *index,
+	u3_chip_fault_state_t *state )
+{
+	state->dartexcp = state->mear = state->mear1 = state->mesr = 0;
+
+	if (state->apiexcp & Chip::dartExcpBits)
+		state->dartexcp = U3ReadRegClassified( port, index, Chip::dartExcpReg );
+
+	if (state->apiexcp & Chip::eccExcpBits)		// always false on U3 Lite
+	{
+		state->mear = U3ReadRegClassified( port, index, Chip::memErrAddrReg );
+		if (Chip::memErrAddrReg1 != 0)
+			state->mear1 = U3ReadRegClassified( port, index, Chip::memErrAddrReg1 );
+		state->mesr = U3ReadRegClassified( port, index, Chip::memErrSyndromeReg );
+	}
+}
+
+// **********************************************************************************
+// U3CaptureChipFault, U3RestoreChipFaultMask
+//
+// Masks every chip fault source and reads the exception register, which clears it, in one
+// transaction, then reads the rest of the error state.  Returns the mask to restore once the
+// fault is handled.
+// **********************************************************************************
+template <class Chip, class Port> UInt32 U3CaptureChipFault( Port &port, const u3_reg_access_t *index,
+	u3_chip_fault_state_t *state )
+{
+	u3_reg_transaction_t faultList[3];
+
+	faultList[0].op = kU3RegOpRead;
+	faultList[0].offset = Chip::faultMaskReg;
+	U3SetRegTransaction( &faultList[1], Chip::faultMaskReg, 0xFFFFFFFF, 0 );
+	faultList[2].op = kU3RegOpRead;
+	faultList[2].offset = Chip::faultExcpReg;
+
+	U3RunRegTransaction( port, faultList, 3 );
+
+	state->apiexcp = faultList[2].value;
+	U3ReadChipFaultState<Chip>( port, index, state );
+
+	return faultList[0].value;
+}
+
+template <class Chip, class Port> void U3RestoreChipFaultMask( Port &port, UInt32 savedMask )
+{
+	u3_reg_transaction_t write;
+
+	U3SetRegTransaction( &write, Chip::faultMaskReg, savedMask, savedMask );
+	U3RunRegTransaction( port, &write, 1 );
+}
+
+// **********************************************************************************
+// U3ECCDecoder
+//
+// Which DIMMs an ECC error is in, for each Chip::eccStyle.  With a U3 Heavy, an _H bit names
+// the upper DIMM of the pair and an _L bit the lower; with both set the error is reported
+// against both.  U4 reports a rank, so an uncorrectable error names both of its DIMMs.  A
+// correctable error's syndrome names the bit, and so the DIMM, it corrected.
+// **********************************************************************************
+template <UInt32 Style> struct U3ECCDecoder;
+
+template <> struct U3ECCDecoder<kU3ECCNone>
+{
+	template <class Chip> static void decode( const u3_chip_fault_state_t *, u3_chip_fault_decode_t * ) {}
+};
+
+template <> struct U3ECCDecoder<kU3ECCU3Heavy>
+{
+	template <class Chip> static void decode( const u3_chip_fault_state_t *state, u3_chip_fault_decode_t *decode )
+	{
+		typedef typename Chip::RankField			RankField;
+		typedef typename Chip::SyndromeUpperField	UpperField;
+		typedef typename Chip::SyndromeLowerField	LowerField;
+		UInt32										activeUEbits, activeCEbits, bit, bitHalf;
+
+		decode->rank = U3GetRegField<RankField>( state->mear );
+		decode->dimm = decode->rank - (decode->rank % 2);	// lower DIMM of the pair
+
+		activeUEbits = state->apiexcp & Chip::eccUEBits;
+		activeCEbits = state->apiexcp & Chip::eccCEBits;
+
+		// An uncorrectable error is fatal, so any correctable one with it doesn't matter
+		if (activeUEbits)
+		{
+			decode->actions |= kU3FaultECCUncorrectable;
+			if (activeUEbits == (UInt32) Chip::eccUEBits)
+				decode->dimmCount = 2;
+			else
+			{
+				if (activeUEbits & Chip::eccUpperBits)
+					decode->dimm++;
+				decode->dimmCount = 1;
+			}
+			return;
+		}
+
+		if (!activeCEbits)
+			return;
+
+		// A data bit names the DIMM it is on; if that DIMM's CE bit is set, count the error against
+		// it alone.  Check bits, multi-bit syndromes and a bit on a half the CE bits don't flag
+		// leave the CE bits to decide.
+		bit = U3DecodeSyndrome( U3HeavySyndrome( U3GetRegField<UpperField>( state->mesr ),
+			U3GetRegField<LowerField>( state->mesr ) ) );
+		if (bit < kU3SyndromeFirstCheckBit)
+		{
+			bitHalf = Chip::eccCEBits & (U3SyndromeBitOnUpperDIMM( bit ) ? Chip::eccUpperBits : ~Chip::eccUpperBits);
+			if (activeCEbits & bitHalf)
+				activeCEbits = bitHalf;
+		}
+
+		decode->actions |= kU3FaultECCCorrectable;
+		if (activeCEbits == (UInt32) Chip::eccCEBits)
+			decode->dimmCount = 2;
+		else
+		{
+			if (activeCEbits & Chip::eccUpperBits)
+				decode->dimm++;
+			decode->dimmCount = 1;
+		}
+	}
+};
+
+template <> struct U3ECCDecoder<kU3ECCU4>
+{
+	template <class Chip> static void decode( const u3_chip_fault_state_t *state, u3_chip_fault_decode_t *decode )
+	{
+		typedef typename Chip::RankField		RankField;
+		typedef typename Chip::SyndromeField	SyndromeField;
+
+		decode->dimm = decode->rank = U3GetRegField<RankField>( state->mear );
+
+		if (state->apiexcp & Chip::eccUEBits)
+		{
+			decode->actions |= kU3FaultECCUncorrectable;
+			decode->dimmCount = 2;
+			return;
+		}
+
+		decode->actions |= kU3FaultECCCorrectable;
+		decode->dimmCount = 1;
+		if (U3SyndromeBitOnUpperDIMM( U3DecodeSyndrome( U3GetRegField<SyndromeField>( state->mesr ) ) ))
+			decode->dimm++;
+	}
+};
+
+// **********************************************************************************
+// U3DecodeChipFault
+//
+// What a captured chip fault calls for.  Only DART write exceptions are reported; reads are
+// often PCI speculative reads, which are typically bogus.
+// **********************************************************************************
+template <class Chip> void U3DecodeChipFault( const u3_chip_fault_state_t *state, u3_chip_fault_decode_t *decode )
+{
+	decode->actions = decode->rank = decode->dimm = decode->dimmCount = 0;
+
+	if ((state->apiexcp & Chip::dartExcpBits) && (state->dartexcp & Chip::dartWriteMask))
+		decode->actions |= kU3FaultDARTWrite;
+
+	if (state->apiexcp & Chip::eccExcpBits)
+		U3ECCDecoder<(UInt32) Chip::eccStyle>::template decode<Chip>( state, decode );
+}
+
+#endif /* _IOKIT_U3_CHIP_STATE_H */
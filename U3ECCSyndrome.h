@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+
+#ifndef _IOKIT_U3_ECC_SYNDROME_H
+#define _IOKIT_U3_ECC_SYNDROME_H
+
+#include <libkern/OSTypes.h>
+
+// The memory controller protects each 128 bits of data, spread across the two DIMMs of a rank,
+// with 16 check bits.  A correctable error leaves the 16-bit syndrome of the flipped bit in the
+// MESR: U4 reports it whole, U3 Heavy as an upper and a lower byte.  Data bits 0-63 are on the
+// lower DIMM of the rank and 64-127 on the upper one.
+
+// Use this Syndrome Table to match against the MESR to determine exactly
+// which bit was corrected [0:143].  Note: this only works for correctable 1-bit
+// errors -- with uncorrectable errors, we can only know the rank.
+#define kECCAllBits 144
+static const UInt16 SyndromeTable[kECCAllBits] =
+{
+        0x0849 , 0x0428 , 0x0214 , 0x01C2 , 0x9084 , 0x8042 , 0x4021 , 0x201C , 0x4908 ,
+        0x2804 , 0x1402 , 0xC201 , 0x8490 , 0x4280 , 0x2140 , 0x1C20 , 0x0894 , 0x0482 ,
+        0x0241 , 0x012C , 0x4089 , 0x2048 , 0x1024 , 0xC012 , 0x9408 , 0x8204 , 0x4102 ,
+        0x2C01 , 0x8940 , 0x4820 , 0x2410 , 0x12C0 , 0x0881 , 0x044C , 0x0226 , 0x0113 ,
+        0x1088 , 0xC044 , 0x6022 , 0x3011 , 0x8108 , 0x4C04 , 0x2602 , 0x1301 , 0x8810 ,
+        0x44C0 , 0x2260 , 0x1130 , 0x0288 , 0x0144 , 0x0C22 , 0x0611 , 0x8028 , 0x4014 ,
+        0x20C2 , 0x1061 , 0x8802 , 0x4401 , 0x220C , 0x1106 , 0x2880 , 0x1440 , 0xC220 ,
+        0x6110 , 0x0B48 , 0x0924 , 0x0812 , 0x04C1 , 0x80B4 , 0x4092 , 0x2081 , 0x104C ,
+        0x480B , 0x2409 , 0x1208 , 0xC104 , 0xB480 , 0x9240 , 0x8120 , 0x4C10 , 0x0198 ,
+        0x0C84 , 0x0642 , 0x0321 , 0x8019 , 0x40C8 , 0x2064 , 0x1032 , 0x9801 , 0x840C ,
+        0x4206 , 0x2103 , 0x1980 , 0xC840 , 0x6420 , 0x3210 , 0x0868 , 0x0434 , 0x02D2 ,
+        0x01A1 , 0x8086 , 0x4043 , 0x202D , 0x101A , 0x6808 , 0x3404 , 0xD202 , 0xA101 ,
+        0x8680 , 0x4340 , 0x2D20 , 0x1A10 , 0x8884 , 0x4442 , 0x2221 , 0x111C , 0x4888 ,
+        0x2444 , 0x1222 , 0xC111 , 0x8488 , 0x4244 , 0x2122 , 0x1C11 , 0x8848 , 0x4424 ,
+        0x2212 , 0x11C1 , 0x8000 , 0x4000 , 0x2000 , 0x1000 , 0x0800 , 0x0400 , 0x0200 ,
+        0x0100 , 0x0080 , 0x0040 , 0x0020 , 0x0010 , 0x0008 , 0x0004 , 0x0002 , 0x0001
+};
+
+#define kU3SyndromeFirstCheckBit	128		// 128-143 are the check bits themselves
+#define kU3SyndromeMultiBit			0xFF	// no single-bit error gives this syndrome
+
+// U3 Heavy's MESR syndrome bytes, put back together
+static inline UInt32 U3HeavySyndrome( UInt32 upperSyndrome, UInt32 lowerSyndrome )
+{
+	return ((upperSyndrome & 0xFF) << 8) | (lowerSyndrome & 0xFF);
+}
+
+// True if a corrected bit is on the upper DIMM of its rank.  Check bits count as the lower DIMM.
+static inline bool U3SyndromeBitOnUpperDIMM( UInt32 bit )
+{
+	return (bit > 63) && (bit < kU3SyndromeFirstCheckBit);
+}
+
+#ifndef U3_SYNDROME_GENERATOR
+
+// The decode table is a perfect hash of the 144 syndromes: a multiplier was searched for under
+// which the top bits of each syndrome's product land in a slot of their own.  Each slot holds
+// the bit its syndrome corrects, so a decode is one multiply, the slot load, and a load of
+// SyndromeTable to confirm the syndrome is the one the slot was made for.  Generated by
+// HostTests/GenSyndromeDecode; make -C HostTests checks it is current.
+#include "U3ECCSyndromeDecode.h"
+
+static inline UInt32 U3SyndromeSlot( UInt32 syndrome )
+{
+	return (syndrome * kU3SyndromeHashMultiplier) >> (32 - kU3SyndromeHashBits);
+}
+
+// **********************************************************************************
+// U3DecodeSyndrome
+//
+// Bit whose single-bit error gives syndrome, or kU3SyndromeMultiBit, by table lookup
+// **********************************************************************************
+static inline UInt32 U3DecodeSyndrome( UInt32 syndrome )
+{
+	UInt32 bit;
+
+	if (syndrome > 0xFFFF)
+		return kU3SyndromeMultiBit;
+
+	bit = gU3SyndromeDecode[ U3SyndromeSlot( syndrome ) ];
+	if ((bit < kECCAllBits) && (SyndromeTable[bit] == syndrome))
+		return bit;
+
+	return kU3SyndromeMultiBit;
+}
+
+#endif /* U3_SYNDROME_GENERATOR */
+
+#endif /* _IOKIT_U3_ECC_SYNDROME_H */
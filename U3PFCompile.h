@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+#ifndef _IOKIT_U3_PF_COMPILE_H
+#define _IOKIT_U3_PF_COMPILE_H
+
+#include <libkern/OSTypes.h>
+
+#include "IOPlatformFunction.h"
+#include "U3RegTransaction.h"
+
+// An on-demand function's command words are parsed and validated once, in start(), into a
+// program of these ops.  Constant operands are folded at that point, so running the program
+// neither allocates nor re-parses anything.
+enum
+{
+	kU3PFOpWriteReg = 0,		// reg = keepMask ? (reg & keepMask) | value : value
+	kU3PFOpReadConfig,			// data = configRead32(offset), returned through param1
+	kU3PFOpRMWConfig,			// configWrite32(offset, (data & keepMask) | value)
+	kU3PFOpDelay,				// park for value microseconds
+	kU3PFOpWaitReg				// park until (reg & keepMask) == value
+};
+
+typedef struct _u3_pf_op_t
+{
+	UInt32					opcode;		// kU3PFOp*
+	UInt32					offset;
+	UInt32					keepMask;	// bits preserved from the current value, 0 means none
+	UInt32					value;
+} u3_pf_op_t;
+
+// What a compiled command set needs besides its ops
+enum
+{
+	kU3PFCompileConfig	= (1 << 0),		// has config ops, so it needs its pHandle's nub
+	kU3PFCompileParks	= (1 << 1)		// has Delay or WaitReg ops, so it needs an executor
+};
+
+// **********************************************************************************
+// U3CompilePFCommands
+//
+// Compiles the commands under cursor into ops, at most maxOps of them.  Returns the op count,
+// or 0 if the set is malformed, too long, or has a command we can't compile, and sets *flags
+// to kU3PFCompile*.  pHandle is the command set's, config ops need one.
+// **********************************************************************************
+static inline UInt32 U3CompilePFCommands( IOPlatformFunctionCursor cursor, UInt32 pHandle, u3_pf_op_t *ops,
+	UInt32 maxOps, UInt32 *flags )
+{
+	IOPFCommandView				cmd;
+	u3_pf_op_t					*op;
+	UInt32 						count, param1, param2, param3, param4;
+	bool						ok;
+
+	*flags = 0;
+	ok = true;
+	for (count = 0, op = ops; ok && cursor.next (&cmd); count++, op++) {
+		if (count == maxOps)
+			return 0;
+
+		// Only the first four fixed parameters are used by the commands we handle
+		param1 = (cmd.paramCount > 0) ? cmd.params[0] : 0;
+		param2 = (cmd.paramCount > 1) ? cmd.params[1] : 0;
+		param3 = (cmd.paramCount > 2) ? cmd.params[2] : 0;
+		param4 = (cmd.paramCount > 3) ? cmd.params[3] : 0;
+
+		op->keepMask = 0;
+		op->value = 0;
+		switch (cmd.cmd) {
+			case kCommandWriteReg32:
+				// An all-ones mask means a plain write, same as no bits kept
+				op->opcode = kU3PFOpWriteReg;
+				op->offset = param1;
+				op->value = param2;
+				op->keepMask = (param3 == 0xFFFFFFFF) ? 0 : param3;
+				break;
+
+			case kCommandReadConfig:
+				ok = (param2 == 4) && (pHandle != 0);
+				op->opcode = kU3PFOpReadConfig;
+				op->offset = param1;
+				*flags |= kU3PFCompileConfig;
+				break;
+
+			case kCommandRMWConfig:
+				// The mask and value arrays belong to the function, but copying them here
+				// means the ops are self-contained
+				ok = (*flags & kU3PFCompileConfig) && (param2 == 4) && (param3 == 4) && (param4 == 4);
+				op->opcode = kU3PFOpRMWConfig;
+				op->offset = param1;
+				if (ok) {
+					op->keepMask = *(const UInt32 *)cmd.bytes;
+					op->value = *(const UInt32 *)(cmd.bytes + param2);
+				}
+				break;
+
+			case kCommandDelay:
+				op->opcode = kU3PFOpDelay;
+				op->offset = 0;
+				op->value = param1;
+				*flags |= kU3PFCompileParks;
+				break;
+
+			// Uni-N registers are 32 bits wide, so there is no 16 or 8 bit wait here
+			case kCommandWaitReg32:
+				op->opcode = kU3PFOpWaitReg;
+				op->offset = param1;
+				op->value = param2;
+				op->keepMask = param3;
+				*flags |= kU3PFCompileParks;
+				break;
+
+			default:
+				ok = false;
+				break;
+		}
+	}
+
+	if (!ok || (cursor.getError() != kIOPFNoError))
+		return 0;
+
+	return count;
+}
+
+// **********************************************************************************
+// U3PFRegDomains
+//
+// kU3LockDomain* mask of the registers a program writes or waits on, the register half of its
+// conflict set.  Port is a U3RegTransaction.h register port.
+// **********************************************************************************
+template <class Port> UInt32 U3PFRegDomains( Port &port, const u3_pf_op_t *ops, UInt32 opCount )
+{
+	const u3_pf_op_t	*op;
+	UInt32				domains = 0;
+
+	for (op = ops; op < &ops[opCount]; op++)
+		if ((op->opcode == kU3PFOpWriteReg) || (op->opcode == kU3PFOpWaitReg))
+			domains |= 1 << port.lockDomain (op->offset);
+
+	return domains;
+}
+
+// **********************************************************************************
+// U3PFOpToRegWrite
+//
+// A WriteReg op as a register transaction write, for merging register-only programs into one
+// batch.  reg = (reg & keep) | value is the transaction write with mask = ~keep | value; a keep
+// of 0 stays a plain write.
+// **********************************************************************************
+static inline void U3PFOpToRegWrite( const u3_pf_op_t *op, u3_reg_transaction_t *entry )
+{
+	entry->op = kU3RegOpWrite;
+	entry->offset = op->offset;
+	entry->mask = op->keepMask ? (~op->keepMask | op->value) : 0xFFFFFFFF;
+	entry->value = op->value;
+}
+
+// Running ops needs a program port: a register port that also provides
+//
+//	lockGate(), unlockGate()					own and give up the program's config gate
+//	UInt32 configRead(UInt32 offset)			configWrite(UInt32 offset, UInt32 data), the program's nub
+//	execOp(const u3_pf_op_t *op, UInt32 *data, UInt32 lockDomains)	runs one op, normally through U3ExecPFOp
+
+// **********************************************************************************
+// U3ExecPFOp
+//
+// Runs one register or config op.  lockDomains is taken around a register write when the
+// caller holds the config gate rather than the program's domains, 0 if it already holds them.
+// Delay and WaitReg are the executor's business and are ignored here.
+// **********************************************************************************
+template <class Port> void U3ExecPFOp( Port &port, const u3_pf_op_t *op, UInt32 *data, UInt32 lockDomains )
+{
+	typename Port::LockState	lockState;
+
+	switch (op->opcode) {
+		case kU3PFOpWriteReg:
+			if (lockDomains) {
+				lockState = port.lock (lockDomains);
+				*data = U3WriteRegKeepingBits (port, op->offset, op->keepMask, op->value);
+				port.unlock (lockDomains, lockState);
+			} else
+				*data = U3WriteRegKeepingBits (port, op->offset, op->keepMask, op->value);
+			break;
+
+		case kU3PFOpReadConfig:
+			*data = port.configRead (op->offset);
+			break;
+
+		case kU3PFOpRMWConfig:
+			*data &= op->keepMask;
+			*data |= op->value;
+			port.configWrite (op->offset, *data);
+			break;
+	}
+
+	return;
+}
+
+// **********************************************************************************
+// U3RunPFOps
+//
+// Runs a program that doesn't park.  A program with config ops owns its nub's gate for the whole
+// run, so its read-modify-write of config space is atomic, and takes its register domains per
+// write since config cycles can't be run with interrupts off.  Any other program holds its
+// domains for the whole run.
+// **********************************************************************************
+template <class Port> void U3RunPFOps( Port &port, const u3_pf_op_t *ops, UInt32 opCount, UInt32 regDomains,
+	bool gated, UInt32 *data )
+{
+	typename Port::LockState	lockState = 0;
+	const u3_pf_op_t			*op;
+
+	if (gated)
+		port.lockGate ();
+	else
+		lockState = port.lock (regDomains);
+
+	for (op = ops; op < &ops[opCount]; op++)
+		port.execOp (op, data, gated ? regDomains : 0);
+
+	if (gated)
+		port.unlockGate ();
+	else
+		port.unlock (regDomains, lockState);
+
+	return;
+}
+
+#endif /* _IOKIT_U3_PF_COMPILE_H */
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+#ifndef _IOKIT_U3_PF_DISPATCH_H
+#define _IOKIT_U3_PF_DISPATCH_H
+
+#include <libkern/OSTypes.h>
+
+// The callPlatformFunction dispatch table is open-addressed and keyed by OSSymbol pointer.  It is
+// sized in start() to stay at most half full and is read-only afterwards, so a lookup is one
+// hash and a short linear probe that always ends, at the key or at an empty slot.
+
+// Multiplicative hash of an OSSymbol pointer.  The low bits of an object address carry little
+// information, so they are shifted out first.  The slot is taken from the low bits of the result,
+// so the upper half of the product is folded down onto them; taking the upper half alone put
+// symbols allocated a fixed distance apart into runs of neighbouring slots.
+static inline UInt32 U3PFHash( const void *sym )
+{
+	UInt32 hash = (((UInt32)(unsigned long)sym) >> 4) * 2654435761U;
+
+	return hash ^ (hash >> 16);
+}
+
+#define kU3PFDispatchMinSlots	16
+
+// **********************************************************************************
+// U3PFDispatchSlots
+//
+// Power of 2 slot count that keeps count entries at most half full
+// **********************************************************************************
+static inline UInt32 U3PFDispatchSlots( UInt32 count )
+{
+	UInt32 size;
+
+	for (size = kU3PFDispatchMinSlots; size < (count * 2); size <<= 1)
+		;
+
+	return size;
+}
+
+// **********************************************************************************
+// U3PFDispatchProbe
+//
+// Slot holding key, or the empty slot (key NULL) where key would go.  Entry is any
+// struct with a key member; mask is the slot count - 1.
+// **********************************************************************************
+template <class Entry> inline UInt32 U3PFDispatchProbe( const Entry *table, UInt32 mask, const void *key )
+{
+	UInt32 slot;
+
+	for (slot = U3PFHash(key) & mask; table[slot].key; slot = (slot + 1) & mask)
+		if (table[slot].key == key)
+			break;
+
+	return slot;
+}
+
+#endif /* _IOKIT_U3_PF_DISPATCH_H */
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+#ifndef _IOKIT_U3_REG_ACCESS_H
+#define _IOKIT_U3_REG_ACCESS_H
+
+#include <libkern/OSTypes.h>
+
+// Register access classification used by the safe accessors.  Registers not listed in the
+// classification table are plain - reads have no side effects and are done without a lock.
+enum
+{
+	kU3RegAccessPlain			= 0,
+	kU3RegAccessRMW				= (1 << 0),	// driver does read-modify-write on this register
+	kU3RegAccessReadSideEffects	= (1 << 1),	// reading the register changes hardware state
+	kU3RegAccessSerialized		= kU3RegAccessRMW | kU3RegAccessReadSideEffects
+};
+
+// Register lock domains.  Each independent block of the Uni-N register space has its own
+// lock, and a register's shadow (if any) is protected by its domain's lock.  Anything that
+// spans blocks (safeRegTransaction, shadow setup/verification) takes the domains it needs
+// in ascending order of this enum - never acquire a lower domain while holding a higher one.
+enum
+{
+	kU3LockDomainAPI		= 0,	// API exception and chip fault / API mask registers
+	kU3LockDomainMemCtl		= 1,	// memory controller and ECC: MCCR, MEAR, MESR
+	kU3LockDomainDART		= 2,	// DART control and exception registers
+	kU3LockDomainHT			= 3,	// HyperTransport link configuration
+	kU3LockDomainToggle		= 4,	// MPIC toggle register
+	kU3LockDomainMisc		= 5,	// everything else (version, HWInit, clocks, PHY config)
+	kU3NumLockDomains		= 6,
+	kU3AllLockDomains		= (1 << kU3NumLockDomains) - 1
+};
+
+typedef struct _u3_reg_access_t
+{
+	UInt32	offset;
+	UInt32	flags;
+	UInt32	domain;		// kU3LockDomainXXX
+} u3_reg_access_t;
+
+// AppleU3's classification table is looked up on every register access, so start() copies it
+// once into an open-addressed index of kU3RegAccessSlots entries.  A lookup is one hash and
+// usually one probe; an unlisted register stops at the first empty slot.
+#define kU3RegAccessSlots		64		// must be a power of 2, at least twice the table size
+#define kU3RegAccessEmpty		0xFFFFFFFF
+
+static inline UInt32 U3RegHash( UInt32 offset )
+{
+	return ((offset >> 2) * 2654435761U) >> 16;
+}
+
+// **********************************************************************************
+// U3BuildRegAccessIndex
+//
+// Entries go in in table order and a repeated offset is skipped, so the first match in
+// table still wins
+// **********************************************************************************
+static inline void U3BuildRegAccessIndex( const u3_reg_access_t *table, UInt32 count, u3_reg_access_t *index )
+{
+	UInt32 i, slot;
+
+	for (slot = 0; slot < kU3RegAccessSlots; slot++)
+		index[slot].offset = kU3RegAccessEmpty;
+
+	for (i = 0; i < count; i++) {
+		for (slot = U3RegHash(table[i].offset) & (kU3RegAccessSlots - 1);
+				(index[slot].offset != kU3RegAccessEmpty) && (index[slot].offset != table[i].offset);
+				slot = (slot + 1) & (kU3RegAccessSlots - 1))
+			;
+
+		if (index[slot].offset == kU3RegAccessEmpty)
+			index[slot] = table[i];
+	}
+}
+
+// **********************************************************************************
+// U3FindRegAccess
+//
+// Returns offset's entry in index, or NULL for a plain register in kU3LockDomainMisc
+// **********************************************************************************
+static inline const u3_reg_access_t *U3FindRegAccess( const u3_reg_access_t *index, UInt32 offset )
+{
+	UInt32 slot;
+
+	for (slot = U3RegHash(offset) & (kU3RegAccessSlots - 1);
+			index[slot].offset != kU3RegAccessEmpty;
+			slot = (slot + 1) & (kU3RegAccessSlots - 1))
+		if (index[slot].offset == offset)
+			return &index[slot];
+
+	return 0;
+}
+
+// **********************************************************************************
+// U3ReadRegClassified
+//
+// Reads offset through a U3RegTransaction.h port.  A single aligned load can't be torn by a
+// concurrent read-modify-write, so plain registers are read without the lock and with
+// interrupts left enabled.  Only registers with read side effects or that the driver
+// read-modify-writes are read under their domain lock.
+// **********************************************************************************
+template <class Port> UInt32 U3ReadRegClassified( Port &port, const u3_reg_access_t *index, UInt32 offset )
+{
+	const u3_reg_access_t		*access = U3FindRegAccess(index, offset);
+	typename Port::LockState	lockState;
+	UInt32						domainMask, data;
+
+	if (!access || !(access->flags & kU3RegAccessSerialized))
+		return port.load(offset);
+
+	domainMask = 1 << access->domain;
+	lockState = port.lock(domainMask);
+	data = port.load(offset);
+	port.unlock(domainMask, lockState);
+
+	return data;
+}
+
+#endif /* _IOKIT_U3_REG_ACCESS_H */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+
+#ifndef _IOKIT_U3_REG_FIELD_H
+#define _IOKIT_U3_REG_FIELD_H
+
+#include <libkern/OSTypes.h>
+
+// Register field descriptors.  A field is a register offset plus a contiguous run of bits given
+// by its mask; shift and width are derived from the mask at compile time.  Fields that are empty,
+// not contiguous or that overlap another field of the same register fail to compile - the
+// checks use arrays of negative size since the compiler has no static assertions.
+template <UInt32 Mask> struct U3FieldShift
+{
+	enum { value = (Mask & 1) ? 0 : 1 + U3FieldShift<(Mask >> 1)>::value };
+};
+
+template <> struct U3FieldShift<0>
+{
+	enum { value = 0 };
+};
+
+template <UInt32 Offset, UInt32 Mask> struct U3RegField
+{
+	enum { offset = Offset, mask = Mask, shift = U3FieldShift<Mask>::value };
+
+	typedef char fieldIsNotEmpty[(Mask != 0) ? 1 : -1];
+	typedef char fieldIsContiguous[((((Mask >> shift) + 1) & (Mask >> shift)) == 0) ? 1 : -1];
+	typedef char offsetIsAligned[((Offset & 3) == 0) ? 1 : -1];
+};
+
+template <class FieldA, class FieldB> struct U3RegFieldsDisjoint
+{
+	typedef char fieldsDoNotOverlap[(((UInt32)FieldA::offset != (UInt32)FieldB::offset) ||
+		(((UInt32)FieldA::mask & (UInt32)FieldB::mask) == 0)) ? 1 : -1];
+	fieldsDoNotOverlap	check;
+};
+
+#define U3_CHECK_REG_FIELD(field)				typedef char field##_checked[sizeof(field::fieldIsNotEmpty) + \
+													sizeof(field::fieldIsContiguous) + sizeof(field::offsetIsAligned)]
+#define U3_CHECK_REG_FIELD_SHIFT(field, s)		typedef char field##_shift_checked[((UInt32)field::shift == (UInt32)(s)) ? 1 : -1]
+#define U3_CHECK_REG_FIELDS_DISJOINT(a, b)		typedef char a##_##b##_disjoint[sizeof(U3RegFieldsDisjoint<a, b>)]
+
+// Field value of a register value, and a register value with the field replaced.  Field values
+// wider than the field are truncated to it.
+template <class Field> inline UInt32 U3GetRegField(UInt32 regValue)
+{
+	return (regValue & (UInt32)Field::mask) >> Field::shift;
+}
+
+template <class Field> inline UInt32 U3SetRegField(UInt32 regValue, UInt32 fieldValue)
+{
+	return (regValue & ~(UInt32)Field::mask) | ((fieldValue << Field::shift) & (UInt32)Field::mask);
+}
+
+#endif /* _IOKIT_U3_REG_FIELD_H */
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2002-2007 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * Copyright (c) 2002-2007 Apple Inc.  All rights reserved.
+ *
+ *  DRI: Dave Radcliffe
+ *
+ */
+
+
+#ifndef _IOKIT_U3_REG_TRANSACTION_H
+#define _IOKIT_U3_REG_TRANSACTION_H
+
+#include <libkern/OSTypes.h>
+
+// Batched register transactions.  A list of these is passed to the "safeRegTransactionUInt32"
+// platform function (param1 = list, param2 = entry count).  The whole list is executed under a
+// single acquisition of the register locks it spans, with I/O fences issued only where ordering requires one.
+#define kU3SafeRegTransactionFuncName	"safeRegTransactionUInt32"
+
+enum
+{
+	kU3RegOpRead	= 0,	// value = register
+	kU3RegOpWrite	= 1		// register = (register & ~mask) | (value & mask), a mask of ~0 skips the read
+};
+
+typedef struct _u3_reg_transaction_t
+{
+	UInt32	op;
+	UInt32	offset;
+	UInt32	mask;
+	UInt32	value;
+} u3_reg_transaction_t;
+
+// The register engine is written against a port rather than AppleU3, so it builds without IOKit
+// and the HostTests can count the locks and fences it issues.  A port provides
+//
+//	LockState lock(UInt32 domainMask)			unlock(UInt32 domainMask, LockState state)
+//	UInt32 lockDomain(UInt32 offset)			kU3LockDomain* of a register
+//	SInt32 shadowIndex(UInt32 offset)			-1 if the register isn't shadowed
+//	UInt32 shadow(SInt32 index)					updateShadow(SInt32 index, UInt32 data), -1 is ignored
+//	UInt32 load(UInt32 offset)					store(UInt32 offset, UInt32 data), unfenced
+//	void fence()
+
+// **********************************************************************************
+// U3RunRegTransaction
+//
+// Runs list under one acquisition of the domains it spans.  Returns false, having touched
+// nothing, if an entry has an unknown op.
+// **********************************************************************************
+template <class Port> bool U3RunRegTransaction( Port &port, u3_reg_transaction_t *list, UInt32 count )
+{
+	typename Port::LockState	lockState;
+	UInt32						i, currentReg, domainMask = 0;
+	SInt32						shadowIndex;
+	bool						fencePending = false;
+
+	if (list == 0 || count == 0)
+		return false;
+
+	// Validate the whole list before touching any hardware, and collect the lock domains it spans
+	for (i = 0; i < count; i++)
+	{
+		if (list[i].op != kU3RegOpRead && list[i].op != kU3RegOpWrite)
+			return false;
+
+		domainMask |= 1 << port.lockDomain(list[i].offset);
+	}
+
+	lockState = port.lock(domainMask);
+
+	for (i = 0; i < count; i++)
+	{
+		shadowIndex = port.shadowIndex(list[i].offset);
+
+		if (list[i].op == kU3RegOpWrite && (list[i].mask == 0xFFFFFFFF || shadowIndex >= 0))
+		{
+			// Just write out the data, or modify the shadow of a driver-owned register
+			if (list[i].mask == 0xFFFFFFFF)
+				currentReg = list[i].value;
+			else
+				currentReg = (port.shadow(shadowIndex) & ~list[i].mask) | (list[i].value & list[i].mask);
+
+			port.store(list[i].offset, currentReg);
+			port.updateShadow(shadowIndex, currentReg);
+			fencePending = true;
+			continue;
+		}
+
+		// Keep earlier stores ordered ahead of this load
+		if (fencePending)
+		{
+			port.fence();
+			fencePending = false;
+		}
+
+		currentReg = port.load(list[i].offset);
+
+		if (list[i].op == kU3RegOpRead)
+			list[i].value = currentReg;
+		else
+		{
+			// read, modify then write the data
+			currentReg = (currentReg & ~list[i].mask) | (list[i].value & list[i].mask);
+			port.store(list[i].offset, currentReg);
+			fencePending = true;
+		}
+	}
+
+	if (fencePending)
+		port.fence();
+
+	port.unlock(domainMask, lockState);
+
+	return true;
+}
+
+// **********************************************************************************
+// U3WriteRegKeepingBits
+//
+// reg = (reg & keepMask) | value, fenced.  The kept bits come from the shadow of a driver-owned
+// register and the shadow is kept current.  The caller holds the register's domain.
+// **********************************************************************************
+template <class Port> UInt32 U3WriteRegKeepingBits( Port &port, UInt32 offset, UInt32 keepMask, UInt32 value )
+{
+	SInt32	shadowIndex = port.shadowIndex(offset);
+	UInt32	currentReg = value;
+
+	if (keepMask)
+		currentReg |= ((shadowIndex >= 0) ? port.shadow(shadowIndex) : port.load(offset)) & keepMask;
+
+	port.store(offset, currentReg);
+	port.fence();
+	port.updateShadow(shadowIndex, currentReg);
+
+	return currentReg;
+}
+
+#endif /* _IOKIT_U3_REG_TRANSACTION_H */